@@ -0,0 +1,102 @@
+#include "audio.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+Audio::Audio(const uint16_t buffer, const int frequency) : frequency{frequency} {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        throw std::runtime_error{std::string{"error starting audio: "} + SDL_GetError()};
+    }
+
+    SDL_AudioSpec wanted{};
+    SDL_AudioSpec got{};
+
+    wanted.freq = 48000;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = buffer;
+    wanted.callback = &Audio::callback;
+    wanted.userdata = this;
+
+    device = SDL_OpenAudioDevice(
+        nullptr,
+        0,
+        &wanted,
+        &got,
+        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+
+    if (device == 0) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        throw std::runtime_error{std::string{"error opening audio device: "} + SDL_GetError()};
+    }
+
+    rate = got.freq;
+    this->buffer = got.samples;
+    step = static_cast<uint32_t>((uint64_t{TONE} << 32) / rate);
+    samples.resize((rate + frequency - 1) / frequency);
+
+    SDL_PauseAudioDevice(device, 0);
+}
+
+Audio::~Audio() {
+    SDL_CloseAudioDevice(device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+void Audio::frame(const bool beeping) {
+    // NOTE: worked out from the frame count rather than rounded per frame, so
+    // e.g. 44.1 kHz at 60 frames a second doesn't drift
+    const size_t count = (frames + 1) * rate / frequency - frames * rate / frequency;
+    const size_t queued = ring.size();
+    const size_t limit = samples.size() + buffer;
+    const size_t room = queued < limit ? limit - queued : 0;
+
+    ++frames;
+
+    // NOTE: the wave carries on from wherever the last frame left it, beep
+    // or no beep, so it never jumps partway through a cycle
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = beeping ? (phase & 0x80000000 ? VOLUME : -VOLUME) : 0;
+        phase += step;
+    }
+
+    const size_t pushed = ring.push(samples.data(), std::min(count, room));
+
+    dropped += count - pushed;
+
+    if (pushed > 0) {
+        ++heard;
+        waited += queued + buffer;
+        worst_wait = std::max<uint64_t>(worst_wait, queued + buffer);
+    }
+}
+
+void Audio::report(std::ostream& out) const {
+    const double mean = heard > 0 ? 1000.0 * waited / heard / rate : 0;
+
+    out << "audio: " << rate << " Hz, " << buffer << " sample buffer"
+        << ", latency mean " << mean << " ms, worst " << 1000.0 * worst_wait / rate << " ms"
+        << "; " << underruns.load(std::memory_order_relaxed) << " underruns ("
+        << missing.load(std::memory_order_relaxed) << " samples), "
+        << dropped << " samples dropped\n";
+}
+
+// NOTE: this runs on SDL's audio thread, so all it does is copy out of the
+// ring: no allocating, locking or waiting
+void Audio::callback(void* userdata, uint8_t* stream, const int length) {
+    Audio& audio = *static_cast<Audio*>(userdata);
+    int16_t* out = reinterpret_cast<int16_t*>(stream);
+    const size_t wanted = length / sizeof(int16_t);
+    const size_t popped = audio.ring.pop(out, wanted);
+
+    std::fill(out + popped, out + wanted, 0);
+
+    // NOTE: running short before the emulator's got going isn't an underrun;
+    // afterwards it is, even while it's stopped (e.g. in the debugger)
+    audio.started = audio.started || popped > 0;
+
+    if (audio.started && popped < wanted) {
+        audio.underruns.fetch_add(1, std::memory_order_relaxed);
+        audio.missing.fetch_add(wanted - popped, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,84 @@
+#include "SDL2/SDL.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "spsc_queue.h"
+
+#ifndef CHIP8_AUDIO_H
+#define CHIP8_AUDIO_H
+
+// the beep: a square wave for as long as the sound timer's running
+//
+// the emulator synthesizes a frame's worth of samples at a time (see
+// `frame`) into a ring that SDL's audio thread drains from its callback, so
+// neither ever waits on the other; the emulator just drops whatever doesn't
+// fit, and the callback plays silence for whatever isn't there yet (each
+// counted, see `report`)
+//
+// NOTE: the ring's only ever let fill up to a frame's worth of samples past
+// what the device asks for at a time, which bounds how long a change to the
+// sound timer takes to be heard; a smaller `buffer` gets that down further
+// (e.g. 256 samples is about 5 ms at 48 kHz) at the cost of more underruns
+// if the callback gets held up
+class Audio {
+public:
+    // the pitch of the beep, in Hz
+    static constexpr uint32_t TONE = 440;
+
+    // how loud it is, out of 32767
+    static constexpr int16_t VOLUME = 3000;
+
+    // the most samples we hold on to between the emulator and the callback
+    static constexpr size_t RING = 1 << 13;
+
+    // `buffer` is how many samples the device should ask for at a time, and
+    // `frequency` how often a frame comes (as for `FrameClock`); throws
+    // `std::runtime_error` if there's no audio to be had
+    Audio(const uint16_t buffer, const int frequency);
+    ~Audio();
+
+    Audio(const Audio&) = delete;
+    Audio& operator=(const Audio&) = delete;
+
+    // queue up the next frame's worth of samples, beeping throughout if
+    // `beeping` (only for the emulator's thread)
+    void frame(const bool beeping);
+
+    // what the counters say, on a line (call once the emulator's stopped)
+    void report(std::ostream& out) const;
+
+private:
+    SDL_AudioDeviceID device = 0;
+    int rate = 0;
+    uint16_t buffer = 0;
+    int frequency = 0;
+
+    SpscQueue<int16_t, RING> ring;
+
+    // the emulator's side: how many frames it's queued (which is how the
+    // samples are divided up between them), where the square wave's up to,
+    // and room to synthesize a frame in without allocating
+    uint64_t frames = 0;
+    uint32_t phase = 0;
+    uint32_t step = 0;
+    std::vector<int16_t> samples;
+
+    // how many samples didn't fit, and how long the frames that did had to
+    // wait to be played (samples already queued plus a device buffer)
+    uint64_t dropped = 0;
+    uint64_t heard = 0;
+    uint64_t waited = 0;
+    uint64_t worst_wait = 0;
+
+    // the callback's side: whether it's had anything yet, how many times
+    // it's run short since, and by how many samples in all
+    bool started = false;
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> missing{0};
+
+    static void callback(void* userdata, uint8_t* stream, int length);
+};
+
+#endif
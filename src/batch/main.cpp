@@ -0,0 +1,615 @@
+#include "../chip8.h"
+#include "../frame_sink.h"
+#include "../jit.h"
+#include "../json.h"
+#include "../pool.h"
+#include "../lockstep.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// runs a batch of ROMs headlessly (no window, no pacing) across every core,
+// and prints one line of JSON per job with the state it ended up in
+//
+// each non-empty line of the jobs file is `<ROM> <cycles> [input script]`
+// (lines starting with `#` are skipped), and each line of an input script is
+// `<frame> <key> <down|up>`, with the key in hex, e.g. `120 5 down`
+
+struct Job {
+    std::string rom;
+    uint64_t cycles = 0;
+    std::string script;
+};
+
+struct Result {
+    std::string json;
+    bool failed = false;
+};
+
+struct Input {
+    uint64_t frame = 0;
+    uint8_t key = 0;
+    bool down = false;
+};
+
+static std::vector<Job> read_jobs(const std::string& filename) {
+    std::ifstream file{filename};
+
+    if (!file.is_open()) {
+        throw std::runtime_error{"error opening jobs file"};
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        std::istringstream fields{line};
+        Job job;
+
+        if (!(fields >> job.rom) || job.rom.front() == '#') {
+            continue;
+        }
+
+        if (!(fields >> job.cycles)) {
+            throw std::runtime_error{"jobs file line " + std::to_string(number) + ": expected a cycle count"};
+        }
+
+        fields >> job.script;
+        jobs.push_back(std::move(job));
+    }
+
+    return jobs;
+}
+
+static std::vector<Input> read_script(const std::string& filename) {
+    std::ifstream file{filename};
+
+    if (!file.is_open()) {
+        throw std::runtime_error{"error opening input script " + filename};
+    }
+
+    std::vector<Input> inputs;
+    std::string line;
+
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        std::istringstream fields{line};
+        Input input;
+        unsigned key;
+        std::string action;
+
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line.front() == '#') {
+            continue;
+        }
+
+        if (!(fields >> input.frame >> std::hex >> key >> action) || key > 0xF || (action != "down" && action != "up")) {
+            throw std::runtime_error{filename + " line " + std::to_string(number) + ": expected <frame> <key> <down|up>"};
+        }
+
+        input.key = key;
+        input.down = action == "down";
+        inputs.push_back(input);
+    }
+
+    // NOTE: stable, so presses and releases on the same frame keep their order
+    std::stable_sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) {
+        return a.frame < b.frame;
+    });
+
+    return inputs;
+}
+
+// split the jobs up into groups of at most `LOCKSTEP_LANES` with the same ROM
+// and cycle budget (as indices into `jobs`)
+static std::vector<std::vector<size_t>> group_jobs(const std::vector<Job>& jobs) {
+    std::map<std::pair<std::string, uint64_t>, std::vector<size_t>> alike;
+    std::vector<std::vector<size_t>> groups;
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        alike[{jobs[i].rom, jobs[i].cycles}].push_back(i);
+    }
+
+    for (const auto& [key, indices] : alike) {
+        for (size_t i = 0; i < indices.size(); i += LOCKSTEP_LANES) {
+            const size_t end = std::min(indices.size(), i + LOCKSTEP_LANES);
+
+            groups.emplace_back(indices.begin() + i, indices.begin() + end);
+        }
+    }
+
+    return groups;
+}
+
+// where a job ended up
+struct Outcome {
+    uint64_t executed = 0;
+    uint64_t elided = 0;
+    uint64_t frames = 0;
+    uint64_t screen = 0;
+    uint16_t pc = 0;
+    uint16_t index = 0;
+    std::array<uint8_t, 16> registers = {};
+    std::chrono::steady_clock::duration wall{};
+    std::string error;
+};
+
+static Result describe(const Job& job, const Outcome& outcome) {
+    std::ostringstream out;
+
+    out << "{\"rom\":" << quote(job.rom)
+        << ",\"script\":" << (job.script.empty() ? "null" : quote(job.script))
+        << ",\"cycles\":" << job.cycles
+        << ",\"executed\":" << outcome.executed
+        << ",\"elided\":" << outcome.elided
+        << ",\"frames\":" << outcome.frames
+        << ",\"screen\":\"" << std::hex << std::setw(16) << std::setfill('0') << outcome.screen << std::dec << '"'
+        << ",\"pc\":" << outcome.pc
+        << ",\"index\":" << outcome.index
+        << ",\"registers\":[";
+
+    for (size_t i = 0; i < outcome.registers.size(); ++i) {
+        out << (i ? "," : "") << int{outcome.registers[i]};
+    }
+
+    out << "],\"wall_ns\":" << std::chrono::duration_cast<std::chrono::nanoseconds>(outcome.wall).count()
+        << ",\"error\":" << (outcome.error.empty() ? "null" : quote(outcome.error))
+        << '}';
+
+    return {out.str(), !outcome.error.empty()};
+}
+
+// every ROM the jobs use, read once up front so all the jobs running the same
+// ROM share one copy of it (see `Chip8::load_image`)
+using Images = std::map<std::string, std::shared_ptr<const Chip8::Image>>;
+
+// NOTE: a ROM that can't be read is left out, so each of its jobs fails with
+// the error from trying to load it itself
+static Images read_roms(const std::vector<Job>& jobs) {
+    Images images;
+
+    for (const auto& job : jobs) {
+        if (images.count(job.rom)) {
+            continue;
+        }
+
+        try {
+            images[job.rom] = Chip8::read_rom(job.rom);
+        } catch (const std::exception&) {}
+    }
+
+    return images;
+}
+
+// where `--capture` writes each job's video to: `<directory>/<n>.<format>`
+// for the job on the `n`th line of the jobs file (counting from 0, and
+// leaving out blank lines and comments), `c8vd` for delta files
+struct Capture {
+    std::string directory;
+    VideoFormat format = VideoFormat::delta;
+
+    // the sink for `job`'s video, or nothing if we're not capturing or it
+    // couldn't be opened (with why in `error`)
+    std::unique_ptr<FrameSink> open(const size_t job, std::string& error) const {
+        if (directory.empty()) {
+            return nullptr;
+        }
+
+        const char* extension = format == VideoFormat::delta ? "c8vd" : format_name(format);
+
+        try {
+            return std::make_unique<FrameSink>(directory + '/' + std::to_string(job) + '.' + extension, format, TIMER_FREQUENCY);
+        } catch (const std::exception& e) {
+            error = e.what();
+            return nullptr;
+        }
+    }
+};
+
+// add `screen` to `sink`'s video, if there is one
+//
+// NOTE: a video that can't be written is no reason to stop the job it's of,
+// so the sink's just dropped, with why in `error` (which the job reports
+// unless it runs into an error of its own)
+static void capture_frame(std::unique_ptr<FrameSink>& sink, const Screen<64, 32>& screen, std::string& error) {
+    if (!sink) {
+        return;
+    }
+
+    try {
+        sink->write(screen);
+    } catch (const std::exception& e) {
+        error = e.what();
+        sink.reset();
+    }
+}
+
+// put `emu` back to power-on with the job's ROM loaded
+static void load(Chip8& emu, const Job& job, const Images& images) {
+    const auto image = images.find(job.rom);
+
+    if (image != images.end()) {
+        emu.load_image(image->second);
+    } else {
+        emu.load_rom(job.rom);
+    }
+}
+
+// run `job` on `emu` from the start of frame `outcome.frames` until its cycle
+// budget runs out (or it faults), pressing and releasing keys as `inputs`
+// say, and capturing every frame to `sink`; what it got through is added to
+// `outcome`
+//
+// NOTE: each frame's cycles are run by `run_cycles`, which is `emu`'s `run`
+// under some policy (see `Checked` and `Masked`) or a `Jit` on `emu` (which
+// throws, rather than returning, a fault)
+template <typename Run>
+static void run_frames(const Job& job, const std::vector<Input>& inputs, const uint64_t instructions_per_frame, Chip8& emu, Outcome& outcome, std::unique_ptr<FrameSink>& sink, std::string& capture_error, Run&& run_cycles) {
+    // NOTE: every frame before this one had a whole frame's worth of cycles
+    uint64_t remaining = job.cycles - std::min(job.cycles, outcome.frames * instructions_per_frame);
+    auto input = std::lower_bound(inputs.begin(), inputs.end(), outcome.frames, [](const Input& input, const uint64_t frame) {
+        return input.frame < frame;
+    });
+
+    // same frame structure as the interactive build: a frame's worth of
+    // instructions, then a timer tick
+    for (; remaining > 0; ++outcome.frames) {
+        const uint64_t budget = std::min(remaining, instructions_per_frame);
+
+        for (; input != inputs.end() && input->frame == outcome.frames; ++input) {
+            emu.keys_pressed[input->key] = input->down;
+        }
+
+        const Chip8::Status status = run_cycles(budget);
+
+        // NOTE: like `Lockstep`, a job doesn't count the cycles it ran in
+        // the frame that faulted
+        if (status.fault != Fault::none) {
+            outcome.error = message(status.fault);
+            break;
+        }
+
+        outcome.executed += status.executed;
+        emu.decrement_timers();
+        remaining -= budget;
+        capture_frame(sink, emu.screen, capture_error);
+    }
+}
+
+// fill in the state `emu` ended up in
+static void finish(Outcome& outcome, const Chip8& emu) {
+    outcome.elided = emu.elided();
+    outcome.screen = emu.screen.hash();
+    outcome.pc = emu.get_pc();
+    outcome.index = emu.get_index();
+    outcome.registers = emu.get_registers();
+}
+
+// run a single job to completion on `emu` (which is reset first, so workers
+// can reuse one machine for every job they run) with `run_cycles` (see
+// `run_frames`), capturing every frame if asked to
+template <typename Run>
+static Outcome run(const std::vector<Job>& jobs, const size_t index, const uint64_t instructions_per_frame, Chip8& emu, const Images& images, const Capture& capture, Run&& run_cycles) {
+    const Job& job = jobs[index];
+    const auto start = std::chrono::steady_clock::now();
+    Outcome outcome;
+    std::unique_ptr<FrameSink> sink;
+    std::string capture_error;
+
+    // NOTE: so a job that fails before it even starts doesn't report the
+    // last job's state
+    emu.reset();
+
+    try {
+        const auto inputs = job.script.empty() ? std::vector<Input>{} : read_script(job.script);
+
+        load(emu, job, images);
+        sink = capture.open(index, capture_error);
+        run_frames(job, inputs, instructions_per_frame, emu, outcome, sink, capture_error, run_cycles);
+    } catch (const std::exception& e) {
+        outcome.error = e.what();
+    }
+
+    if (outcome.error.empty()) {
+        outcome.error = capture_error;
+    }
+
+    finish(outcome, emu);
+    outcome.wall = std::chrono::steady_clock::now() - start;
+
+    return outcome;
+}
+
+// the fewest jobs worth running side by side (see `run_lanes`)
+//
+// NOTE: with AVX-512 (so 32 lanes), 64 jobs of the bundled ROMs whose lanes
+// never drift apart run about twice as fast as on their own, i.e. a lockstep
+// instruction costs about as much as 16 scalar ones, so this is where it
+// breaks even
+constexpr size_t LOCKSTEP_MIN_JOBS = LOCKSTEP_LANES / 2;
+
+// run up to `LOCKSTEP_LANES` jobs with the same ROM and cycle budget (given by
+// their indices into `jobs`) side by side, same as running each of them
+// separately on `emu` (except that they all report the time taken by the
+// whole group), under `Policy`, with `Quirks` (which have to be `emu`'s)
+//
+// NOTE: lanes that take different inputs soon drift apart, and hardly ever
+// meet up again, so once the lanes sharing each instruction drop below
+// `LOCKSTEP_MIN_JOBS` on average over a frame, every job still running is
+// picked up on `emu` from where its lane got to and finished on its own with
+// `run_cycles` (see `run_frames`), which has to run under `Policy` too
+template <typename Policy, typename Quirks, typename Run>
+static std::vector<Outcome> run_lanes(const std::vector<Job>& jobs, const std::vector<size_t>& lanes, const uint64_t instructions_per_frame, Chip8& emu, const Images& images, const Capture& capture, Run&& run_cycles) {
+    const auto start = std::chrono::steady_clock::now();
+    const Job& first = jobs[lanes.front()];
+    std::vector<std::vector<Input>> inputs;
+    std::vector<std::unique_ptr<FrameSink>> sinks;
+    std::vector<std::string> capture_errors(lanes.size());
+
+    // NOTE: a group too small to be worth it runs a job at a time, the same
+    // as everything that would stop a job before it even starts (which is
+    // easiest to report by just running the job on its own)
+    const auto one_at_a_time = [&] {
+        std::vector<Outcome> outcomes;
+
+        for (const size_t job : lanes) {
+            outcomes.push_back(run(jobs, job, instructions_per_frame, emu, images, capture, run_cycles));
+        }
+
+        return outcomes;
+    };
+
+    if (lanes.size() < LOCKSTEP_MIN_JOBS) {
+        return one_at_a_time();
+    }
+
+    try {
+        for (const size_t job : lanes) {
+            inputs.push_back(jobs[job].script.empty() ? std::vector<Input>{} : read_script(jobs[job].script));
+        }
+
+        load(emu, first, images);
+    } catch (const std::exception&) {
+        return one_at_a_time();
+    }
+
+    // NOTE: only opened once we know we're not falling back on running the
+    // jobs one at a time, which would open them all over again
+    for (size_t lane = 0; lane < lanes.size(); ++lane) {
+        sinks.push_back(capture.open(lanes[lane], capture_errors[lane]));
+    }
+
+    auto engine = std::make_unique<Lockstep<LOCKSTEP_LANES, Policy, Quirks>>(emu, lanes.size());
+    std::vector<Outcome> outcomes(lanes.size());
+    std::vector<size_t> next_input(lanes.size());
+    uint64_t remaining = first.cycles;
+    bool apart = false;
+
+    for (uint64_t frames = 0; remaining > 0 && !apart; ++frames) {
+        const uint64_t budget = std::min(remaining, instructions_per_frame);
+        const uint64_t lane_steps = engine->lane_steps();
+        const uint64_t group_steps = engine->group_steps();
+
+        for (size_t lane = 0; lane < lanes.size(); ++lane) {
+            auto& input = next_input[lane];
+
+            for (; input < inputs[lane].size() && inputs[lane][input].frame == frames; ++input) {
+                engine->set_key(lane, inputs[lane][input].key, inputs[lane][input].down);
+            }
+        }
+
+        engine->run(budget);
+        engine->decrement_timers();
+        remaining -= budget;
+
+        // NOTE: a job that runs into an error stops counting (and capturing)
+        // frames there
+        for (size_t lane = 0; lane < lanes.size(); ++lane) {
+            if (engine->fault(lane) == Fault::none) {
+                outcomes[lane].frames = frames + 1;
+                capture_frame(sinks[lane], engine->screen(lane), capture_errors[lane]);
+            }
+        }
+
+        apart = engine->lane_steps() - lane_steps < (engine->group_steps() - group_steps) * LOCKSTEP_MIN_JOBS;
+    }
+
+    for (size_t lane = 0; lane < lanes.size(); ++lane) {
+        auto& outcome = outcomes[lane];
+
+        outcome.executed = engine->executed(lane);
+
+        if (engine->fault(lane) != Fault::none) {
+            outcome.error = message(engine->fault(lane));
+        }
+
+        if (remaining > 0 && outcome.error.empty()) {
+            emu.reset();
+            engine->copy_to(lane, emu);
+            // NOTE: same as `run`, a job that faults from here on throws if
+            // it's on the `Jit`
+            try {
+                run_frames(jobs[lanes[lane]], inputs[lane], instructions_per_frame, emu, outcome, sinks[lane], capture_errors[lane], run_cycles);
+            } catch (const std::exception& e) {
+                outcome.error = e.what();
+            }
+
+            finish(outcome, emu);
+        } else {
+            outcome.elided = engine->elided(lane);
+            outcome.screen = engine->screen(lane).hash();
+            outcome.pc = engine->get_pc(lane);
+            outcome.index = engine->get_index(lane);
+            outcome.registers = engine->get_registers(lane);
+        }
+
+        if (outcome.error.empty()) {
+            outcome.error = capture_errors[lane];
+        }
+    }
+
+    const auto wall = std::chrono::steady_clock::now() - start;
+
+    for (auto& outcome : outcomes) {
+        outcome.wall = wall;
+    }
+
+    return outcomes;
+}
+
+int main(int argc, char** argv) {
+    // NOTE: `--lockstep` runs jobs with the same ROM and cycle budget
+    // together on a `Lockstep` engine instead of one `Chip8` each (which
+    // only pays off for as long as their inputs agree, see `run_lanes`),
+    // `--jit` runs each job (and each lane a lockstep group hands off) on a
+    // `Jit` rather than interpreting it, which only pays off once a frame
+    // runs a thousand or so instructions, `--masked` runs trusted ROMs without
+    // bounds checks (see `Masked`), and `--quirks` runs every job under one of
+    // the profiles (see `Profile`), and `--capture` writes every frame of
+    // every job out as video (see `Capture`)
+    bool lockstep = false;
+    bool jit = false;
+    bool masked = false;
+    std::string quirks_option = profile_name(Profile::modern);
+    std::string format_option;
+    Capture capture;
+
+    for (; argc > 1; --argc, ++argv) {
+        const std::string option = argv[1];
+
+        if (option == "--lockstep") {
+            lockstep = true;
+        } else if (option == "--jit") {
+            jit = true;
+        } else if (option == "--masked") {
+            masked = true;
+        } else if (option == "--quirks" && argc > 2) {
+            quirks_option = argv[2];
+            --argc;
+            ++argv;
+        } else if (option == "--capture" && argc > 3) {
+            format_option = argv[2];
+            capture.directory = argv[3];
+            argc -= 2;
+            argv += 2;
+        } else {
+            break;
+        }
+    }
+
+    if (argc != 3 && argc != 4) {
+        std::cerr << "usage: chip8-batch [--lockstep] [--jit] [--masked] [--quirks <vip|chip48|schip|modern>] "
+            "[--capture <y4m|ppm|delta> <directory>] <jobs file> <instructions per frame> [threads]";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        const Profile profile = find_profile(quirks_option);
+
+        if (!capture.directory.empty()) {
+            capture.format = find_format(format_option);
+        }
+        const auto jobs = read_jobs(argv[1]);
+        const uint64_t instructions_per_frame = std::stoull(argv[2]);
+        const size_t threads = argc == 4 ? std::stoul(argv[3]) : std::thread::hardware_concurrency();
+
+        if (instructions_per_frame == 0) {
+            throw std::invalid_argument{"instructions per frame must be positive"};
+        }
+
+        if (jit && masked) {
+            throw std::invalid_argument{"the JIT only runs checked, so --jit can't be used with --masked"};
+        }
+
+        // NOTE: every job writes its own slot, and nothing's printed until the
+        // end, so the output is in the same order as the jobs file no matter
+        // which worker ran what
+        std::vector<Result> results(jobs.size());
+        Pool pool{threads};
+        const auto images = read_roms(jobs);
+
+        // NOTE: each worker makes one machine (and JIT) the first time it
+        // needs it and resets it for every job after that, so its decode
+        // cache (and code buffer) only ever gets allocated once, and a JIT
+        // can keep what it's translated for as long as the ROM's the same
+        std::vector<std::unique_ptr<Chip8>> machines(pool.threads());
+        std::vector<std::unique_ptr<Jit>> jits(pool.threads());
+
+        const auto machine = [&](const size_t worker) -> Chip8& {
+            if (!machines[worker]) {
+                machines[worker] = std::make_unique<Chip8>();
+                machines[worker]->set_profile(profile);
+            }
+
+            return *machines[worker];
+        };
+
+        // call `f` with how `worker` runs a job's cycles on its machine (see
+        // `run_frames`)
+        const auto with_engine = [&](const size_t worker, auto&& f) {
+            Chip8& emu = machine(worker);
+
+            if (jit) {
+                if (!jits[worker]) {
+                    jits[worker] = std::make_unique<Jit>(emu);
+                }
+
+                return f(emu, [&](const uint64_t cycles) {
+                    return Chip8::Status{jits[worker]->run(cycles)};
+                });
+            }
+
+            return masked
+                ? f(emu, [&](const uint64_t cycles) { return emu.run<Masked>(cycles); })
+                : f(emu, [&](const uint64_t cycles) { return emu.run<Checked>(cycles); });
+        };
+
+        if (lockstep) {
+            const auto groups = group_jobs(jobs);
+
+            pool.run(groups.size(), [&](size_t worker, size_t i) {
+                const auto outcomes = with_engine(worker, [&](Chip8& emu, auto run_cycles) {
+                    return with_quirks(profile, [&](auto quirks) {
+                        return masked
+                            ? run_lanes<Masked, decltype(quirks)>(jobs, groups[i], instructions_per_frame, emu, images, capture, run_cycles)
+                            : run_lanes<Checked, decltype(quirks)>(jobs, groups[i], instructions_per_frame, emu, images, capture, run_cycles);
+                    });
+                });
+
+                for (size_t lane = 0; lane < groups[i].size(); ++lane) {
+                    results[groups[i][lane]] = describe(jobs[groups[i][lane]], outcomes[lane]);
+                }
+            });
+        } else {
+            pool.run(jobs.size(), [&](size_t worker, size_t i) {
+                const auto outcome = with_engine(worker, [&](Chip8& emu, auto run_cycles) {
+                    return run(jobs, i, instructions_per_frame, emu, images, capture, run_cycles);
+                });
+
+                results[i] = describe(jobs[i], outcome);
+            });
+        }
+
+        bool failed = false;
+
+        for (const auto& result : results) {
+            std::cout << result.json << '\n';
+            failed |= result.failed;
+        }
+
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const std::exception& e) {
+        std::cerr << "chip8-batch: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
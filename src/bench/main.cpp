@@ -0,0 +1,448 @@
+#include "../chip8.h"
+#include "../jit.h"
+#include "../json.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// runs ROMs (the bundled ones unless told otherwise) and a couple of synthetic
+// microbenchmarks headlessly for a fixed number of cycles on each way of
+// running instructions, and prints one line of JSON per run with how fast it
+// went, so runs of different builds (e.g. `bench` against
+// `bench-specialized`) can be compared side by side
+//
+// every run has the same frame structure as the interactive build (a frame's
+// worth of instructions, then a timer tick), with keys pressed on a fixed
+// schedule so ROMs waiting on input get somewhere
+
+// NOTE: every allocation (and nothing else) goes through these, so we can tell
+// whether running a frame allocates; they're all kept out of line, since once
+// GCC inlines a pair of them it sees a `malloc` handed to `operator delete`
+// (or a `new` to `free`) and warns about a mismatch (`-Wmismatched-new-delete`)
+static uint64_t allocations = 0;
+
+[[gnu::noinline]] void* operator new(const size_t size) {
+    ++allocations;
+
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+
+    throw std::bad_alloc{};
+}
+
+[[gnu::noinline]] void* operator new(const size_t size, const std::align_val_t alignment) {
+    ++allocations;
+
+    const size_t align = static_cast<size_t>(alignment);
+
+    // NOTE: `aligned_alloc` wants the size to be a multiple of the alignment
+    if (void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return pointer;
+    }
+
+    throw std::bad_alloc{};
+}
+
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+// counts the cache misses (of any level, as the kernel sees it) this thread
+// runs into between `start` and `stop`, where the hardware and kernel let us
+class CacheMisses {
+public:
+    CacheMisses() {
+        #ifdef __linux__
+        perf_event_attr attributes{};
+
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        #endif
+    }
+
+    ~CacheMisses() {
+        #ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+        #endif
+    }
+
+    CacheMisses(const CacheMisses&) = delete;
+    CacheMisses& operator=(const CacheMisses&) = delete;
+
+    void start() {
+        #ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        #endif
+    }
+
+    // nothing if they can't be counted here
+    std::optional<uint64_t> stop() {
+        #ifdef __linux__
+        uint64_t misses = 0;
+
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+            if (read(fd, &misses, sizeof(misses)) == sizeof(misses)) {
+                return misses;
+            }
+        }
+        #endif
+
+        return std::nullopt;
+    }
+
+private:
+    int fd = -1;
+};
+
+struct Benchmark {
+    std::string name;
+    std::shared_ptr<const Chip8::Image> image;
+
+    // for the draw microbenchmark: after `setup` instructions, every `period`
+    // instructions are `draws` draws followed by a jump back (0 if we don't
+    // count draws), and `baseline` is the same program with every draw
+    // swapped for an instruction that does nothing, to time it against
+    uint64_t setup = 0;
+    uint64_t period = 0;
+    uint64_t draws = 0;
+    std::shared_ptr<const Chip8::Image> baseline = nullptr;
+};
+
+static void emit(std::vector<uint8_t>& rom, const uint16_t instruction) {
+    rom.push_back(instruction >> 8);
+    rom.push_back(instruction & 0xFF);
+}
+
+// a loop of everyday instructions: arithmetic, logic, skips (taken and not),
+// `I` arithmetic, a BCD store and a load, and a call and return
+static Benchmark opcode_mix() {
+    constexpr size_t REPEATS = 64;
+
+    const std::vector<uint16_t> body = {
+        0x6012, // V0 = 0x12
+        0x7107, // V1 += 7
+        0x8014, // V0 += V1
+        0x8215, // V2 -= V1
+        0x8306, // V3 >>= 1
+        0x8417, // V4 = V1 - V4
+        0x8121, // V1 |= V2
+        0x8232, // V2 &= V3
+        0x8343, // V3 ^= V4
+        0x3000, // skip if V0 == 0
+        0x4111, // skip if V1 != 0x11
+        0x5230, // skip if V2 == V3
+        0xAE00, // I = 0xE00
+        0xF01E, // I += V0
+        0xF233, // BCD of V2 at I
+        0xF265, // load from I
+    };
+
+    // NOTE: the body repeated, a jump back to the start, then the subroutine
+    // every body calls (so the call never gets skipped over)
+    const uint16_t subroutine = START_ADDRESS + (REPEATS * (body.size() + 1) + 1) * 2;
+    std::vector<uint8_t> rom;
+
+    for (size_t i = 0; i < REPEATS; ++i) {
+        for (const uint16_t instruction : body) {
+            emit(rom, instruction);
+        }
+
+        emit(rom, 0x2000 | subroutine);
+    }
+
+    emit(rom, 0x1000 | START_ADDRESS);
+    emit(rom, 0x00EE);
+
+    return {"opcode-mix", Chip8::make_image(rom)};
+}
+
+// nothing but 5-row sprites (font digits) drawn all over the screen
+static Benchmark draw_heavy() {
+    constexpr uint64_t DRAWS = 1024;
+
+    std::vector<uint8_t> rom;
+
+    // spread the registers out over the screen, and point `I` at a digit
+    for (uint16_t x = 0; x < 16; ++x) {
+        emit(rom, 0x6000 | x << 8 | (x * 29 + 3) % 256);
+    }
+
+    emit(rom, 0xA000 | FONT_ADDRESS);
+
+    const uint64_t setup = rom.size() / 2;
+    const uint16_t loop = START_ADDRESS + rom.size();
+
+    // NOTE: the baseline adds 0 to the same `VX` in place of each draw, so
+    // everything but the draws themselves (the setup, the jumps back, the
+    // timer ticks, ...) is the same in both
+    std::vector<uint8_t> baseline = rom;
+
+    for (uint64_t i = 0; i < DRAWS; ++i) {
+        emit(rom, 0xD005 | (i % 15) << 8 | (i / 15 % 15) << 4);
+        emit(baseline, 0x7000 | (i % 15) << 8);
+    }
+
+    emit(rom, 0x1000 | loop);
+    emit(baseline, 0x1000 | loop);
+
+    return {"draw-heavy", Chip8::make_image(rom), setup, DRAWS + 1, DRAWS, Chip8::make_image(baseline)};
+}
+
+// runs up to `cycles` instructions on the machine it was made for, and
+// returns how many actually ran
+using Runner = std::function<uint64_t(uint64_t)>;
+
+struct Variant {
+    std::string name;
+    std::function<Runner(Chip8&)> make;
+};
+
+static std::vector<Variant> variants() {
+    return {
+        {"cycle", [](Chip8& emu) -> Runner {
+            return [&emu](const uint64_t cycles) {
+                for (uint64_t i = 0; i < cycles; ++i) {
+                    emu.cycle();
+                }
+
+                return cycles;
+            };
+        }},
+        {"run_decoded", [](Chip8& emu) -> Runner {
+            return [&emu](const uint64_t cycles) {
+                return emu.run_decoded(cycles);
+            };
+        }},
+        {"run_masked", [](Chip8& emu) -> Runner {
+            return [&emu](const uint64_t cycles) {
+                const auto status = emu.run<Masked>(cycles);
+
+                if (status.fault != Fault::none) {
+                    throw std::runtime_error{message(status.fault)};
+                }
+
+                return status.executed;
+            };
+        }},
+        {"jit", [](Chip8& emu) -> Runner {
+            auto jit = std::make_shared<Jit>(emu);
+
+            return [jit](const uint64_t cycles) {
+                return jit->run(cycles);
+            };
+        }},
+    };
+}
+
+struct Measurement {
+    uint64_t frames = 0;
+    uint64_t instructions = 0;
+    std::chrono::steady_clock::duration wall{};
+    uint64_t allocations = 0;
+    std::optional<uint64_t> cache_misses;
+    std::string error;
+};
+
+// run `cycles` worth of frames on `emu`, from power-on
+static Measurement measure(Chip8& emu, const Runner& run, const uint64_t cycles, const uint64_t instructions_per_frame, CacheMisses& cache_misses) {
+    Measurement measurement;
+
+    emu.reset();
+
+    const uint64_t allocated = allocations;
+    const auto start = std::chrono::steady_clock::now();
+
+    cache_misses.start();
+
+    try {
+        for (uint64_t remaining = cycles; remaining > 0; ++measurement.frames) {
+            const uint64_t budget = std::min(remaining, instructions_per_frame);
+            const uint64_t frame = measurement.frames;
+
+            // NOTE: each key in turn, pressed for 4 frames out of every 8
+            for (size_t key = 0; key < emu.keys_pressed.size(); ++key) {
+                emu.keys_pressed[key] = frame / 8 % 16 == key && frame % 8 < 4;
+            }
+
+            measurement.instructions += run(budget);
+            emu.decrement_timers();
+            remaining -= budget;
+        }
+    } catch (const std::exception& e) {
+        measurement.error = e.what();
+    }
+
+    measurement.cache_misses = cache_misses.stop();
+    measurement.wall = std::chrono::steady_clock::now() - start;
+    measurement.allocations = allocations - allocated;
+
+    return measurement;
+}
+
+// run `variant` on `image` for `cycles` worth of frames, on a machine of its
+// own
+static Measurement time_variant(const std::shared_ptr<const Chip8::Image>& image, const Variant& variant, const uint64_t cycles, const uint64_t instructions_per_frame, CacheMisses& cache_misses) {
+    Chip8 emu{};
+
+    emu.load_image(image);
+
+    const Runner run = variant.make(emu);
+
+    // NOTE: a tenth of the run first, so caches (ours and the hardware's) are
+    // warm when we start timing
+    measure(emu, run, cycles / 10, instructions_per_frame, cache_misses);
+
+    return measure(emu, run, cycles, instructions_per_frame, cache_misses);
+}
+
+// NOTE: `baseline` is how the benchmark's baseline (if it has one) went
+static std::string describe(const Benchmark& benchmark, const Variant& variant, const uint64_t cycles, const Measurement& measurement, const std::optional<Measurement>& baseline) {
+    const double seconds = std::chrono::duration<double>(measurement.wall).count();
+    const double nanoseconds = seconds * 1e9;
+    std::ostringstream out;
+
+    out << std::fixed << std::setprecision(3)
+        << "{\"benchmark\":" << quote(benchmark.name)
+        << ",\"variant\":" << quote(variant.name)
+        #ifdef SPECIALIZED_DISPATCH
+        << ",\"dispatch\":\"specialized\""
+        #else
+        << ",\"dispatch\":\"switch\""
+        #endif
+        << ",\"cycles\":" << cycles
+        << ",\"instructions\":" << measurement.instructions
+        << ",\"frames\":" << measurement.frames
+        << ",\"seconds\":" << std::setprecision(6) << seconds << std::setprecision(3)
+        << ",\"mips\":" << measurement.instructions / seconds / 1e6
+        << ",\"ns_per_cycle\":" << nanoseconds / std::max<uint64_t>(measurement.instructions, 1)
+        << ",\"ns_per_frame\":" << nanoseconds / std::max<uint64_t>(measurement.frames, 1)
+        << ",\"ns_per_draw\":";
+
+    // NOTE: how much longer the run took than its baseline, spread over its
+    // draws, i.e. what DXYN costs over and above an instruction that does
+    // nothing (so it can come out slightly negative for a draw that costs
+    // next to nothing); the baseline ran just as many instructions, unless
+    // either of them failed
+    if (benchmark.draws > 0 && baseline && measurement.error.empty() && baseline->error.empty()
+            && measurement.instructions > benchmark.setup) {
+        // NOTE: every period ends in a jump, which we don't count as a draw
+        const uint64_t looped = measurement.instructions - benchmark.setup;
+        const uint64_t draws = looped / benchmark.period * benchmark.draws
+            + std::min(looped % benchmark.period, benchmark.draws);
+        const double extra = std::chrono::duration<double, std::nano>(measurement.wall - baseline->wall).count();
+
+        out << extra / std::max<uint64_t>(draws, 1);
+    } else {
+        out << "null";
+    }
+
+    out << ",\"allocations\":" << measurement.allocations
+        << ",\"cache_misses\":";
+
+    if (measurement.cache_misses) {
+        out << *measurement.cache_misses;
+    } else {
+        out << "null";
+    }
+
+    out << ",\"error\":" << (measurement.error.empty() ? "null" : quote(measurement.error))
+        << '}';
+
+    return out.str();
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string{argv[1]}.starts_with('-')) {
+        std::cerr << "usage: chip8-bench [cycles] [instructions per frame] [ROM ...]";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        const uint64_t cycles = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+        const uint64_t instructions_per_frame = argc > 2 ? std::stoull(argv[2]) : 12;
+
+        if (instructions_per_frame == 0) {
+            throw std::invalid_argument{"instructions per frame must be positive"};
+        }
+
+        std::vector<std::string> roms{argv + std::min(argc, 3), argv + argc};
+
+        if (roms.empty()) {
+            roms = {"roms/pong", "roms/tetris.ch8", "roms/math.ch8"};
+        }
+
+        std::vector<Benchmark> benchmarks;
+
+        for (const auto& rom : roms) {
+            benchmarks.push_back({rom, Chip8::read_rom(rom)});
+        }
+
+        benchmarks.push_back(opcode_mix());
+        benchmarks.push_back(draw_heavy());
+
+        CacheMisses cache_misses;
+        bool failed = false;
+
+        for (const auto& benchmark : benchmarks) {
+            for (const auto& variant : variants()) {
+                const auto measurement = time_variant(benchmark.image, variant, cycles, instructions_per_frame, cache_misses);
+                std::optional<Measurement> baseline;
+
+                if (benchmark.baseline) {
+                    baseline = time_variant(benchmark.baseline, variant, cycles, instructions_per_frame, cache_misses);
+                }
+
+                std::cout << describe(benchmark, variant, cycles, measurement, baseline) << std::endl;
+                failed |= !measurement.error.empty();
+            }
+        }
+
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const std::exception& e) {
+        std::cerr << "chip8-bench: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,31 @@
+#include <cstddef>
+#include <cstdint>
+
+#ifndef CHIP8_BYTES_H
+#define CHIP8_BYTES_H
+
+// write `value` to `out` a byte at a time, least significant first, and return
+// where the next one goes; anything saved to a file goes through here (and
+// `get_le`) so it reads back the same on any host
+template <typename T, typename Out>
+Out put_le(Out out, const T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        *out++ = static_cast<uint8_t>(value >> (i * 8));
+    }
+
+    return out;
+}
+
+// the reverse of `put_le`
+template <typename T>
+const uint8_t* get_le(const uint8_t* in, T& value) {
+    value = 0;
+
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(*in++) << (i * 8);
+    }
+
+    return in;
+}
+
+#endif
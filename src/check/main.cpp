@@ -0,0 +1,421 @@
+#include "../chip8.h"
+#include "../jit.h"
+#include "../lockstep.h"
+#include "../random.h"
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// checks every way of running instructions against `Chip8::run<Checked>`:
+// `Chip8::cycle` (which runs `Specialized`'s tables in a build with
+// `SPECIALIZED_DISPATCH`), `Chip8::run_decoded`, `Chip8::run<Masked>`, the
+// `Jit`, and `Lockstep` under both policies (a masked one against
+// `run<Masked>`); prints the first few mismatches, and fails if there were
+// any, so it's worth running after any change to how instructions run
+//
+// each check is a random program run for a few frames under every profile,
+// with random keys held down on each frame, on every lane of a `Lockstep`
+// (each lane with keys of its own) and on the first few lanes' worth of each
+// of the others; after every frame, each machine has to be in exactly the
+// same state (see `Chip8::fingerprint`), have run and skipped over as many
+// cycles, and have faulted the same way (if it did)
+
+constexpr uint64_t FRAMES = 30;
+constexpr uint64_t INSTRUCTIONS_PER_FRAME = 20;
+
+// how many lanes to run the `Chip8` based engines (which are slower to check
+// than `Lockstep`, since they're run one lane at a time) on
+constexpr size_t SCALAR_LANES = 2;
+
+constexpr size_t MAX_MISMATCHES = 10;
+
+// the keys held down on each frame, one bit per key
+using Keys = std::vector<uint16_t>;
+
+// where a machine got to by the end of a frame
+struct Frame {
+    uint64_t fingerprint = 0;
+    uint64_t executed = 0;
+    uint64_t elided = 0;
+    Fault fault = Fault::none;
+
+    // NOTE: `cycle` throws, rather than returning a `Fault`, and doesn't say
+    // how many cycles it got through
+    bool faulted = false;
+};
+
+// a random program, leaning towards instructions that reach somewhere else in
+// it (jumps, calls, loads of `I`, ...) so that branches, self-modifying code
+// and idling all come up; everything that can fault does so rarely, so most
+// programs get through a good few frames first
+static std::vector<uint8_t> make_program(Random& random) {
+    const size_t length = 8 + random.next() % 120;
+    std::vector<uint8_t> rom;
+
+    const auto rarely = [&] {
+        return random.next() % 64 == 0;
+    };
+
+    const auto target = [&] {
+        // NOTE: mostly an instruction of the program, sometimes anywhere
+        // (e.g. right at the end of memory, or off by a byte)
+        if (rarely()) {
+            return static_cast<uint16_t>(random.next() % 2 ? random.next() % 0x1000 : 0xFF0 + random.next() % 0x10);
+        }
+
+        return static_cast<uint16_t>(START_ADDRESS + 2 * (random.next() % length));
+    };
+
+    for (size_t i = 0; i < length; ++i) {
+        const uint16_t x = random.next() % 16 << 8;
+        const uint16_t y = random.next() % 16 << 4;
+        const uint16_t nn = random.next() % 256;
+        uint16_t instruction = 0;
+
+        switch (random.next() % 20) {
+            case 0: instruction = rarely() ? random.next() % 0x10000 : 0x00E0; break;
+            case 1: instruction = random.next() % 4 ? 0x2000 | target() : 0x00EE; break;
+            case 2: instruction = 0x1000 | target(); break;
+            case 3: instruction = 0x3000 | x | nn; break;
+            case 4: instruction = 0x4000 | x | nn; break;
+            case 5: instruction = 0x5000 | x | y | rarely(); break;
+            case 6: instruction = 0x6000 | x | nn; break;
+            case 7: instruction = 0x7000 | x | nn; break;
+            case 8:
+            case 9: {
+                constexpr uint16_t N[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+
+                instruction = 0x8000 | x | y | (rarely() ? 0x8 + random.next() % 6 : N[random.next() % std::size(N)]);
+                break;
+            }
+            case 10: instruction = 0x9000 | x | y; break;
+            case 11: {
+                // NOTE: often right at the end of memory, where anything that
+                // reads or writes from `I` runs off the end of it
+                const uint16_t address = random.next() % 8 ? target() : 0xFF0 + random.next() % 0x10;
+
+                instruction = 0xA000 | address;
+                break;
+            }
+            case 12: instruction = 0xB000 | target(); break;
+            case 13: instruction = 0xC000 | x | nn; break;
+            case 14:
+            case 15: instruction = 0xD000 | x | y | random.next() % 16; break;
+            case 16: instruction = 0xE000 | x | (random.next() % 2 ? 0x9E : 0xA1); break;
+            default: {
+                constexpr uint16_t NN[] = {0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65};
+
+                instruction = 0xF000 | x | NN[random.next() % std::size(NN)];
+                break;
+            }
+        }
+
+        rom.push_back(instruction >> 8);
+        rom.push_back(instruction & 0xFF);
+    }
+
+    // NOTE: loop back into the program rather than running off the end of it
+    // into zeroes (which are illegal)
+    const uint16_t back = 0x1000 | (START_ADDRESS + 2 * (random.next() % length));
+
+    rom.push_back(back >> 8);
+    rom.push_back(back & 0xFF);
+
+    return rom;
+}
+
+// NOTE: mostly nothing held down, so ROMs waiting on a key get to wait
+static Keys make_keys(Random& random) {
+    Keys keys(FRAMES);
+
+    for (uint16_t& held : keys) {
+        held = random.next() % 4 == 0 ? uint16_t{1} << random.next() % 16 : 0;
+    }
+
+    return keys;
+}
+
+static void press(Chip8& emu, const uint16_t held) {
+    for (size_t key = 0; key < emu.keys_pressed.size(); ++key) {
+        emu.keys_pressed[key] = held >> key & 1;
+    }
+}
+
+// run `keys` on `emu` (from wherever it is) a frame at a time with `run`,
+// which runs a frame's worth of cycles and returns how many it ran and what
+// stopped it, if anything
+template <typename Run>
+static std::vector<Frame> run_frames(Chip8& emu, const Keys& keys, Run&& run) {
+    std::vector<Frame> frames;
+    uint64_t executed = 0;
+
+    for (const uint16_t held : keys) {
+        Frame frame;
+
+        press(emu, held);
+
+        try {
+            const Chip8::Status status = run(INSTRUCTIONS_PER_FRAME);
+
+            frame.fault = status.fault;
+            executed += status.fault == Fault::none ? status.executed : 0;
+        } catch (const std::exception&) {
+            frame.faulted = true;
+        }
+
+        frame.faulted |= frame.fault != Fault::none;
+        frame.fingerprint = emu.fingerprint();
+        frame.executed = executed;
+        frame.elided = emu.elided();
+        frames.push_back(frame);
+
+        if (frame.faulted) {
+            break;
+        }
+
+        emu.decrement_timers();
+    }
+
+    return frames;
+}
+
+// the fault `e` reports (see `Chip8::raise`), for engines that throw rather
+// than return one
+//
+// NOTE: anything else is passed on, and counts as a fault of no known kind
+static Fault thrown(const std::exception& e) {
+    for (uint8_t fault = 1; fault <= static_cast<uint8_t>(Fault::key_out_of_range); ++fault) {
+        if (std::string{e.what()} == message(static_cast<Fault>(fault))) {
+            return static_cast<Fault>(fault);
+        }
+    }
+
+    throw;
+}
+
+class Checker {
+public:
+    // check one program, from `seed`, under `profile`
+    void check(const uint64_t seed, const Profile profile) {
+        Random random{seed};
+        const auto image = Chip8::make_image(make_program(random));
+        std::vector<Keys> keys;
+
+        for (size_t lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            keys.push_back(make_keys(random));
+        }
+
+        reference.set_profile(profile);
+        other.set_profile(profile);
+
+        std::vector<std::vector<Frame>> checked;
+        std::vector<std::vector<Frame>> masked;
+
+        for (size_t lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            reference.load_image(image);
+            checked.push_back(run_frames(reference, keys[lane], [&](uint64_t cycles) {
+                return reference.run<Checked>(cycles);
+            }));
+
+            reference.load_image(image);
+            masked.push_back(run_frames(reference, keys[lane], [&](uint64_t cycles) {
+                return reference.run<Masked>(cycles);
+            }));
+        }
+
+        for (size_t lane = 0; lane < SCALAR_LANES; ++lane) {
+            const auto where = [&](const char* engine) {
+                std::ostringstream out;
+
+                out << "program " << seed << ", " << profile_name(profile) << ", lane " << lane << ", " << engine;
+
+                return out.str();
+            };
+
+            reference.load_image(image);
+            compare(where("cycle"), checked[lane], run_frames(reference, keys[lane], [&](uint64_t cycles) {
+                for (uint64_t i = 0; i < cycles; ++i) {
+                    reference.cycle();
+                }
+
+                return Chip8::Status{cycles, Fault::none};
+            }), false);
+
+            reference.load_image(image);
+            compare(where("run_decoded"), checked[lane], run_frames(reference, keys[lane], [&](uint64_t cycles) {
+                try {
+                    return Chip8::Status{reference.run_decoded(cycles), Fault::none};
+                } catch (const std::exception& e) {
+                    return Chip8::Status{0, thrown(e)};
+                }
+            }), true);
+
+            other.load_image(image);
+            compare(where("jit"), checked[lane], run_frames(other, keys[lane], [&](uint64_t cycles) {
+                try {
+                    return Chip8::Status{jit.run(cycles), Fault::none};
+                } catch (const std::exception& e) {
+                    return Chip8::Status{0, thrown(e)};
+                }
+            }), true);
+
+            // NOTE: masked, a machine only has to match a checked one for as
+            // long as the checked one didn't fault (or reach anything else
+            // outside memory, the stack or the keypad, which we can't tell
+            // from here; so only runs that never faulted count)
+            if (!checked[lane].back().faulted) {
+                compare(where("run<Masked>"), checked[lane], masked[lane], true);
+            }
+        }
+
+        with_quirks(profile, [&](auto quirks) {
+            using Quirks = decltype(quirks);
+
+            check_lockstep<Checked, Quirks>(seed, image, keys, checked);
+            check_lockstep<Masked, Quirks>(seed, image, keys, masked);
+        });
+
+        ++checks;
+    }
+
+    uint64_t count() const {
+        return checks;
+    }
+
+    uint64_t failures() const {
+        return mismatches;
+    }
+
+private:
+    Chip8 reference{};
+    Chip8 other{};
+    Jit jit{other};
+
+    // where `Lockstep` lanes are copied out to, to fingerprint them
+    Chip8 scratch{};
+
+    uint64_t checks = 0;
+    uint64_t mismatches = 0;
+
+    // run every lane of a `Lockstep` with its own keys, and check each lane
+    // against `expected` after every frame
+    template <typename Policy, typename Quirks>
+    void check_lockstep(const uint64_t seed, const std::shared_ptr<const Chip8::Image>& image, const std::vector<Keys>& keys, const std::vector<std::vector<Frame>>& expected) {
+        // NOTE: a fresh machine (rather than `reference`), since the engine
+        // starts out as a copy of it
+        Chip8 initial{};
+
+        initial.set_profile(scratch.get_profile());
+        initial.load_image(image);
+
+        auto engine = std::make_unique<Lockstep<LOCKSTEP_LANES, Policy, Quirks>>(initial);
+        std::vector<std::vector<Frame>> frames(LOCKSTEP_LANES);
+
+        for (size_t frame = 0; frame < FRAMES; ++frame) {
+            for (size_t lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                for (uint8_t key = 0; key < 16; ++key) {
+                    engine->set_key(lane, key, keys[lane][frame] >> key & 1);
+                }
+            }
+
+            engine->run(INSTRUCTIONS_PER_FRAME);
+
+            for (size_t lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                if (!frames[lane].empty() && frames[lane].back().faulted) {
+                    continue;
+                }
+
+                Frame result;
+
+                scratch.load_image(image);
+                engine->copy_to(lane, scratch);
+
+                result.fault = engine->fault(lane);
+                result.faulted = result.fault != Fault::none;
+                result.fingerprint = scratch.fingerprint();
+                result.executed = engine->executed(lane);
+                result.elided = engine->elided(lane);
+                frames[lane].push_back(result);
+            }
+
+            engine->decrement_timers();
+        }
+
+        for (size_t lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            std::ostringstream where;
+
+            where << "program " << seed << ", " << profile_name(scratch.get_profile()) << ", lane " << lane
+                << ", lockstep" << (Policy::MASKED ? " masked" : "");
+
+            compare(where.str(), expected[lane], frames[lane], true);
+        }
+    }
+
+    // report where `actual` first went a different way to `expected`, if it
+    // did; `counted` if it says how many cycles it ran and how it faulted
+    void compare(const std::string& where, const std::vector<Frame>& expected, const std::vector<Frame>& actual, const bool counted) {
+        for (size_t frame = 0; frame < std::max(expected.size(), actual.size()); ++frame) {
+            std::string what;
+
+            if (frame >= expected.size() || frame >= actual.size()) {
+                what = "faulted on a different frame";
+            } else if (expected[frame].faulted != actual[frame].faulted
+                    || (counted && expected[frame].fault != actual[frame].fault)) {
+                what = std::string{"faulted with \""} + message(actual[frame].fault) + "\", expected \""
+                    + message(expected[frame].fault) + '"';
+            } else if (expected[frame].fingerprint != actual[frame].fingerprint) {
+                what = "ended up in a different state";
+            } else if (counted && (expected[frame].executed != actual[frame].executed || expected[frame].elided != actual[frame].elided)) {
+                what = "ran " + std::to_string(actual[frame].executed) + " cycles and skipped "
+                    + std::to_string(actual[frame].elided) + ", expected "
+                    + std::to_string(expected[frame].executed) + " and " + std::to_string(expected[frame].elided);
+            } else {
+                continue;
+            }
+
+            if (++mismatches <= MAX_MISMATCHES) {
+                std::cout << where << ": frame " << frame << ": " << what << '\n';
+            }
+
+            return;
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    if (argc > 3 || (argc > 1 && std::string{argv[1]}.starts_with('-'))) {
+        std::cerr << "usage: chip8-check [programs] [first seed]";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        const uint64_t programs = argc > 1 ? std::stoull(argv[1]) : 2000;
+        const uint64_t first = argc > 2 ? std::stoull(argv[2]) : 0;
+
+        // NOTE: on the heap, since a `Lockstep` is far too big for the stack
+        auto checker = std::make_unique<Checker>();
+
+        for (uint64_t seed = first; seed < first + programs; ++seed) {
+            for (const Profile profile : {Profile::cosmac_vip, Profile::chip48, Profile::super_chip, Profile::modern}) {
+                checker->check(seed, profile);
+            }
+        }
+
+        std::cout << "chip8-check: " << checker->count() << " checks"
+            #ifdef SPECIALIZED_DISPATCH
+            << " (with specialized dispatch)"
+            #endif
+            << ", " << checker->failures() << " mismatches\n";
+
+        return checker->failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+        std::cerr << "chip8-check: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -1,4 +1,7 @@
 #include "chip8.h"
+#include "specialized.h"
+#include "bytes.h"
+#include "fingerprint.h"
 #include <cstdint>
 #include <stdexcept>
 #include <array>
@@ -6,9 +9,7 @@
 #include <string_view>
 #include <iostream>
 #include <iomanip>
-
-constexpr auto FONT_STRIDE = 5;
-constexpr auto FONT_ADDRESS = 0x50;
+#include <utility>
 
 const std::array<uint8_t, FONT_STRIDE * 16> fontset = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -33,53 +34,546 @@ static bool bit_at(uint8_t byte, uint8_t offset) {
     return byte >> offset & 1;
 }
 
-Chip8::Chip8() {
-    std::copy(fontset.begin(), fontset.end(), memory.begin() + FONT_ADDRESS);
+// what memory looks like before a ROM is loaded: just the fontset, which
+// every machine shares
+static std::shared_ptr<const Chip8::Image> blank_image() {
+    static const std::shared_ptr<const Chip8::Image> image = [] {
+        auto image = std::make_shared<Chip8::Image>();
+
+        std::copy(fontset.begin(), fontset.end(), image->begin() + FONT_ADDRESS);
+
+        return image;
+    }();
+
+    return image;
 }
 
-void Chip8::load_rom(const std::string_view filename) {
+Chip8::Chip8()
+    : Chip8{std::make_shared<Pages>()} {}
+
+// NOTE: machines that share `pages` have to stay on the same thread
+Chip8::Chip8(std::shared_ptr<Pages> pages)
+    : memory{blank_image(), std::move(pages)} {
+    #ifdef SPECIALIZED_DISPATCH
+    specialized = Specialized::table(profile).data();
+    #endif
+}
+
+// read a ROM into an image of memory that any number of machines can share
+// (see `load_image`)
+std::shared_ptr<const Chip8::Image> Chip8::read_rom(const std::string_view filename) {
     std::ifstream rom{filename.data(), std::ios::binary | std::ios::in};
 
     if (rom.is_open()) {
-        auto space = memory.size() - START_ADDRESS;
+        auto image = std::make_shared<Image>(*blank_image());
+        auto space = image->size() - START_ADDRESS;
         // NOTE: this cast is necessary since `read` only takes signed char; the
         // Standard guarantees that this is not UB due to special-casing for
         // byte-like types
-        rom.read(reinterpret_cast<char*>(memory.data() + START_ADDRESS), space);
+        rom.read(reinterpret_cast<char*>(image->data() + START_ADDRESS), space);
 
         /* if (rom.peek()) { */
         /*     throw std::runtime_error{"ROM file is too large"}; */
         /* } */
+
+        return image;
     } else {
         throw std::runtime_error{"error opening ROM file"};
     }
 }
 
-void Chip8::cycle() {
-    fetch_instruction();
-    increment_pc();
-    execute_instruction();
-    decrement_timers();
+// same as `read_rom`, but for a ROM that's already in memory (e.g. one that
+// was generated rather than read from a file)
+std::shared_ptr<const Chip8::Image> Chip8::make_image(const std::vector<uint8_t>& rom) {
+    auto image = std::make_shared<Image>(*blank_image());
+
+    if (rom.size() > image->size() - START_ADDRESS) {
+        throw std::runtime_error{"ROM is too large"};
+    }
+
+    std::copy(rom.begin(), rom.end(), image->begin() + START_ADDRESS);
+
+    return image;
 }
 
-void Chip8::reset() {
-    std::fill(memory.begin(), memory.end(), 0);
+void Chip8::load_rom(const std::string_view filename) {
+    load_image(read_rom(filename));
+}
+
+// start over from power-on with `image` as the contents of memory; if it's
+// the image we already had, only the pages written since then have to be
+// thrown away (along with everything decoded from them), so this is cheap
+// enough to do between every run of a ROM
+void Chip8::load_image(std::shared_ptr<const Image> image) {
+    const bool same = image == memory.shared();
+    const auto written = memory.reset(std::move(image));
+
     std::fill(registers.begin(), registers.end(), 0);
+    std::fill(keys_pressed.begin(), keys_pressed.end(), false);
 
     stack.clear();
     screen.clear();
 
-    std::copy(fontset.begin(), fontset.end(), memory.begin() + FONT_ADDRESS);
-
     index = 0;
     pc = START_ADDRESS;
     sound_timer = 0;
     delay_timer = 0;
     instruction = 0;
+    operands = {};
+    idle = false;
+    elided_cycles = 0;
+    random.seed(random_seed);
+
+    #ifdef PROFILE
+    if (profiler) {
+        profiler->restart();
+    }
+    #endif
+
+    if (!same) {
+        invalidate(0, memory.size());
+        return;
+    }
+
+    for (size_t page = 0; page < written.size(); ++page) {
+        if (written[page]) {
+            invalidate(page * PAGE_BYTES, PAGE_BYTES);
+        }
+    }
+}
+
+// NOTE: faults are thrown as exceptions here, same as `run_decoded`
+void Chip8::cycle() {
+    // NOTE: `run` hands its fault back but leaves it set, so one that faulted
+    // before this mustn't be taken for this instruction's
+    fault = Fault::none;
+
+    fetch_instruction();
+
+    #if defined(PROFILE) || defined(TRACE)
+    const uint16_t from = pc;
+    #endif
+
+    #ifdef PROFILE
+    const uint64_t started = Profiler::now();
+    #endif
+
+    increment_pc();
+
+    #ifdef SPECIALIZED_DISPATCH
+    specialized[instruction](*this);
+    #else
+    (this->*execute)();
+    #endif
+
+    if (fault != Fault::none) {
+        raise(std::exchange(fault, Fault::none));
+    }
+
+    #ifdef PROFILE
+    if (profiler) {
+        profiler->record(from, instruction, Profiler::now() - started);
+    }
+    #endif
+
+    #ifdef TRACE
+    if (tracer) {
+        tracer->record({from, instruction, index, registers[instruction >> 8 & 0xF], registers[0xF]});
+    }
+    #endif
+}
+
+// same as `run<Checked>`, except that a fault is thrown (as
+// `std::out_of_range`, or `std::runtime_error` for an illegal instruction)
+// rather than returned; returns how many cycles actually ran
+uint64_t Chip8::run_decoded(const uint64_t cycles) {
+    const Status status = run<Checked>(cycles);
+
+    if (status.fault != Fault::none) {
+        raise(status.fault);
+    }
+
+    return status.executed;
+}
+
+// same as calling `cycle` `cycles` times, but instructions are only decoded
+// the first time they're reached (or after something writes over them);
+// afterwards we dispatch straight to the cached handler; what happens when
+// an instruction reaches outside memory (etc.) is up to `Policy` (see
+// `Checked` and `Masked`), and a fault stops us and is handed back rather
+// than thrown; the instructions behave as they do under the profile we were
+// last given (see `set_profile`)
+//
+// NOTE: this stops early if the ROM starts idling (see `jump` and `ld_vx_k`),
+// since nothing would change until the next timer tick or keypress anyway, or
+// if an attached debugger stops it (see `Debugger::stopped`)
+template <typename Policy>
+Chip8::Status Chip8::run(const uint64_t cycles) {
+    // NOTE: a machine normally sticks to one policy and profile, so switching
+    // just throws every decoding away
+    if (decoded_masked != Policy::MASKED || decoded_profile != profile) {
+        for (auto& valid : decoded_valid) {
+            valid.reset();
+        }
+
+        decoded_masked = Policy::MASKED;
+        decoded_profile = profile;
+    }
+
+    if (decoded.empty()) {
+        decoded.resize(memory.size());
+    }
+
+    return with_quirks(profile, [&](auto quirks) {
+        using Quirks = decltype(quirks);
+
+        return debugger ? loop<Policy, Quirks, true>(cycles) : loop<Policy, Quirks, false>(cycles);
+    });
+}
+
+// NOTE: the debugger's checks are compiled into a copy of this loop of their
+// own, so the one that normally runs doesn't even test for them
+template <typename Policy, typename Quirks, bool DEBUGGED>
+Chip8::Status Chip8::loop(const uint64_t cycles) {
+    uint64_t executed = 0;
+
+    // NOTE: nothing an instruction does resizes the cache, so this is only
+    // looked up once rather than after every call through a handler
+    Decoded* const cache = decoded.data();
+
+    idle = false;
+    fault = Fault::none;
+
+    for (; executed < cycles && !idle; ++executed) {
+        // NOTE: this faults like any instruction does, by setting `idle`, so
+        // it's counted (and then uncounted) like one too
+        if constexpr (Policy::MASKED) {
+            pc &= memory.size() - 1;
+        } else if (pc >= memory.size() - 1) {
+            fail(Fault::fetch_outside_memory);
+            continue;
+        }
+
+        auto& valid = decoded_valid[pc / PAGE_BYTES];
+
+        if (!valid.test(pc % PAGE_BYTES)) {
+            instruction = memory[pc] << 8 | memory[(pc + 1) & (memory.size() - 1)];
+            operands = unpack(instruction);
+            cache[pc] = {decode<Policy, Quirks>(instruction), operands};
+            valid.set(pc % PAGE_BYTES);
+        }
+
+        // NOTE: a stop isn't idling, so the rest of `cycles` isn't elided;
+        // whoever's debugging can pick up where we left off
+        if constexpr (DEBUGGED) {
+            if (debugger->check(*this)) {
+                return {executed, Fault::none};
+            }
+        }
+
+        const Decoded& current = cache[pc];
+
+        #if defined(EDGE_COVERAGE) || defined(PROFILE) || defined(TRACE)
+        const uint16_t from = pc;
+        #endif
+
+        #if defined(PROFILE) || defined(TRACE)
+        // NOTE: read before running it, in case it writes over itself
+        const uint16_t executing = memory[from] << 8 | memory[(from + 1) & (memory.size() - 1)];
+        #endif
+
+        #ifdef PROFILE
+        const uint64_t started = Profiler::now();
+        #endif
+
+        operands = current.operands;
+        increment_pc();
+        current.handler(*this);
+
+        // NOTE: as far as these are concerned, an instruction that faulted
+        // never ran
+        #if defined(EDGE_COVERAGE) || defined(PROFILE) || defined(TRACE)
+        if (fault != Fault::none) {
+            continue;
+        }
+        #endif
+
+        #ifdef EDGE_COVERAGE
+        if (coverage) {
+            coverage->hit(from, pc);
+        }
+        #endif
+
+        #ifdef PROFILE
+        if (profiler) {
+            profiler->record(from, executing, Profiler::now() - started);
+        }
+        #endif
+
+        #ifdef TRACE
+        if (tracer) {
+            tracer->record({from, executing, index, registers[executing >> 8 & 0xF], registers[0xF]});
+        }
+        #endif
+    }
+
+    // NOTE: the instruction that faulted didn't finish, so it isn't counted,
+    // and we didn't stop to idle, so nothing's elided either; every
+    // instruction faults before it jumps anywhere, so it's the one just
+    // behind `pc` (except when there wasn't one to fetch)
+    if (fault != Fault::none) {
+        const uint16_t at = fault == Fault::fetch_outside_memory ? pc : pc - 2;
+
+        return {executed - 1, fault, at};
+    }
+
+    elided_cycles += cycles - executed;
+
+    return {executed, Fault::none};
+}
+
+template Chip8::Status Chip8::run<Checked>(const uint64_t cycles);
+template Chip8::Status Chip8::run<Masked>(const uint64_t cycles);
+
+// run the instructions as they behave under `profile` from now on (see
+// `Profile`)
+void Chip8::set_profile(const Profile profile) {
+    this->profile = profile;
+    execute = with_quirks(profile, [](auto quirks) {
+        return &Chip8::execute_instruction<decltype(quirks)>;
+    });
+
+    #ifdef SPECIALIZED_DISPATCH
+    specialized = Specialized::table(profile).data();
+    #endif
+}
+
+Profile Chip8::get_profile() const {
+    return profile;
+}
+
+// stop before the instructions `debugger` asks to from now on (or never stop,
+// if it's null)
+void Chip8::set_debugger(Debugger* debugger) {
+    this->debugger = debugger;
+}
+
+#ifdef EDGE_COVERAGE
+// record every edge `run_decoded` takes from now on in `coverage` (or stop
+// recording, if it's null)
+void Chip8::set_coverage(Coverage* coverage) {
+    this->coverage = coverage;
+}
+#endif
+
+#ifdef TRACE
+// record every instruction the interpreter runs from now on with `tracer` (or
+// stop recording, if it's null)
+void Chip8::set_tracer(Tracer* tracer) {
+    this->tracer = tracer;
+}
+#endif
+
+#ifdef PROFILE
+// report every instruction the interpreter runs from now on to `profiler` (or
+// stop reporting, if it's null)
+void Chip8::set_profiler(Profiler* profiler) {
+    this->profiler = profiler;
+}
+#endif
+
+// how many cycles we've skipped over because the ROM was idling
+uint64_t Chip8::elided() const {
+    return elided_cycles;
+}
+
+const std::array<uint8_t, 16>& Chip8::get_registers() const {
+    return registers;
+}
+
+uint16_t Chip8::get_index() const {
+    return index;
+}
+
+uint16_t Chip8::get_pc() const {
+    return pc;
+}
+
+// start over from power-on with the same ROM
+void Chip8::reset() {
+    load_image(memory.shared());
+}
+
+// seed the random number generator behind 0xCXNN, here and every time we start
+// over (see `load_image`), so a run can be reproduced exactly from the seed
+// and its inputs
+void Chip8::seed(const uint64_t seed) {
+    random_seed = seed;
+    random.seed(seed);
+}
+
+// save states start with this, then `STATE_VERSION`
+constexpr std::array<uint8_t, 4> STATE_MAGIC = {'C', '8', 'S', 'S'};
+
+// magic, version, memory, registers, stack (entries, then pointer), index,
+// pc, timers, screen, keys, elided cycles, random state
+constexpr size_t STATE_SIZE = 4 + 2 + 4096 + 16 + 16 * 2 + 1 + 2 + 2 + 1 + 1 + 32 * 8 + 16 + 8 + 8;
+
+// write everything needed to pick up exactly where we left off into `state`
+// (reusing its storage, so saving every frame doesn't allocate)
+void Chip8::save_state(std::vector<uint8_t>& state) const {
+    state.resize(STATE_SIZE);
+
+    uint8_t* out = std::copy(STATE_MAGIC.begin(), STATE_MAGIC.end(), state.data());
+
+    out = put_le(out, STATE_VERSION);
+    memory.copy_to(out);
+    out = std::copy(registers.begin(), registers.end(), out + memory.size());
+
+    for (const uint16_t address : stack.stack) {
+        out = put_le(out, address);
+    }
+
+    out = put_le(out, static_cast<uint8_t>(stack.stack_pointer));
+    out = put_le(out, index);
+    out = put_le(out, pc);
+    out = put_le(out, delay_timer);
+    out = put_le(out, sound_timer);
+
+    for (const uint64_t row : screen.packed()) {
+        out = put_le(out, row);
+    }
+
+    for (const bool pressed : keys_pressed) {
+        out = put_le(out, static_cast<uint8_t>(pressed));
+    }
+
+    out = put_le(out, elided_cycles);
+    put_le(out, random.get_state());
+}
+
+// pick up exactly where a `save_state` left off (the loaded ROM doesn't have
+// to match, since the state has all of memory); only the decodings from pages
+// that actually changed get thrown away
+void Chip8::load_state(const std::vector<uint8_t>& state) {
+    uint16_t version = 0;
+
+    if (state.size() < STATE_MAGIC.size() + sizeof(version)
+            || !std::equal(STATE_MAGIC.begin(), STATE_MAGIC.end(), state.begin())) {
+        throw std::runtime_error{"not a save state"};
+    }
+
+    const uint8_t* in = get_le(state.data() + STATE_MAGIC.size(), version);
+
+    if (version != STATE_VERSION) {
+        throw std::runtime_error{"save state is from an incompatible version"};
+    }
+
+    if (state.size() != STATE_SIZE) {
+        throw std::runtime_error{"save state is corrupt"};
+    }
+
+    // NOTE: check the stack pointer before touching anything, so a bad state
+    // leaves us as we were
+    uint8_t stack_pointer = 0;
+    get_le(in + memory.size() + registers.size() + stack.stack.size() * 2, stack_pointer);
+
+    if (stack_pointer > stack.stack.size()) {
+        throw std::runtime_error{"save state is corrupt"};
+    }
+
+    const auto changed = memory.restore(in);
+
+    in += memory.size();
+    std::copy_n(in, registers.size(), registers.begin());
+    in += registers.size();
+
+    for (uint16_t& address : stack.stack) {
+        in = get_le(in, address);
+    }
+
+    stack.stack_pointer = stack_pointer;
+    in = get_le(in + 1, index);
+    in = get_le(in, pc);
+    in = get_le(in, delay_timer);
+    in = get_le(in, sound_timer);
+
+    std::array<uint64_t, 32> rows;
+
+    for (uint64_t& row : rows) {
+        in = get_le(in, row);
+    }
+
+    screen.restore(rows);
+
+    for (bool& pressed : keys_pressed) {
+        pressed = *in++ != 0;
+    }
+
+    in = get_le(in, elided_cycles);
+
+    uint64_t random_state = 0;
+    get_le(in, random_state);
+    random.seed(random_state);
+
+    instruction = 0;
+    operands = {};
+    idle = false;
+
+    #ifdef PROFILE
+    if (profiler) {
+        profiler->restart();
+    }
+    #endif
+
+    for (size_t page = 0; page < changed.size(); ++page) {
+        if (changed[page]) {
+            invalidate(page * PAGE_BYTES, PAGE_BYTES);
+        }
+    }
+}
+
+// a fingerprint of everything that decides what happens from here on (see
+// `fingerprint.h`): memory, the screen, the registers, the stack, `I`, `pc`,
+// the timers and the random state; machines with the same fingerprint will do
+// the same thing given the same keys, so e.g. a search only has to explore
+// one of them (see `Visited`)
+//
+// NOTE: memory and the screen keep theirs up to date as they're written, and
+// the rest is only a handful of words, so this costs the same however much
+// has changed; the keys are left out since they're set by the host before
+// every frame, and the stack entries above the stack pointer since nothing
+// can read them back
+uint64_t Chip8::fingerprint() const {
+    std::array<uint64_t, 8> words = {};
+
+    for (size_t i = 0; i < registers.size(); ++i) {
+        words[i / 8] |= uint64_t{registers[i]} << (i % 8 * 8);
+    }
+
+    for (size_t i = 0; i < stack.stack_pointer; ++i) {
+        words[2 + i / 4] |= uint64_t{stack.stack[i]} << (i % 4 * 16);
+    }
+
+    words[6] = uint64_t{index}
+        | uint64_t{pc} << 16
+        | uint64_t{delay_timer} << 32
+        | uint64_t{sound_timer} << 40
+        | uint64_t{stack.stack_pointer} << 48;
+    words[7] = random.get_state();
+
+    uint64_t cpu = 0;
+
+    for (size_t i = 0; i < words.size(); ++i) {
+        cpu ^= word_key(Part::cpu, i, words[i]);
+    }
+
+    return memory.fingerprint() ^ screen.fingerprint() ^ cpu;
 }
 
 void Chip8::fetch_instruction() {
     instruction = (memory.at(pc) << 8) | memory.at(pc + 1);
+    operands = unpack(instruction);
 }
 
 void Chip8::increment_pc() {
@@ -90,18 +584,19 @@ void Chip8::decrement_pc() {
     pc -= sizeof(instruction);
 }
 
+template <typename Quirks>
 void Chip8::execute_instruction() {
     // we could do a jump table, but let's keep things simple(ish)
     switch (instruction >> 12) {
         case 0x0:
             switch (extract_nn()) {
                 case 0xE0: cls(); break;
-                case 0xEE: ret(); break;
+                case 0xEE: ret<Checked>(); break;
                 default: illegal(); break;
             }
             break;
         case 0x1: jp_nnn(); break;
-        case 0x2: call_nnn(); break;
+        case 0x2: call_nnn<Checked>(); break;
         case 0x3: se_vx_nn(); break;
         case 0x4: sne_vx_nn(); break;
         case 0x5: extract_n() ? illegal() : se_vx_vy(); break;
@@ -110,26 +605,26 @@ void Chip8::execute_instruction() {
         case 0x8:
             switch (extract_n()) {
                 case 0x0: ld_vx_vy(); break;
-                case 0x1: or_vx_vy(); break;
-                case 0x2: and_vx_vy(); break;
-                case 0x3: xor_vx_vy(); break;
+                case 0x1: or_vx_vy<Quirks>(); break;
+                case 0x2: and_vx_vy<Quirks>(); break;
+                case 0x3: xor_vx_vy<Quirks>(); break;
                 case 0x4: add_vx_vy(); break;
                 case 0x5: sub_vx_vy(); break;
-                case 0x6: shr_vx(); break;
+                case 0x6: shr_vx<Quirks>(); break;
                 case 0x7: subn_vx_vy(); break;
-                case 0x8: shl_vx(); break;
+                case 0xE: shl_vx<Quirks>(); break;
                 default: illegal(); break;
             }
             break;
         case 0x9: extract_n() ? illegal() : sne_vx_vy(); break;
         case 0xA: ld_i_nnn(); break;
-        case 0xB: jp_v0_nnn(); break;
+        case 0xB: jp_v0_nnn<Quirks>(); break;
         case 0xC: rnd_vx_nn(); break;
-        case 0xD: drw_vx_vy_n(); break;
+        case 0xD: drw_vx_vy_n<Checked, Quirks>(); break;
         case 0xE:
             switch (extract_nn()) {
-                case 0x9E: skp_vx(); break;
-                case 0xA1: sknp_vx(); break;
+                case 0x9E: skp_vx<Checked>(); break;
+                case 0xA1: sknp_vx<Checked>(); break;
                 default: illegal(); break;
             }
             break;
@@ -141,24 +636,151 @@ void Chip8::execute_instruction() {
                 case 0x18: ld_st_vx(); break;
                 case 0x1E: add_i_vx(); break;
                 case 0x29: ld_f_vx(); break;
-                case 0x33: ld_b_vx(); break;
-                case 0x55: ld_mem_vx(); break;
-                case 0x65: ld_vx_mem(); break;
+                case 0x33: ld_b_vx<Checked>(); break;
+                case 0x55: ld_mem_vx<Checked, Quirks>(); break;
+                case 0x65: ld_vx_mem<Checked, Quirks>(); break;
+                default: illegal(); break;
             }
             break;
         default: illegal(); break;
     }
 }
 
-void Chip8::decrement_timers() {
+// mirrors `execute_instruction`, except we hand back the instruction to run
+// (as it behaves under `Policy` and `Quirks`) instead of running it, so the
+// result can be cached
+template <typename Policy, typename Quirks>
+Chip8::Handler Chip8::decode(const uint16_t instruction) {
+    const Operands operands = unpack(instruction);
+
+    switch (instruction >> 12) {
+        case 0x0:
+            switch (operands.nn) {
+                case 0xE0: return &thunk<&Chip8::cls>;
+                case 0xEE: return &thunk<&Chip8::ret<Policy>>;
+                default: return &thunk<&Chip8::illegal>;
+            }
+        case 0x1: return &thunk<&Chip8::jp_nnn>;
+        case 0x2: return &thunk<&Chip8::call_nnn<Policy>>;
+        case 0x3: return &thunk<&Chip8::se_vx_nn>;
+        case 0x4: return &thunk<&Chip8::sne_vx_nn>;
+        case 0x5: return operands.n ? &thunk<&Chip8::illegal> : &thunk<&Chip8::se_vx_vy>;
+        case 0x6: return &thunk<&Chip8::ld_vx_nn>;
+        case 0x7: return &thunk<&Chip8::add_vx_nn>;
+        case 0x8:
+            switch (operands.n) {
+                case 0x0: return &thunk<&Chip8::ld_vx_vy>;
+                case 0x1: return &thunk<&Chip8::or_vx_vy<Quirks>>;
+                case 0x2: return &thunk<&Chip8::and_vx_vy<Quirks>>;
+                case 0x3: return &thunk<&Chip8::xor_vx_vy<Quirks>>;
+                case 0x4: return &thunk<&Chip8::add_vx_vy>;
+                case 0x5: return &thunk<&Chip8::sub_vx_vy>;
+                case 0x6: return &thunk<&Chip8::shr_vx<Quirks>>;
+                case 0x7: return &thunk<&Chip8::subn_vx_vy>;
+                case 0xE: return &thunk<&Chip8::shl_vx<Quirks>>;
+                default: return &thunk<&Chip8::illegal>;
+            }
+        case 0x9: return operands.n ? &thunk<&Chip8::illegal> : &thunk<&Chip8::sne_vx_vy>;
+        case 0xA: return &thunk<&Chip8::ld_i_nnn>;
+        case 0xB: return &thunk<&Chip8::jp_v0_nnn<Quirks>>;
+        case 0xC: return &thunk<&Chip8::rnd_vx_nn>;
+        case 0xD: return &thunk<&Chip8::drw_vx_vy_n<Policy, Quirks>>;
+        case 0xE:
+            switch (operands.nn) {
+                case 0x9E: return &thunk<&Chip8::skp_vx<Policy>>;
+                case 0xA1: return &thunk<&Chip8::sknp_vx<Policy>>;
+                default: return &thunk<&Chip8::illegal>;
+            }
+        case 0xF:
+            switch (operands.nn) {
+                case 0x07: return &thunk<&Chip8::ld_vx_dt>;
+                case 0x0A: return &thunk<&Chip8::ld_vx_k>;
+                case 0x15: return &thunk<&Chip8::ld_dt_vx>;
+                case 0x18: return &thunk<&Chip8::ld_st_vx>;
+                case 0x1E: return &thunk<&Chip8::add_i_vx>;
+                case 0x29: return &thunk<&Chip8::ld_f_vx>;
+                case 0x33: return &thunk<&Chip8::ld_b_vx<Policy>>;
+                case 0x55: return &thunk<&Chip8::ld_mem_vx<Policy, Quirks>>;
+                case 0x65: return &thunk<&Chip8::ld_vx_mem<Policy, Quirks>>;
+                default: return &thunk<&Chip8::illegal>;
+            }
+        default: return &thunk<&Chip8::illegal>;
+    }
+}
+
+// the handler `run<Checked>` dispatches `instruction` to under the current
+// profile (for the `Jit`, which calls some of them directly)
+Chip8::Handler Chip8::handler(const uint16_t instruction) const {
+    return with_quirks(profile, [&](auto quirks) {
+        return decode<Checked, decltype(quirks)>(instruction);
+    });
+}
+
+// count the delay and sound timers down by one; this should be called
+// `TIMER_FREQUENCY` times a second, independently of how fast instructions
+// run; true if the sound timer was running up to this tick, i.e. the host
+// should have been beeping since the last one
+bool Chip8::decrement_timers() {
     if (delay_timer > 0) {
         --delay_timer;
     }
 
     if (sound_timer > 0) {
         --sound_timer;
-    } else {
-        // TODO: beep (isn't that really annoying though?)
+        return true;
+    }
+
+    return false;
+}
+
+// store a byte in memory, throwing away anything derived from the old value
+void Chip8::write(const uint16_t address, const uint8_t value) {
+    memory.set(address, value);
+    invalidate(address, 1);
+}
+
+// forget the cached decodings of every instruction that overlaps the `length`
+// bytes starting at `address` (including the one that starts a byte earlier,
+// since instructions are 2 bytes wide), and stop watching any of the bytes
+// themselves that were (see `watched`)
+void Chip8::invalidate(const uint16_t address, const uint16_t length) {
+    const size_t first = address > 0 ? address - 1 : 0;
+    const size_t last = std::min<size_t>(address + length, memory.size());
+
+    if (first >= last) {
+        return;
+    }
+
+    // NOTE: under `Masked`, the instruction at the very end of memory wraps
+    // around to the start of it
+    if (address == 0) {
+        decoded_valid.back().reset(PAGE_BYTES - 1);
+    }
+
+    for (size_t i = first; i < last;) {
+        // NOTE: whole pages at a time where we can, which is what makes
+        // `reset` cheap
+        if (i % PAGE_BYTES == 0 && last - i >= PAGE_BYTES) {
+            decoded_valid[i / PAGE_BYTES].reset();
+            i += PAGE_BYTES;
+        } else {
+            decoded_valid[i / PAGE_BYTES].reset(i % PAGE_BYTES);
+            ++i;
+        }
+    }
+
+    for (size_t i = address; i < last;) {
+        auto& bytes = watched[i / PAGE_BYTES];
+
+        if (i % PAGE_BYTES == 0 && last - i >= PAGE_BYTES) {
+            overwritten = overwritten || bytes.any();
+            bytes.reset();
+            i += PAGE_BYTES;
+        } else {
+            overwritten = overwritten || bytes.test(i % PAGE_BYTES);
+            bytes.reset(i % PAGE_BYTES);
+            ++i;
+        }
     }
 }
 
@@ -182,9 +804,81 @@ uint8_t& Chip8::vf() {
     return registers[0xF];
 }
 
-// convenient alias to throw an exception when we find an illegal instruction
+// convenient alias to fault when we find an illegal instruction (whatever the
+// policy)
 void Chip8::illegal() {
-    throw std::runtime_error{"encountered illegal instruction"};
+    fail(Fault::illegal_instruction);
+}
+
+// stop running on `fault` (see `run`), leaving the rest of the instruction
+// undone
+void Chip8::fail(const Fault fault) {
+    this->fault = fault;
+    idle = true;
+}
+
+// throw `fault` the way the interpreter always used to
+void Chip8::raise(const Fault fault) {
+    if (fault == Fault::illegal_instruction) {
+        throw std::runtime_error{message(fault)};
+    }
+
+    throw std::out_of_range{message(fault)};
+}
+
+const char* profile_name(const Profile profile) {
+    switch (profile) {
+        case Profile::cosmac_vip: return "vip";
+        case Profile::chip48: return "chip48";
+        case Profile::super_chip: return "schip";
+        case Profile::modern: return "modern";
+    }
+
+    return "unknown";
+}
+
+Profile find_profile(const std::string_view name) {
+    for (const Profile profile : {Profile::cosmac_vip, Profile::chip48, Profile::super_chip, Profile::modern}) {
+        if (name == profile_name(profile)) {
+            return profile;
+        }
+    }
+
+    throw std::invalid_argument{"expected a profile of vip, chip48, schip or modern"};
+}
+
+const char* message(const Fault fault) {
+    switch (fault) {
+        case Fault::none: return "no fault";
+        case Fault::illegal_instruction: return "encountered illegal instruction";
+        case Fault::fetch_outside_memory: return "attempted to fetch an instruction from outside memory";
+        case Fault::draw_outside_memory: return "attempted to draw a sprite from outside memory";
+        case Fault::read_outside_memory: return "attempted to read outside memory";
+        case Fault::write_outside_memory: return "attempted to write outside memory";
+        case Fault::stack_overflow: return "attempted to call with a full stack";
+        case Fault::stack_underflow: return "attempted to return with an empty stack";
+        case Fault::key_out_of_range: return "attempted to check a key that doesn't exist";
+    }
+
+    return "unknown fault";
+}
+
+// jump to `target`, noting whether that means the ROM is now idling, i.e.
+// spinning in a loop that can't end before the next timer tick:
+//   - jumping to itself (a common way to halt)
+//   - jumping back to a delay timer polling loop while the timer is running,
+//     `FX07; 3X00; 1NNN` (`VX` just gets the same value every time around)
+void Chip8::jump(const uint16_t target) {
+    const bool self = target == pc - 2;
+    const bool delay_loop = target == pc - 6
+        && delay_timer > 0
+        && (memory[target] & 0xF0) == 0xF0
+        && memory[target + 1] == 0x07
+        && memory[target + 2] == (0x30 | (memory[target] & 0x0F))
+        && memory[target + 3] == 0x00;
+
+    idle = self || delay_loop;
+    pc = target;
 }
 
 // convenient alias to skip the next instruction based on a given condition
@@ -194,34 +888,50 @@ void Chip8::skip_if(const bool condition) {
     }
 }
 
+// unpack every operand an instruction could have, e.g. for 0x1234:
+//   nnn - the 3 least significant nibbles (0x0234)
+//   nn  - the 2 least significant nibbles (0x34)
+//   n   - the least significant nibble (0x04)
+//   x   - the 2nd most significant nibble (0x02)
+//   y   - the 3rd most significant nibble (0x03)
+Chip8::Operands Chip8::unpack(const uint16_t instruction) {
+    return {
+        static_cast<uint16_t>(instruction & 0x0FFF),
+        static_cast<uint8_t>(instruction & 0x00FF),
+        static_cast<uint8_t>(instruction & 0x000F),
+        static_cast<uint8_t>((instruction & 0x0F00) >> 8),
+        static_cast<uint8_t>((instruction & 0x00F0) >> 4)
+    };
+}
+
 // extracts the 3 least significant nibbles from the current instruction 
 // (e.g. 0x1234 -> 0x0234)
 uint16_t Chip8::extract_nnn() {
-    return instruction & 0x0FFF;
+    return operands.nnn;
 }
 
 // extracts the 2 least significant nibbles from the current instruction 
 // (e.g. 0x1234 -> 0x34)
 uint8_t Chip8::extract_nn() {
-    return instruction & 0x00FF;
+    return operands.nn;
 }
 
 // extracts the least significant nibble from the current instruction 
 // (e.g. 0x1234 -> 0x04)
 uint8_t Chip8::extract_n() {
-    return instruction & 0x000F;
+    return operands.n;
 }
 
 // extracts the 2nd most significant nibble from the current instruction 
 // (e.g. 0x1234 -> 0x02)
 uint8_t Chip8::extract_x() {
-    return (instruction & 0x0F00) >> 8;
+    return operands.x;
 }
 
 // extracts the 3rd most significant nibble from the current instruction 
 // (e.g. 0x1234 -> 0x03)
 uint8_t Chip8::extract_y() {
-    return (instruction & 0x00F0) >> 4;
+    return operands.y;
 }
 
 // 0x00E0 - clear the screen
@@ -230,19 +940,34 @@ void Chip8::cls() {
 }
 
 // 0x00EE - return from a subroutine by jumping to a previously-saved address
+template <typename Policy>
 void Chip8::ret() {
-    pc = stack.pop();
+    if constexpr (Policy::MASKED) {
+        pc = stack.pop_wrapped();
+    } else if (stack.empty()) {
+        fail(Fault::stack_underflow);
+    } else {
+        pc = stack.pop();
+    }
 }
 
 // 0x1NNN - save address of the next instruction, then jump to address 0x0NNN
 void Chip8::jp_nnn() {
-    pc = extract_nnn();
+    jump(extract_nnn());
 }
 
 // 0x2NNN - directly jump to address 0x0NNN (don't save the current value of `pc`)
+template <typename Policy>
 void Chip8::call_nnn() {
-    stack.push(pc);
-    jp_nnn();
+    if constexpr (Policy::MASKED) {
+        stack.push_wrapped(pc);
+    } else if (stack.full()) {
+        return fail(Fault::stack_overflow);
+    } else {
+        stack.push(pc);
+    }
+
+    pc = extract_nnn();
 }
 
 // 0x3XNN - skip the next instruction if `VX` == 0xNN
@@ -275,19 +1000,37 @@ void Chip8::ld_vx_vy() {
     vx() = vy();
 }
 
-// 0x8XY1 - bitwise OR `VX` with `VY` in place
+// 0x8XY1 - bitwise OR `VX` with `VY` in place (then clear `VF`, if
+// `Quirks::RESET_VF`)
+template <typename Quirks>
 void Chip8::or_vx_vy() {
     vx() |= vy();
+
+    if constexpr (Quirks::RESET_VF) {
+        vf() = 0;
+    }
 }
 
-// 0x8XY2 - bitwise AND `VX` with `VY` in place
+// 0x8XY2 - bitwise AND `VX` with `VY` in place (then clear `VF`, if
+// `Quirks::RESET_VF`)
+template <typename Quirks>
 void Chip8::and_vx_vy() {
     vx() &= vy();
+
+    if constexpr (Quirks::RESET_VF) {
+        vf() = 0;
+    }
 }
 
-// 0x8XY3 - bitwise XOR `VX` with `VY` in place
+// 0x8XY3 - bitwise XOR `VX` with `VY` in place (then clear `VF`, if
+// `Quirks::RESET_VF`)
+template <typename Quirks>
 void Chip8::xor_vx_vy() {
     vx() ^= vy();
+
+    if constexpr (Quirks::RESET_VF) {
+        vf() = 0;
+    }
 }
 
 // 0x8XY4 - add `VX` and `VY`, storing the result in `VX`; if the sum 
@@ -308,12 +1051,14 @@ void Chip8::sub_vx_vy() {
 }
 
 // 0x8XY6 - shift `VX` right 1 bit in place, storing the least significant bit 
-// of `VX` in `VF` prior to the shift
-//
-// TODO: check if this is the correct implementation vs. the other specification
+// of `VX` in `VF` prior to the shift (or, if `Quirks::SHIFT_VY`, store `VY`
+// shifted right in `VX` and its least significant bit in `VF`)
+template <typename Quirks>
 void Chip8::shr_vx() {
-    vf() = bit_at(vx(), 0);
-    vx() >>= 1;
+    const uint8_t source = Quirks::SHIFT_VY ? vy() : vx();
+
+    vf() = bit_at(source, 0);
+    vx() = source >> 1;
 }
 
 // 0x8XY7 - set `VX` to `VY` - `VX`; if `Vy` > `Vx`, then `VF` 1, otherwise 0
@@ -324,12 +1069,14 @@ void Chip8::subn_vx_vy() {
 }
 
 // 0x8XYE - shift `VX` left 1 bit in place, storing the most significant bit 
-// of `VX` in `VF` prior to the shift
-//
-// TODO: check if this is the correct implementation vs. the other specification
+// of `VX` in `VF` prior to the shift (or, if `Quirks::SHIFT_VY`, store `VY`
+// shifted left in `VX` and its most significant bit in `VF`)
+template <typename Quirks>
 void Chip8::shl_vx() {
-    vf() = bit_at(vx(), 7);
-    vx() <<= 1;
+    const uint8_t source = Quirks::SHIFT_VY ? vy() : vx();
+
+    vf() = bit_at(source, 7);
+    vx() = source << 1;
 }
 
 // 0x9XY0 - skip the next instruction if `VX` != `VY`
@@ -342,51 +1089,64 @@ void Chip8::ld_i_nnn() {
     index = extract_nnn();
 }
 
-// 0xBNNN - jump to address 0x0NNN + `V0`.
+// 0xBNNN - jump to address 0x0NNN + `V0` (or, if `Quirks::JUMP_VX`, to
+// 0x0XNN + `VX`)
+template <typename Quirks>
 void Chip8::jp_v0_nnn() {
-    pc = registers[0] + extract_nnn();
+    pc = registers[Quirks::JUMP_VX ? extract_x() : 0] + extract_nnn();
 }
 
 // 0xCXNN - set `VX` to a random number with a mask of 0xNN 
 void Chip8::rnd_vx_nn() {
-    // NOTE: we don't really care about the quality of our random integers,
-    // so using c-style stuff is fine
-    vx() = (std::rand() % UINT8_MAX) & extract_nn();
+    vx() = random.byte() & extract_nn();
 }
 
 // 0xDXYN - draw a sprite starting at (`VX`, `VY`) with the bytes from `I` to
 // `I` + 0x0N; if any set pixels are unset, set `VF` to 1 (otherwise, 0)
 // NOTE: (0, 0) is at the top-left, +x goes right, +y goes down, the most
 // significant bits are at lower x-values, and lower memory addresses are
-// at lower y-values
+// at lower y-values; sprites wrap around the edges of the screen, unless
+// `Quirks::CLIP`
+template <typename Policy, typename Quirks>
 void Chip8::drw_vx_vy_n() {
-    uint8_t x = vx();
-    uint8_t y = vy();
+    // NOTE: clipped, only the start wraps, so the rows below it don't
+    uint8_t x = Quirks::CLIP ? vx() % screen.width() : vx();
+    uint8_t y = Quirks::CLIP ? vy() % screen.height() : vy();
     uint8_t n = extract_n();
+    bool collision = false;
 
-    vf() = 0;
+    // NOTE: explicitly check bounds once up front instead of on every row
+    if (!Policy::MASKED && index + n > memory.size()) {
+        return fail(Fault::draw_outside_memory);
+    }
 
     for (auto dy = 0; dy < n; ++dy) {
-        uint8_t byte = memory.at(index + dy);
-
-        for (auto dx = 0; dx < 8; ++dx) {
-            if (bit_at(byte, 7 - dx)) { 
-                vf() = screen.draw(x + dx, y + dy);
-            }
-        }
+        collision |= screen.draw<Quirks::CLIP>(x, y + dy, memory[(index + dy) & (memory.size() - 1)]);
     }
+
+    vf() = collision;
 }
 
 // 0xEX9E - skip the next instruction if the key corresponding to `VX` is
 // pressed
+template <typename Policy>
 void Chip8::skp_vx() {
-    skip_if(keys_pressed.at(vx()));
+    if (!Policy::MASKED && vx() >= keys_pressed.size()) {
+        return fail(Fault::key_out_of_range);
+    }
+
+    skip_if(keys_pressed[vx() % keys_pressed.size()]);
 }
 
 // 0xEXA1 - skip the next instruction if the key corresponding to `VX` is not
 // pressed
+template <typename Policy>
 void Chip8::sknp_vx() {
-    skip_if(!keys_pressed.at(vx()));
+    if (!Policy::MASKED && vx() >= keys_pressed.size()) {
+        return fail(Fault::key_out_of_range);
+    }
+
+    skip_if(!keys_pressed[vx() % keys_pressed.size()]);
 }
 
 // 0xFX07 - store the delay timer in `VX`
@@ -401,8 +1161,10 @@ void Chip8::ld_vx_k() {
     if (it != keys_pressed.end()) {
         vx() = std::distance(keys_pressed.begin(), it);
     } else {
-        // repeat this instruction again until we actually get input
+        // repeat this instruction again until we actually get input (which
+        // can't happen until the host polls for it)
         decrement_pc();
+        idle = true;
     }
 }
 
@@ -429,42 +1191,87 @@ void Chip8::ld_f_vx() {
 
 // 0xFX33 - store the base 10 representation of `VX` at `I`, `I` + 1, 
 // and `I` + 2 (hundreds, tens, ones)
+template <typename Policy>
 void Chip8::ld_b_vx() {
+    const uint16_t mask = memory.size() - 1;
+
+    // NOTE: check bounds up front so nothing gets written if it doesn't fit
+    if (!Policy::MASKED && index + 2u >= memory.size()) {
+        return fail(Fault::write_outside_memory);
+    }
+
     // NOTE: we don't mod 10 for the hundreds place since UINT8_MAX < 1000
     // digit_at(vx(), 0);
-    memory.at(index) = vx() / 100;     
-    memory.at(index + 1) = vx() / 10 % 10;
-    memory.at(index + 2) = vx() % 10;
+    write(index & mask, vx() / 100);
+    write((index + 1) & mask, vx() / 10 % 10);
+    write((index + 2) & mask, vx() % 10);
+}
+
+// move `I` on past the `x` + 1 bytes FX55/FX65 just stored or loaded, as far
+// as `Quirks` says to
+template <typename Quirks>
+static void increment_index(uint16_t& index, const uint8_t x) {
+    if constexpr (Quirks::INCREMENT_INDEX == IndexIncrement::x) {
+        index += x;
+    } else if constexpr (Quirks::INCREMENT_INDEX == IndexIncrement::x_plus_1) {
+        index += x + 1;
+    }
 }
 
 // 0xFX55 - dump the values of `V0` to `VX` (inclusive) into memory at `I`
+template <typename Policy, typename Quirks>
 void Chip8::ld_mem_vx() {
     uint8_t x = extract_x();
 
-    // NOTE: explicitly check bounds since `copy_n` doesn't 
-    if (index + x >= memory.size()) {
-        throw std::out_of_range("attempted to write outside memory");
-    }
+    // NOTE: masked, the registers may wrap around to the start of memory, so
+    // they're written (and invalidated) one at a time
+    if constexpr (Policy::MASKED) {
+        for (uint8_t i = 0; i <= x; ++i) {
+            write((index + i) & (memory.size() - 1), registers[i]);
+        }
+    } else {
+        // NOTE: check bounds up front so nothing gets written if it doesn't
+        // fit
+        if (index + x >= memory.size()) {
+            return fail(Fault::write_outside_memory);
+        }
 
-    std::copy_n(registers.begin(), x, memory.begin() + index);
+        for (uint8_t i = 0; i <= x; ++i) {
+            memory.set(index + i, registers[i]);
+        }
 
-    #ifdef INCREMENT_INDEX
-    index += x + 1;
-    #endif
+        invalidate(index, x + 1);
+    }
+
+    increment_index<Quirks>(index, x);
 }
 
-// 0xFX55 - read memory at `I` into `V0` to `VX` (inclusive)
+// 0xFX65 - read memory at `I` into `V0` to `VX` (inclusive)
+template <typename Policy, typename Quirks>
 void Chip8::ld_vx_mem() {
     uint8_t x = extract_x();
 
-    // NOTE: explicitly check bounds since `copy_n` doesn't
-    if (index + x >= memory.size()) {
-        throw std::out_of_range("attempted to read outside memory");
+    // NOTE: explicitly check bounds since `[]` doesn't
+    if (!Policy::MASKED && index + x >= memory.size()) {
+        return fail(Fault::read_outside_memory);
     }
 
-    std::copy_n(memory.begin() + index, x, registers.begin());
+    for (uint8_t i = 0; i <= x; ++i) {
+        registers[i] = memory[(index + i) & (memory.size() - 1)];
+    }
 
-    #ifdef INCREMENT_INDEX
-    index += x + 1;
-    #endif
+    increment_index<Quirks>(index, x);
 }
+
+// NOTE: `Specialized` runs these as they are under `Checked`
+template void Chip8::ret<Checked>();
+template void Chip8::call_nnn<Checked>();
+template void Chip8::ld_b_vx<Checked>();
+template void Chip8::ld_mem_vx<Checked, CosmacVip>();
+template void Chip8::ld_mem_vx<Checked, Chip48>();
+template void Chip8::ld_mem_vx<Checked, SuperChip>();
+template void Chip8::ld_mem_vx<Checked, Modern>();
+template void Chip8::ld_vx_mem<Checked, CosmacVip>();
+template void Chip8::ld_vx_mem<Checked, Chip48>();
+template void Chip8::ld_vx_mem<Checked, SuperChip>();
+template void Chip8::ld_vx_mem<Checked, Modern>();
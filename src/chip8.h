@@ -3,24 +3,196 @@
 #include <array>
 #include <string_view>
 #include <random>
+#include <bitset>
+#include <memory>
+#include <vector>
+#include "memory.h"
+#include "random.h"
 #include "screen.h"
 #include "stack.h"
+#include "debugger.h"
+
+#ifdef EDGE_COVERAGE
+#include "coverage.h"
+#endif
+
+#ifdef PROFILE
+#include "profiler.h"
+#endif
+
+#ifdef TRACE
+#include "trace.h"
+#endif
 
 #ifndef CHIP8_H
 #define CHIP8_H
 
 constexpr auto START_ADDRESS = 0x200;
+constexpr auto FONT_STRIDE = 5;
+constexpr auto FONT_ADDRESS = 0x50;
+constexpr auto TIMER_FREQUENCY = 60;
+
+// NOTE: bump this whenever the layout of a save state changes, so old ones get
+// rejected instead of loaded wrong
+constexpr uint16_t STATE_VERSION = 2;
+
+// why a machine stopped short (see `Chip8::run`)
+enum class Fault : uint8_t {
+    none,
+    illegal_instruction,
+    fetch_outside_memory,
+    draw_outside_memory,
+    read_outside_memory,
+    write_outside_memory,
+    stack_overflow,
+    stack_underflow,
+    key_out_of_range
+};
+
+const char* message(const Fault fault);
+
+// what `Chip8::run` does about an instruction reaching outside memory, the
+// stack or the keypad:
+//   Checked - stops with a `Fault` (the default, and what `run_decoded` and
+//             `cycle` throw on)
+//   Masked  - wraps around instead (addresses `& 0xFFF`, the stack pointer
+//             and keys modulo 16), skipping the checks; only illegal
+//             instructions still fault, so this is for trusted ROMs
+struct Checked {
+    static constexpr bool MASKED = false;
+};
+
+struct Masked {
+    static constexpr bool MASKED = true;
+};
+
+// how far FX55/FX65 move `I` on from where they started (see `CosmacVip`)
+enum class IndexIncrement : uint8_t { none, x, x_plus_1 };
+
+// the ways interpreters have disagreed about what an instruction does, as a
+// set of constants that `Chip8::run` compiles into the handlers of a copy of
+// its loop of their own (so none of them branch on these at runtime):
+//   RESET_VF        - 8XY1/8XY2/8XY3 clear `VF` afterwards
+//   SHIFT_VY        - 8XY6/8XYE shift `VY` into `VX`, rather than shifting
+//                     `VX` in place
+//   INCREMENT_INDEX - how far FX55/FX65 leave `I` past where they started
+//   JUMP_VX         - BNNN is BXNN, jumping to 0xXNN + `VX` rather than to
+//                     0xNNN + `V0`
+//   CLIP            - sprites get cut off at the edges of the screen rather
+//                     than wrapping around (where they start still wraps)
+//
+// NOTE: the COSMAC VIP also waited for the next frame before every draw,
+// which we don't; a ROM can't tell, short of counting cycles
+struct CosmacVip {
+    static constexpr bool RESET_VF = true;
+    static constexpr bool SHIFT_VY = true;
+    static constexpr IndexIncrement INCREMENT_INDEX = IndexIncrement::x_plus_1;
+    static constexpr bool JUMP_VX = false;
+    static constexpr bool CLIP = true;
+};
+
+struct Chip48 {
+    static constexpr bool RESET_VF = false;
+    static constexpr bool SHIFT_VY = false;
+    static constexpr IndexIncrement INCREMENT_INDEX = IndexIncrement::x;
+    static constexpr bool JUMP_VX = true;
+    static constexpr bool CLIP = true;
+};
+
+struct SuperChip {
+    static constexpr bool RESET_VF = false;
+    static constexpr bool SHIFT_VY = false;
+    static constexpr IndexIncrement INCREMENT_INDEX = IndexIncrement::none;
+    static constexpr bool JUMP_VX = true;
+    static constexpr bool CLIP = true;
+};
+
+// what most interpreters written since do, and what we've always done
+struct Modern {
+    static constexpr bool RESET_VF = false;
+    static constexpr bool SHIFT_VY = false;
+    static constexpr IndexIncrement INCREMENT_INDEX = IndexIncrement::none;
+    static constexpr bool JUMP_VX = false;
+    static constexpr bool CLIP = false;
+};
+
+// which of the quirk sets above a machine runs with (see `Chip8::set_profile`)
+enum class Profile : uint8_t { cosmac_vip, chip48, super_chip, modern };
+
+const char* profile_name(const Profile profile);
+
+// the profile called `name` (as in `profile_name`), or throws
+// `std::invalid_argument`
+Profile find_profile(const std::string_view name);
+
+// call `f` with the quirks `profile` stands for (a value of one of the types
+// above), e.g. to pick an instantiation of something templated on them once
+// up front rather than checking the profile over and over
+template <typename F>
+decltype(auto) with_quirks(const Profile profile, F&& f) {
+    switch (profile) {
+        case Profile::cosmac_vip: return f(CosmacVip{});
+        case Profile::chip48: return f(Chip48{});
+        case Profile::super_chip: return f(SuperChip{});
+        case Profile::modern: break;
+    }
+
+    return f(Modern{});
+}
 
 class Chip8 {
+    friend class Jit;
+    friend class Debugger;
+    friend struct Specialized;
+    template <size_t, typename, typename> friend class Lockstep;
 public:
+    using Image = Memory<4096>::Image;
+
+    // how many cycles a `run` got through, and what stopped it if it faulted
+    // (in which case the instruction that faulted isn't counted), and where
+    // that instruction is (`pc` has already moved past it by then)
+    struct Status {
+        uint64_t executed = 0;
+        Fault fault = Fault::none;
+        uint16_t pc = 0;
+    };
+
     Chip8();
+    explicit Chip8(std::shared_ptr<Pages> pages);
     void cycle();
+    uint64_t run_decoded(const uint64_t cycles);
+    template <typename Policy = Checked>
+    Status run(const uint64_t cycles);
+    uint64_t elided() const;
+    const std::array<uint8_t, 16>& get_registers() const;
+    uint16_t get_index() const;
+    uint16_t get_pc() const;
+    bool decrement_timers();
+    static std::shared_ptr<const Image> read_rom(const std::string_view filename);
+    static std::shared_ptr<const Image> make_image(const std::vector<uint8_t>& rom);
     void load_rom(const std::string_view filename);
+    void load_image(std::shared_ptr<const Image> image);
     void reset();
+    void seed(const uint64_t seed);
+    void save_state(std::vector<uint8_t>& state) const;
+    void load_state(const std::vector<uint8_t>& state);
+    uint64_t fingerprint() const;
+    void set_profile(const Profile profile);
+    Profile get_profile() const;
+    void set_debugger(Debugger* debugger);
+    #ifdef EDGE_COVERAGE
+    void set_coverage(Coverage* coverage);
+    #endif
+    #ifdef PROFILE
+    void set_profiler(Profiler* profiler);
+    #endif
+    #ifdef TRACE
+    void set_tracer(Tracer* tracer);
+    #endif
     Screen<64, 32> screen{};
     std::array<bool, 16> keys_pressed = {};
 private:
-    std::array<uint8_t, 4096> memory = {};
+    Memory<4096> memory;
     std::array<uint8_t, 16> registers = {};
     Stack<16> stack{};
 
@@ -29,14 +201,108 @@ private:
     uint8_t sound_timer = 0;
     uint8_t delay_timer = 0;
     uint16_t instruction = 0;
+
+    // behind 0xCXNN; reseeded with `random_seed` on every reset
+    Random random{};
+    uint64_t random_seed = 0;
+
+    Debugger* debugger = nullptr;
+
+    #ifdef EDGE_COVERAGE
+    Coverage* coverage = nullptr;
+    #endif
+
+    #ifdef PROFILE
+    Profiler* profiler = nullptr;
+    #endif
+
+    #ifdef TRACE
+    Tracer* tracer = nullptr;
+    #endif
+
+    // set when the last instruction left the ROM spinning until the next
+    // timer tick or keypress, and how many cycles we've skipped because of it
+    bool idle = false;
+    uint64_t elided_cycles = 0;
+
+    // set by an instruction that faulted, which also sets `idle` so the
+    // loop in `run` stops without testing for this every time around
+    Fault fault = Fault::none;
+
+    // which quirks we run with, and `execute_instruction` compiled for them
+    // (for `cycle`)
+    Profile profile = Profile::modern;
+    void (Chip8::*execute)() = &Chip8::execute_instruction<Modern>;
+
+    // which policy and profile the handlers in `decoded` were decoded for
+    bool decoded_masked = false;
+    Profile decoded_profile = Profile::modern;
+
+    // the operands of the current instruction, unpacked once up front so the
+    // instructions themselves don't have to mask and shift them out again
+    struct Operands {
+        uint16_t nnn = 0;
+        uint8_t nn = 0;
+        uint8_t n = 0;
+        uint8_t x = 0;
+        uint8_t y = 0;
+    };
+
+    // NOTE: plain function pointers are cheaper to call through than pointers
+    // to members, so every instruction gets a thin static wrapper
+    using Handler = void (*)(Chip8&);
+
+    template <void (Chip8::*Instruction)()>
+    static void thunk(Chip8& chip8) {
+        (chip8.*Instruction)();
+    }
+
+    #ifdef SPECIALIZED_DISPATCH
+    // `Specialized`'s table for our profile, which `cycle` runs instructions
+    // from instead of `execute`
+    const Handler* specialized = nullptr;
+    #endif
+
+    // an instruction that has already been decoded: the instruction to
+    // dispatch to, plus its unpacked operands
+    struct Decoded {
+        Handler handler = nullptr;
+        Operands operands{};
+    };
+
+    Operands operands{};
+
+    // cache of decoded instructions, keyed by address; a bit in
+    // `decoded_valid` (one set per page) is only set while `decoded` holds an
+    // up-to-date decoding of the two bytes at that address
+    //
+    // NOTE: empty until the first `run`, since it's far bigger than the rest
+    // of the machine put together and plenty of machines (e.g. one waiting in
+    // a batch, or only ever stepped with `cycle`) never need it
+    std::vector<Decoded> decoded;
+    std::array<std::bitset<PAGE_BYTES>, 4096 / PAGE_BYTES> decoded_valid{};
+
+    // the bytes of `memory` something derived from them (i.e. code the `Jit`
+    // translated) depends on; writing over one clears its bit and sets
+    // `overwritten`, so whoever's watching can tell exactly what went stale
+    std::array<std::bitset<PAGE_BYTES>, 4096 / PAGE_BYTES> watched{};
+    bool overwritten = false;
     
     // helpers
 
+    template <typename Policy, typename Quirks, bool DEBUGGED>
+    Status loop(const uint64_t cycles);
+    static Operands unpack(const uint16_t instruction);
+    template <typename Policy, typename Quirks>
+    static Handler decode(const uint16_t instruction);
+    Handler handler(const uint16_t instruction) const;
     void fetch_instruction();
     void increment_pc();
     void decrement_pc();
+    template <typename Quirks>
     void execute_instruction();
-    void decrement_timers();
+    void write(const uint16_t address, const uint8_t value);
+    void invalidate(const uint16_t address, const uint16_t length);
     uint16_t extract_nnn();
     uint8_t extract_nn();
     uint8_t extract_n();
@@ -45,14 +311,19 @@ private:
     uint8_t& vx();
     uint8_t& vy();
     uint8_t& vf();
+    void jump(const uint16_t target);
     void skip_if(const bool condition);
     void illegal();
+    void fail(const Fault fault);
+    [[noreturn]] static void raise(const Fault fault);
 
     // instructions
 
     void cls();
+    template <typename Policy>
     void ret();
     void jp_nnn();
+    template <typename Policy>
     void call_nnn();
     void se_vx_nn();
     void sne_vx_nn();
@@ -60,20 +331,29 @@ private:
     void ld_vx_nn();
     void add_vx_nn();
     void ld_vx_vy();
+    template <typename Quirks>
     void or_vx_vy();
+    template <typename Quirks>
     void and_vx_vy();
+    template <typename Quirks>
     void xor_vx_vy();
     void add_vx_vy();
     void sub_vx_vy();
+    template <typename Quirks>
     void shr_vx();
     void subn_vx_vy();
+    template <typename Quirks>
     void shl_vx();
     void sne_vx_vy();
     void ld_i_nnn();
+    template <typename Quirks>
     void jp_v0_nnn();
     void rnd_vx_nn();
+    template <typename Policy, typename Quirks>
     void drw_vx_vy_n();
+    template <typename Policy>
     void skp_vx();
+    template <typename Policy>
     void sknp_vx();
     void ld_vx_dt();
     void ld_vx_k();
@@ -81,8 +361,11 @@ private:
     void ld_st_vx();
     void add_i_vx();
     void ld_f_vx();
+    template <typename Policy>
     void ld_b_vx();
+    template <typename Policy, typename Quirks>
     void ld_mem_vx();
+    template <typename Policy, typename Quirks>
     void ld_vx_mem();
 };
 
@@ -0,0 +1,88 @@
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef CHIP8_COVERAGE_H
+#define CHIP8_COVERAGE_H
+
+// which control flow edges (the `pc` an instruction ran at, and the `pc` it
+// left behind) a run has taken, one bit each, hashed down so the whole map
+// stays small enough to clear and compare after every run
+//
+// NOTE: a machine only records these when built with `EDGE_COVERAGE`
+class Coverage {
+public:
+    static constexpr size_t EDGES = 1 << 16;
+    static constexpr size_t WORDS = EDGES / 64;
+
+    void hit(const uint16_t from, const uint16_t to) noexcept {
+        // NOTE: multiplicative hashing, keeping the top 16 bits; straight-line
+        // code (`to == from + 2`) spreads out as well as jumps do
+        const uint32_t edge = (uint32_t{from} << 12 | to) * 0x9E3779B1u >> 16;
+
+        bits[edge / 64] |= uint64_t{1} << edge % 64;
+    }
+
+    void clear() noexcept {
+        bits.fill(0);
+    }
+
+    size_t count() const noexcept {
+        size_t edges = 0;
+
+        for (const uint64_t word : bits) {
+            edges += std::popcount(word);
+        }
+
+        return edges;
+    }
+
+    uint64_t word(const size_t i) const noexcept {
+        return bits[i];
+    }
+
+private:
+    std::array<uint64_t, WORDS> bits = {};
+};
+
+// every edge any run has taken so far, shared between threads
+class SharedCoverage {
+public:
+    // add `coverage`'s edges to ours; returns how many of them we hadn't
+    // seen before
+    //
+    // NOTE: only words with something new in them get written (atomically),
+    // so threads that keep taking the same edges only ever read
+    size_t merge(const Coverage& coverage) noexcept {
+        size_t fresh = 0;
+
+        for (size_t i = 0; i < Coverage::WORDS; ++i) {
+            const uint64_t word = coverage.word(i);
+
+            if (word & ~bits[i].load(std::memory_order_relaxed)) {
+                const uint64_t before = bits[i].fetch_or(word, std::memory_order_relaxed);
+
+                fresh += std::popcount(word & ~before);
+            }
+        }
+
+        return fresh;
+    }
+
+    size_t count() const noexcept {
+        size_t edges = 0;
+
+        for (const auto& word : bits) {
+            edges += std::popcount(word.load(std::memory_order_relaxed));
+        }
+
+        return edges;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, Coverage::WORDS> bits = {};
+};
+
+#endif
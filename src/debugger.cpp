@@ -0,0 +1,346 @@
+#include "debugger.h"
+#include "chip8.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+bool Debugger::Condition::holds(const uint8_t actual) const {
+    switch (compare) {
+        case Compare::equal: return actual == value;
+        case Compare::not_equal: return actual != value;
+        case Compare::less: return actual < value;
+        case Compare::less_equal: return actual <= value;
+        case Compare::greater: return actual > value;
+        case Compare::greater_equal: return actual >= value;
+    }
+
+    return false;
+}
+
+void Debugger::add_breakpoint(const uint16_t address) {
+    breakpoints.set(address % breakpoints.size());
+}
+
+// stop at `address` only while `condition` holds (any of them, if there's
+// more than one there)
+void Debugger::add_breakpoint(const uint16_t address, const Condition& condition) {
+    conditional.set(address % conditional.size());
+    conditions[address % conditional.size()].push_back(condition);
+}
+
+void Debugger::remove_breakpoints(const uint16_t address) {
+    breakpoints.reset(address % breakpoints.size());
+    conditional.reset(address % conditional.size());
+    conditions.erase(address % conditional.size());
+}
+
+// watch `first` to `last` (inclusive) for `accesses` (`READS` and/or
+// `WRITES`), on top of whatever's already watched there
+void Debugger::watch(const uint16_t first, const uint16_t last, const uint8_t accesses) {
+    for (size_t address = first; address <= last && address < watched_reads.size(); ++address) {
+        watched_reads[address] = watched_reads[address] || accesses & READS;
+        watched_writes[address] = watched_writes[address] || accesses & WRITES;
+    }
+}
+
+void Debugger::unwatch(const uint16_t first, const uint16_t last) {
+    for (size_t address = first; address <= last && address < watched_reads.size(); ++address) {
+        watched_reads.reset(address);
+        watched_writes.reset(address);
+    }
+}
+
+// watch `I` for `accesses` (or stop watching it, if that's 0)
+void Debugger::watch_index(const uint8_t accesses) {
+    watched_index = accesses;
+}
+
+void Debugger::pause() {
+    pausing = true;
+}
+
+void Debugger::resume() {
+    resuming = true;
+    stop.reset();
+}
+
+const std::optional<Debugger::Stop>& Debugger::stopped() const {
+    return stop;
+}
+
+bool Debugger::stop_at(const Reason reason, const uint16_t pc, const uint16_t address) {
+    stop = Stop{reason, pc, address};
+
+    return true;
+}
+
+bool Debugger::watching(const std::bitset<4096>& watched, const uint16_t first, const uint16_t length,
+                        const Reason reason, const uint16_t pc) {
+    for (size_t address = first; address < first + length && address < watched.size(); ++address) {
+        if (watched.test(address)) {
+            return stop_at(reason, pc, address);
+        }
+    }
+
+    return false;
+}
+
+// NOTE: the instruction at `pc` has already been fetched (and so is known to
+// be in bounds) by the time we're called; watchpoints work out what it's
+// about to touch from the instruction itself, rather than being checked
+// inside the instructions, which would cost the normal path too
+bool Debugger::check(const Chip8& chip8) {
+    const uint16_t pc = chip8.pc;
+
+    if (resuming) {
+        resuming = false;
+        return false;
+    }
+
+    if (pausing) {
+        pausing = false;
+        return stop_at(Reason::pause, pc);
+    }
+
+    if (breakpoints.test(pc)) {
+        return stop_at(Reason::breakpoint, pc);
+    }
+
+    if (conditional.test(pc)) {
+        for (const Condition& condition : conditions[pc]) {
+            if (condition.holds(chip8.registers[condition.reg])) {
+                return stop_at(Reason::condition, pc);
+            }
+        }
+    }
+
+    // NOTE: wrapped the same way `Masked` fetches it, which is the only way
+    // to get here with `pc` on the last byte of memory
+    const uint16_t instruction = chip8.memory[pc] << 8 | chip8.memory[(pc + 1) & (chip8.memory.size() - 1)];
+    const uint16_t index = chip8.index;
+    const uint8_t x = instruction >> 8 & 0xF;
+    const bool increments = with_quirks(chip8.profile, [](auto quirks) {
+        return decltype(quirks)::INCREMENT_INDEX != IndexIncrement::none;
+    });
+    uint8_t index_accesses = 0;
+    uint16_t reads = 0;
+    uint16_t writes = 0;
+
+    // NOTE: the spans here have to match what the instructions themselves
+    // read and write
+    switch (instruction >> 12) {
+        case 0xA: index_accesses = WRITES; break;
+        case 0xD: index_accesses = READS; reads = instruction & 0xF; break;
+        case 0xF:
+            switch (instruction & 0xFF) {
+                case 0x1E: index_accesses = READS | WRITES; break;
+                case 0x29: index_accesses = WRITES; break;
+                case 0x33: index_accesses = READS; writes = 3; break;
+                case 0x55: index_accesses = increments ? READS | WRITES : READS; writes = x + 1; break;
+                case 0x65: index_accesses = increments ? READS | WRITES : READS; reads = x + 1; break;
+            }
+            break;
+    }
+
+    if (watched_index & index_accesses & READS) {
+        return stop_at(Reason::index_read, pc, index);
+    }
+
+    if (watched_index & index_accesses & WRITES) {
+        return stop_at(Reason::index_write, pc, index);
+    }
+
+    return watching(watched_reads, index, reads, Reason::read, pc)
+        || watching(watched_writes, index, writes, Reason::write, pc);
+}
+
+static std::string hex(const unsigned value, const int digits) {
+    std::ostringstream out;
+
+    out << "0x" << std::hex << std::uppercase << std::setw(digits) << std::setfill('0') << value;
+
+    return out.str();
+}
+
+// where we are and what the machine looks like
+void Debugger::describe(const Chip8& chip8, std::ostream& out) const {
+    if (stop) {
+        switch (stop->reason) {
+            case Reason::pause: out << "paused"; break;
+            case Reason::breakpoint: out << "breakpoint"; break;
+            case Reason::condition: out << "conditional breakpoint"; break;
+            case Reason::read: out << "about to read " << hex(stop->address, 3); break;
+            case Reason::write: out << "about to write " << hex(stop->address, 3); break;
+            case Reason::index_read: out << "about to read I"; break;
+            case Reason::index_write: out << "about to write I"; break;
+        }
+
+        out << '\n';
+    }
+
+    const uint16_t pc = chip8.pc;
+
+    out << "pc=" << hex(pc, 3);
+
+    if (pc + 1u < chip8.memory.size()) {
+        out << ' ' << hex(chip8.memory[pc] << 8 | chip8.memory[pc + 1], 4);
+    }
+
+    out << " I=" << hex(chip8.index, 3)
+        << " DT=" << hex(chip8.delay_timer, 2)
+        << " ST=" << hex(chip8.sound_timer, 2) << '\n';
+
+    for (size_t i = 0; i < chip8.registers.size(); ++i) {
+        out << 'V' << std::hex << std::uppercase << i << std::dec << '=' << hex(chip8.registers[i], 2)
+            << (i % 8 == 7 ? '\n' : ' ');
+    }
+
+    out << "stack:";
+
+    for (size_t i = 0; i < chip8.stack.stack_pointer; ++i) {
+        out << ' ' << hex(chip8.stack.stack[i], 3);
+    }
+
+    out << '\n';
+}
+
+static uint16_t parse_address(const std::string& text) {
+    const unsigned long address = std::stoul(text, nullptr, 16);
+
+    if (address >= 4096) {
+        throw std::out_of_range{"address out of range"};
+    }
+
+    return address;
+}
+
+static uint8_t parse_accesses(const std::string& text) {
+    if (text.empty() || text == "rw") {
+        return Debugger::READS | Debugger::WRITES;
+    } else if (text == "r") {
+        return Debugger::READS;
+    } else if (text == "w") {
+        return Debugger::WRITES;
+    }
+
+    throw std::invalid_argument{"expected r, w or rw"};
+}
+
+// e.g. `v3`, `>=` and `10` (in hex)
+static Debugger::Condition parse_condition(const std::string& reg, const std::string& compare,
+                                           const std::string& value) {
+    static const std::map<std::string, Debugger::Compare> COMPARES = {
+        {"==", Debugger::Compare::equal}, {"!=", Debugger::Compare::not_equal},
+        {"<", Debugger::Compare::less}, {"<=", Debugger::Compare::less_equal},
+        {">", Debugger::Compare::greater}, {">=", Debugger::Compare::greater_equal}
+    };
+
+    const auto found = COMPARES.find(compare);
+
+    if (reg.size() != 2 || (reg[0] != 'v' && reg[0] != 'V') || found == COMPARES.end()) {
+        throw std::invalid_argument{"expected a condition like v3 >= 10"};
+    }
+
+    return {
+        static_cast<uint8_t>(std::stoul(reg.substr(1), nullptr, 16)),
+        found->second,
+        static_cast<uint8_t>(std::stoul(value, nullptr, 16))
+    };
+}
+
+static constexpr const char* HELP =
+    "c                       carry on\n"
+    "s [count]               run count instructions (1 if left out)\n"
+    "r                       show the registers\n"
+    "x <address> [length]    show memory\n"
+    "b <address> [vX op NN]  break at address (only while VX op NN, op being\n"
+    "                        one of == != < <= > >=)\n"
+    "d <address>             delete the breakpoints at address\n"
+    "w <first> [last] [r|w|rw]\n"
+    "                        watch memory (for reads and writes by default)\n"
+    "u <first> [last]        stop watching memory\n"
+    "i [r|w|rw|off]          watch I\n"
+    "q                       quit\n"
+    "(addresses and values are in hex)\n";
+
+// NOTE: stepping runs instructions outside of any frame, so the timers don't
+// count down while we do
+bool Debugger::console(Chip8& chip8, std::istream& in, std::ostream& out) {
+    describe(chip8, out);
+
+    std::string line;
+
+    while (out << "(chip8) " << std::flush && std::getline(in, line)) {
+        std::istringstream words{line};
+        std::string command;
+        std::vector<std::string> args;
+
+        words >> command;
+
+        for (std::string arg; words >> arg;) {
+            args.push_back(arg);
+        }
+
+        try {
+            if (command.empty()) {
+                continue;
+            } else if (command == "c") {
+                resume();
+                return true;
+            } else if (command == "s") {
+                uint64_t left = args.empty() ? 1 : std::stoull(args[0]);
+
+                resume();
+
+                while (left > 0 && !stop) {
+                    left -= chip8.run_decoded(left);
+                }
+
+                describe(chip8, out);
+            } else if (command == "r") {
+                describe(chip8, out);
+            } else if (command == "x" && !args.empty()) {
+                const uint16_t first = parse_address(args[0]);
+                const size_t length = args.size() > 1 ? std::stoul(args[1], nullptr, 16) : 16;
+
+                for (size_t i = 0; i < length && first + i < chip8.memory.size(); ++i) {
+                    if (i % 16 == 0) {
+                        out << (i ? "\n" : "") << hex(first + i, 3) << ':';
+                    }
+
+                    out << ' ' << hex(chip8.memory[first + i], 2).substr(2);
+                }
+
+                out << '\n';
+            } else if (command == "b" && args.size() == 1) {
+                add_breakpoint(parse_address(args[0]));
+            } else if (command == "b" && args.size() == 4) {
+                add_breakpoint(parse_address(args[0]), parse_condition(args[1], args[2], args[3]));
+            } else if (command == "d" && args.size() == 1) {
+                remove_breakpoints(parse_address(args[0]));
+            } else if (command == "w" && !args.empty()) {
+                const uint16_t first = parse_address(args[0]);
+                const bool ranged = args.size() > 1 && args[1] != "r" && args[1] != "w" && args[1] != "rw";
+                const uint16_t last = ranged ? parse_address(args[1]) : first;
+
+                watch(first, last, parse_accesses(args.size() > 1u + ranged ? args[1 + ranged] : ""));
+            } else if (command == "u" && !args.empty()) {
+                const uint16_t first = parse_address(args[0]);
+
+                unwatch(first, args.size() > 1 ? parse_address(args[1]) : first);
+            } else if (command == "i") {
+                watch_index(!args.empty() && args[0] == "off" ? 0 : parse_accesses(args.empty() ? "" : args[0]));
+            } else if (command == "q") {
+                return false;
+            } else {
+                out << HELP;
+            }
+        } catch (const std::exception& e) {
+            out << "error: " << e.what() << '\n';
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,93 @@
+#include <bitset>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#ifndef CHIP8_DEBUGGER_H
+#define CHIP8_DEBUGGER_H
+
+class Chip8;
+
+// stops a machine before it runs an instruction at a breakpoint, or one that
+// would touch a watched range of memory or `I`, so it can be looked at (see
+// `console`); attach one with `Chip8::set_debugger`
+//
+// NOTE: only `Chip8::run_decoded` stops, and it runs a separate copy of its
+// loop while a debugger's attached, so a machine without one doesn't pay
+// anything for this; every check is a lookup in a bitmap with a bit per
+// address, however many breakpoints or watchpoints there are
+class Debugger {
+public:
+    enum class Reason { pause, breakpoint, condition, read, write, index_read, index_write };
+
+    // what the machine was about to do when it stopped; `address` is the
+    // watched address it was about to touch, if that's why
+    struct Stop {
+        Reason reason = Reason::pause;
+        uint16_t pc = 0;
+        uint16_t address = 0;
+    };
+
+    enum class Compare { equal, not_equal, less, less_equal, greater, greater_equal };
+
+    // a condition on one of `V0` to `VF`, e.g. `V3 >= 0x10`
+    struct Condition {
+        uint8_t reg = 0;
+        Compare compare = Compare::equal;
+        uint8_t value = 0;
+
+        bool holds(const uint8_t actual) const;
+    };
+
+    // which ways of touching memory (or `I`) a watchpoint catches
+    static constexpr uint8_t READS = 1;
+    static constexpr uint8_t WRITES = 2;
+
+    void add_breakpoint(const uint16_t address);
+    void add_breakpoint(const uint16_t address, const Condition& condition);
+    void remove_breakpoints(const uint16_t address);
+    void watch(const uint16_t first, const uint16_t last, const uint8_t accesses);
+    void unwatch(const uint16_t first, const uint16_t last);
+    void watch_index(const uint8_t accesses);
+
+    // stop before the next instruction, whatever it is
+    void pause();
+
+    // let the instruction we stopped at run next time (rather than stopping
+    // at it again straight away)
+    void resume();
+
+    // why we stopped, if we have
+    const std::optional<Stop>& stopped() const;
+
+    // called by `Chip8::run_decoded` before every instruction; true if the
+    // machine should stop before it (which `stopped` then explains)
+    bool check(const Chip8& chip8);
+
+    // a line-based console on `in`/`out` to look at a stopped machine, step
+    // it and change breakpoints and watchpoints; returns once told to carry
+    // on, or false if told to quit
+    bool console(Chip8& chip8, std::istream& in, std::ostream& out);
+
+private:
+    std::bitset<4096> breakpoints;
+    std::bitset<4096> conditional;
+    std::map<uint16_t, std::vector<Condition>> conditions;
+    std::bitset<4096> watched_reads;
+    std::bitset<4096> watched_writes;
+    uint8_t watched_index = 0;
+
+    bool pausing = false;
+    bool resuming = false;
+    std::optional<Stop> stop;
+
+    bool stop_at(const Reason reason, const uint16_t pc, const uint16_t address = 0);
+    bool watching(const std::bitset<4096>& watched, const uint16_t first, const uint16_t length,
+                  const Reason reason, const uint16_t pc);
+    void describe(const Chip8& chip8, std::ostream& out) const;
+};
+
+#endif
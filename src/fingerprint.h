@@ -0,0 +1,43 @@
+#include <cstdint>
+
+#ifndef CHIP8_FINGERPRINT_H
+#define CHIP8_FINGERPRINT_H
+
+// which part of a machine a fingerprint key belongs to, so the same position
+// and value in two different parts don't cancel each other out
+enum class Part : uint64_t {
+    memory = 1,
+    screen = 2,
+    cpu = 3,
+
+    // not part of a machine at all, but the keys it's given on each frame
+    // (e.g. so a fuzzer can tell two runs will go the same way, see
+    // `chip8-fuzz`)
+    keys = 4,
+};
+
+// SplitMix64's finalizer: every bit of the input affects every bit of the
+// output
+constexpr uint64_t mix(uint64_t z) noexcept {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+
+    return z ^ (z >> 31);
+}
+
+// the Zobrist key for byte `value` being at `position` in `part`; a
+// fingerprint is the XOR of the keys of everything in it, so changing one
+// value only means XORing its old key out and its new one in
+//
+// NOTE: keys are computed rather than looked up, since a table with one for
+// every value of every byte of memory would be megabytes
+constexpr uint64_t byte_key(const Part part, const uint32_t position, const uint8_t value) noexcept {
+    return mix(static_cast<uint64_t>(part) << 40 | uint64_t{position} << 8 | value);
+}
+
+// same as above, but for a whole word (which takes another round of mixing)
+constexpr uint64_t word_key(const Part part, const uint32_t position, const uint64_t value) noexcept {
+    return mix(byte_key(part, position, 0) ^ value);
+}
+
+#endif
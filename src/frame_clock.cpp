@@ -0,0 +1,57 @@
+#include "frame_clock.h"
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <time.h>
+#include <cerrno>
+#endif
+
+FrameClock::FrameClock(const int frequency) :
+    period{std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0 / frequency))},
+    next{clock::now()} {}
+
+unsigned FrameClock::advance() {
+    const auto now = clock::now();
+    unsigned frames = 0;
+
+    while (next <= now && frames < MAX_CATCH_UP) {
+        next += period;
+        ++frames;
+    }
+
+    if (next <= now) {
+        next = now + period;
+    }
+
+    return frames;
+}
+
+void FrameClock::wait() const {
+    #ifdef __linux__
+    // NOTE: sleeping until an absolute deadline (rather than for a duration)
+    // means time spent getting here doesn't push every later frame back;
+    // `steady_clock` is `CLOCK_MONOTONIC` on Linux, so the epochs line up
+    const auto since_epoch = next.time_since_epoch();
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    const timespec deadline{
+        static_cast<time_t>(seconds.count()),
+        static_cast<long>(std::chrono::nanoseconds{since_epoch - seconds}.count())
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        // interrupted by a signal, so go back to sleep
+    }
+    #else
+    std::this_thread::sleep_until(next);
+    #endif
+}
+
+std::chrono::steady_clock::time_point FrameClock::due_at(const unsigned ago) const {
+    return next - ago * period;
+}
+
+std::chrono::steady_clock::duration FrameClock::get_period() const {
+    return period;
+}
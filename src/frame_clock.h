@@ -0,0 +1,36 @@
+#include <chrono>
+#include <cstdint>
+
+#ifndef CHIP8_FRAME_CLOCK_H
+#define CHIP8_FRAME_CLOCK_H
+
+// paces a loop to a fixed number of frames per second by sleeping until each
+// frame is due, rather than spinning on the clock
+class FrameClock {
+public:
+    explicit FrameClock(const int frequency);
+
+    // how many frames have come due since the last call (normally 1); after a
+    // hiccup we catch up on up to `MAX_CATCH_UP` missed frames, and past that
+    // we give up on them and start over from now
+    unsigned advance();
+
+    // sleep until the next frame is due
+    void wait() const;
+
+    // when the frame `ago` frames before the next one came due, e.g. when
+    // the last of the frames `advance` just counted came due is `due_at(1)`
+    std::chrono::steady_clock::time_point due_at(const unsigned ago) const;
+
+    std::chrono::steady_clock::duration get_period() const;
+
+    static constexpr unsigned MAX_CATCH_UP = 5;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    clock::duration period;
+    clock::time_point next;
+};
+
+#endif
@@ -0,0 +1,326 @@
+#include "frame_sink.h"
+#include "bytes.h"
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+// delta files start with this, then `VIDEO_VERSION`
+constexpr std::array<uint8_t, 4> VIDEO_MAGIC = {'C', '8', 'V', 'D'};
+
+// NOTE: bump this whenever the layout of a delta file changes
+constexpr uint16_t VIDEO_VERSION = 1;
+
+constexpr size_t VIDEO_HEADER_SIZE = 4 + 2 + 1 + 1 + 2;
+
+constexpr size_t WIDTH = 64;
+constexpr size_t HEIGHT = 32;
+
+const char* format_name(const VideoFormat format) {
+    switch (format) {
+        case VideoFormat::y4m: return "y4m";
+        case VideoFormat::ppm: return "ppm";
+        case VideoFormat::delta: return "delta";
+    }
+
+    return "unknown";
+}
+
+VideoFormat find_format(const std::string_view name) {
+    for (const auto format : {VideoFormat::y4m, VideoFormat::ppm, VideoFormat::delta}) {
+        if (name == format_name(format)) {
+            return format;
+        }
+    }
+
+    throw std::invalid_argument{"unknown video format (expected y4m, ppm or delta)"};
+}
+
+// 7 bits at a time, least significant first, with the top bit set on every
+// byte but the last (the same as in movies)
+static void write_varint(std::vector<uint8_t>& out, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+    }
+
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static uint64_t read_varint(std::istream& in) {
+    uint64_t value = 0;
+
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        const int byte = in.get();
+
+        if (byte == std::char_traits<char>::eof()) {
+            throw std::runtime_error{"video file is corrupt"};
+        }
+
+        value |= uint64_t{byte & 0x7Fu} << shift;
+
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+
+    throw std::runtime_error{"video file is corrupt"};
+}
+
+// `bytes` as runs, each a count of zero bytes and a count of other bytes (as
+// varints) followed by those other bytes; a changed row is mostly zeros once
+// XORed with what was there before, since a frame usually only draws a
+// sprite or two into it
+static void encode_runs(const std::vector<uint8_t>& bytes, std::vector<uint8_t>& out) {
+    for (size_t at = 0; at < bytes.size();) {
+        const size_t zeros_end = std::find_if(bytes.begin() + at, bytes.end(), [](const uint8_t byte) {
+            return byte != 0;
+        }) - bytes.begin();
+        const size_t literals_end = std::find(bytes.begin() + zeros_end, bytes.end(), 0) - bytes.begin();
+
+        write_varint(out, zeros_end - at);
+        write_varint(out, literals_end - zeros_end);
+        out.insert(out.end(), bytes.begin() + zeros_end, bytes.begin() + literals_end);
+        at = literals_end;
+    }
+}
+
+// the reverse of `encode_runs`, for `count` bytes
+static void decode_runs(std::istream& in, const size_t count, std::vector<uint8_t>& bytes) {
+    bytes.clear();
+
+    while (bytes.size() < count) {
+        const uint64_t zeros = read_varint(in);
+        const uint64_t literals = read_varint(in);
+
+        if (zeros + literals > count - bytes.size()) {
+            throw std::runtime_error{"video file is corrupt"};
+        }
+
+        bytes.insert(bytes.end(), zeros, 0);
+
+        for (uint64_t i = 0; i < literals; ++i) {
+            const int byte = in.get();
+
+            if (byte == std::char_traits<char>::eof()) {
+                throw std::runtime_error{"video file is corrupt"};
+            }
+
+            bytes.push_back(static_cast<uint8_t>(byte));
+        }
+    }
+}
+
+FrameSink::FrameSink(const std::string& path, const VideoFormat format, const unsigned frequency)
+    : format{format} {
+    if (path == "-") {
+        out = &std::cout;
+    } else {
+        file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error{"error opening video file " + path};
+        }
+
+        out = &file;
+    }
+
+    const std::string size = " W" + std::to_string(WIDTH) + " H" + std::to_string(HEIGHT);
+
+    switch (format) {
+        case VideoFormat::y4m: {
+            const std::string header = "YUV4MPEG2" + size + " F" + std::to_string(frequency) + ":1 Ip A1:1 Cmono\n";
+
+            buffer.assign(header.begin(), header.end());
+            break;
+        }
+        case VideoFormat::ppm:
+            break;
+        case VideoFormat::delta: {
+            std::array<uint8_t, VIDEO_HEADER_SIZE> header;
+            auto into = std::copy(VIDEO_MAGIC.begin(), VIDEO_MAGIC.end(), header.begin());
+
+            into = put_le(into, VIDEO_VERSION);
+            into = put_le(into, static_cast<uint8_t>(WIDTH));
+            into = put_le(into, static_cast<uint8_t>(HEIGHT));
+            put_le(into, static_cast<uint16_t>(frequency));
+            buffer.assign(header.begin(), header.end());
+            break;
+        }
+    }
+
+    flush();
+}
+
+// NOTE: the unchanged frames at the end of a delta file only get written
+// here, so a sink that's never destroyed (e.g. in a process that was killed)
+// leaves them out; and since destructors can't throw, an error writing them
+// goes unreported
+FrameSink::~FrameSink() {
+    if (format == VideoFormat::delta && unchanged > 0) {
+        buffer.clear();
+        write_varint(buffer, unchanged - 1);
+        buffer.insert(buffer.end(), 4, 0);
+
+        out->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+
+    out->flush();
+}
+
+void FrameSink::write(const Screen<64, 32>& screen) {
+    const auto& rows = screen.packed();
+
+    buffer.clear();
+
+    switch (format) {
+        case VideoFormat::y4m: {
+            const std::string_view frame = "FRAME\n";
+
+            buffer.assign(frame.begin(), frame.end());
+
+            for (const uint64_t row : rows) {
+                for (size_t x = 0; x < WIDTH; ++x) {
+                    buffer.push_back(row >> (WIDTH - 1 - x) & 1 ? 0xFF : 0x00);
+                }
+            }
+            break;
+        }
+        case VideoFormat::ppm: {
+            const std::string header = "P6\n" + std::to_string(WIDTH) + ' ' + std::to_string(HEIGHT) + "\n255\n";
+
+            buffer.assign(header.begin(), header.end());
+
+            for (const uint64_t row : rows) {
+                for (size_t x = 0; x < WIDTH; ++x) {
+                    buffer.insert(buffer.end(), 3, row >> (WIDTH - 1 - x) & 1 ? 0xFF : 0x00);
+                }
+            }
+            break;
+        }
+        case VideoFormat::delta: {
+            uint32_t mask = 0;
+
+            changed.clear();
+
+            for (size_t y = 0; y < rows.size(); ++y) {
+                if (rows[y] != last[y]) {
+                    mask |= uint32_t{1} << y;
+                    put_le(std::back_inserter(changed), rows[y] ^ last[y]);
+                }
+            }
+
+            if (mask == 0) {
+                ++unchanged;
+                return;
+            }
+
+            write_varint(buffer, unchanged);
+            put_le(std::back_inserter(buffer), mask);
+            encode_runs(changed, buffer);
+            last = rows;
+            unchanged = 0;
+            break;
+        }
+    }
+
+    flush();
+}
+
+uint64_t FrameSink::bytes() const {
+    return written;
+}
+
+void FrameSink::flush() {
+    if (!out->write(reinterpret_cast<const char*>(buffer.data()), buffer.size())) {
+        throw std::runtime_error{"error writing video"};
+    }
+
+    written += buffer.size();
+}
+
+FrameReader::FrameReader(const std::string& path) : file{path, std::ios::binary | std::ios::in} {
+    if (!file.is_open()) {
+        throw std::runtime_error{"error opening video file " + path};
+    }
+
+    std::array<uint8_t, VIDEO_HEADER_SIZE> header;
+    uint16_t version = 0;
+    uint8_t width = 0;
+    uint8_t height = 0;
+    uint16_t frames_per_second = 0;
+
+    if (!file.read(reinterpret_cast<char*>(header.data()), header.size())
+            || !std::equal(VIDEO_MAGIC.begin(), VIDEO_MAGIC.end(), header.begin())) {
+        throw std::runtime_error{path + " is not a delta video file"};
+    }
+
+    get_le(get_le(get_le(get_le(header.data() + VIDEO_MAGIC.size(), version), width), height), frames_per_second);
+
+    if (version != VIDEO_VERSION) {
+        throw std::runtime_error{path + " is from an incompatible version"};
+    }
+
+    if (width != WIDTH || height != HEIGHT) {
+        throw std::runtime_error{path + " isn't 64x32"};
+    }
+
+    frequency = frames_per_second;
+}
+
+unsigned FrameReader::get_frequency() const {
+    return frequency;
+}
+
+bool FrameReader::next(std::array<uint64_t, 32>& rows) {
+    if (!pending && !read_record()) {
+        return false;
+    }
+
+    if (repeats > 0) {
+        --repeats;
+    } else {
+        this->rows = changed;
+        pending = false;
+    }
+
+    rows = this->rows;
+
+    return true;
+}
+
+// read the next record into `changed` and `repeats`; false if there isn't one
+bool FrameReader::read_record() {
+    if (file.peek() == std::char_traits<char>::eof()) {
+        return false;
+    }
+
+    std::array<uint8_t, 4> mask_bytes;
+    uint32_t mask = 0;
+
+    repeats = read_varint(file);
+
+    if (!file.read(reinterpret_cast<char*>(mask_bytes.data()), mask_bytes.size())) {
+        throw std::runtime_error{"video file is corrupt"};
+    }
+
+    get_le(mask_bytes.data(), mask);
+    decode_runs(file, std::popcount(mask) * sizeof(uint64_t), xors);
+
+    const uint8_t* in = xors.data();
+
+    changed = rows;
+
+    for (size_t y = 0; y < changed.size(); ++y) {
+        if (mask >> y & 1) {
+            uint64_t xor_row = 0;
+
+            in = get_le(in, xor_row);
+            changed[y] ^= xor_row;
+        }
+    }
+
+    pending = true;
+
+    return true;
+}
@@ -0,0 +1,100 @@
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "screen.h"
+
+#ifndef CHIP8_FRAME_SINK_H
+#define CHIP8_FRAME_SINK_H
+
+// what a `FrameSink` writes:
+//   y4m   - YUV4MPEG2 video, greyscale, a byte per pixel (for ffmpeg etc.)
+//   ppm   - one binary PPM image after another, three bytes per pixel
+//   delta - our own format (see `FrameSink`), a few bytes per row that
+//           changed, and nothing at all for a frame where nothing did
+enum class VideoFormat : uint8_t { y4m, ppm, delta };
+
+const char* format_name(const VideoFormat format);
+
+// the format called `name` (as in `format_name`), or throws
+// `std::invalid_argument`
+VideoFormat find_format(const std::string_view name);
+
+// writes a run's frames out to a file or pipe (or standard output, for
+// `-`), one call to `write` per frame, without needing a window (see
+// `Platform`) to show them in
+//
+// a delta file is the magic and version, the width, height and frames per
+// second, then a record for every frame where something changed: how many
+// frames since the last record (as a varint, so the unchanged frames in
+// between cost nothing), a 32-bit mask of which rows changed, then the XOR of
+// each of those rows with what was there before, run-length encoded (see
+// `encode_runs`); the screen starts out blank, and a record with no rows
+// changed marks however many unchanged frames there were at the end
+class FrameSink {
+public:
+    FrameSink(const std::string& path, const VideoFormat format, const unsigned frequency);
+    ~FrameSink();
+
+    FrameSink(const FrameSink&) = delete;
+    FrameSink& operator=(const FrameSink&) = delete;
+
+    // add `screen` as the next frame; throws `std::runtime_error` if it
+    // can't be written
+    void write(const Screen<64, 32>& screen);
+
+    // how many bytes have been written so far
+    uint64_t bytes() const;
+
+private:
+    std::ofstream file;
+    std::ostream* out = nullptr;
+    VideoFormat format;
+
+    // the rows of the last frame, and how many frames have gone by since the
+    // last delta record
+    std::array<uint64_t, 32> last = {};
+    uint64_t unchanged = 0;
+
+    uint64_t written = 0;
+    std::vector<uint8_t> buffer;
+
+    // the XORs of the rows that changed, before they're run-length encoded
+    // into `buffer`
+    std::vector<uint8_t> changed;
+
+    void flush();
+};
+
+// reads frames back from a delta file written by `FrameSink`
+class FrameReader {
+public:
+    explicit FrameReader(const std::string& path);
+
+    unsigned get_frequency() const;
+
+    // the next frame's rows (as in `Screen::packed`); false once there are
+    // no more frames
+    bool next(std::array<uint64_t, 32>& rows);
+
+private:
+    std::ifstream file;
+    unsigned frequency = 0;
+    std::array<uint64_t, 32> rows = {};
+
+    // the rows as of the next record, and how many more frames are the same
+    // as `rows` before it takes effect (if there is one)
+    std::array<uint64_t, 32> changed = {};
+    uint64_t repeats = 0;
+    bool pending = false;
+
+    // scratch space for the record's XORs
+    std::vector<uint8_t> xors;
+
+    bool read_record();
+};
+
+#endif
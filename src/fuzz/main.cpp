@@ -0,0 +1,307 @@
+#include "../chip8.h"
+#include "../coverage.h"
+#include "../fingerprint.h"
+#include "../json.h"
+#include "../movie.h"
+#include "../pool.h"
+#include "../random.h"
+#include "../visited.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef EDGE_COVERAGE
+#error "the fuzzer needs coverage, so build it with -DEDGE_COVERAGE"
+#endif
+
+// throws inputs at a ROM to find its bugs: illegal instructions, stack over-
+// and underflows, reads and writes outside memory, and so on
+//
+// an input is the keys held down on each frame of a run; inputs that take an
+// edge no run has taken before are kept and mutated further, and every
+// distinct error (by its `Fault` and the address of the instruction that ran
+// into it) is saved as a movie that replays it (`chip8 <ROM> ... --replay
+// <movie>`)
+//
+// every run starts from the same in-memory save state, restored in place, so
+// a run costs about as much as the instructions it actually executes; and a
+// run that reaches a state (see `Chip8::fingerprint`) on the same frame and
+// with the same keys still to come as one before it is cut short there, since
+// the rest of it can only go the way that one did (which is most runs, as
+// most mutations change nothing the ROM was looking at)
+
+// the keys held down on each frame, one bit per key
+using Input = std::vector<uint16_t>;
+
+// where the runs have gotten to so far, shared between the workers
+struct Shared {
+    SharedCoverage coverage;
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> cut_short{0};
+
+    // NOTE: workers only touch these when they find something, which is
+    // rare enough that one lock is fine
+    std::mutex mutex;
+    std::vector<Input> corpus;
+    std::map<std::pair<Fault, uint16_t>, Input> crashes;
+};
+
+// what a single run ran into, if anything
+struct Crash {
+    Fault fault = Fault::none;
+    uint16_t pc = 0;
+};
+
+// what a worker's runs have been through so far: the state a run was in at the
+// start of every `INTERVAL`th frame, combined with the keys it was still to
+// be given from there (so two runs only match if the rest of them will go the
+// same way), and room to work out the latter in
+struct Explored {
+    // NOTE: forgotten all at once past this many, which just means going
+    // over some old ground again; it keeps a worker to about 16 MB
+    static constexpr size_t LIMIT = 1 << 20;
+
+    // NOTE: only every so many frames, since looking a state up is a cache
+    // miss or two, which costs about as much as running a frame
+    static constexpr size_t INTERVAL = 32;
+
+    Visited visited{LIMIT};
+    std::vector<uint64_t> rest;
+    uint64_t cut_short = 0;
+};
+
+// run `input` from `snapshot`, recording edges in `coverage`; true if it hit
+// an error (described in `crash`)
+//
+// NOTE: a run that's cut short (see `Explored`) has nothing new to find in
+// the rest of it: the run it matched already merged its edges and reported
+// its error, if it had one
+static bool run(Chip8& emu, const std::vector<uint8_t>& snapshot, const Input& input, const uint64_t instructions_per_frame, Coverage& coverage, Explored& explored, Crash& crash) {
+    auto& rest = explored.rest;
+
+    emu.load_state(snapshot);
+    coverage.clear();
+    rest.resize(input.size() + 1);
+    rest.back() = 0;
+
+    for (size_t frame = input.size(); frame-- > 0;) {
+        rest[frame] = rest[frame + 1] ^ word_key(Part::keys, frame, input[frame]);
+    }
+
+    // NOTE: cleared before this run could take it past the limit, so it
+    // never grows past the room it started out with
+    if (explored.visited.size() + input.size() / Explored::INTERVAL + 1 > Explored::LIMIT) {
+        explored.visited.clear();
+    }
+
+    for (size_t frame = 0; frame < input.size(); ++frame) {
+        if (frame % Explored::INTERVAL == 0 && !explored.visited.insert(emu.fingerprint() ^ rest[frame])) {
+            ++explored.cut_short;
+            return false;
+        }
+
+        for (size_t key = 0; key < emu.keys_pressed.size(); ++key) {
+            emu.keys_pressed[key] = input[frame] >> key & 1;
+        }
+
+        const auto status = emu.run<Checked>(instructions_per_frame);
+
+        if (status.fault != Fault::none) {
+            crash = {status.fault, status.pc};
+            return true;
+        }
+
+        emu.decrement_timers();
+    }
+
+    return false;
+}
+
+// change `input` a little, sometimes borrowing from `other`
+static void mutate(Input& input, const Input& other, Random& random) {
+    const size_t frames = input.size();
+    const size_t at = random.next() % frames;
+    const size_t length = 1 + random.next() % std::min<size_t>(frames - at, 32);
+    const uint16_t key = uint16_t{1} << (random.next() % 16);
+
+    switch (random.next() % 4) {
+        case 0:
+            // tap or release a key for a frame
+            input[at] ^= key;
+            break;
+        case 1:
+            // hold a key down for a while
+            for (size_t frame = at; frame < at + length; ++frame) {
+                input[frame] |= key;
+            }
+            break;
+        case 2:
+            // let go of everything for a while
+            std::fill(input.begin() + at, input.begin() + at + length, 0);
+            break;
+        case 3:
+            // splice in part of another input
+            std::copy(other.begin() + at, other.begin() + at + length, input.begin() + at);
+            break;
+    }
+}
+
+// save `input` as a movie that replays it, by running it on a machine
+// restored from `snapshot`
+static void save_movie(const std::string& filename, const std::vector<uint8_t>& snapshot, const Input& input, const uint64_t seed, const uint64_t instructions_per_frame) {
+    Chip8 emu{};
+    Movie movie{seed, instructions_per_frame};
+
+    emu.seed(seed);
+    emu.load_state(snapshot);
+
+    try {
+        for (uint64_t frame = 0; frame < input.size(); ++frame) {
+            for (size_t key = 0; key < emu.keys_pressed.size(); ++key) {
+                emu.keys_pressed[key] = input[frame] >> key & 1;
+            }
+
+            movie.record(emu);
+            movie.run_frame(emu, frame);
+        }
+    } catch (const std::exception&) {
+        // NOTE: expected, since that's what we're saving
+    }
+
+    movie.save(filename);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 6 && argc != 7) {
+        std::cerr << "usage: chip8-fuzz <ROM> <instructions per frame> <frames per run> <seconds> <output directory> [threads]";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        const std::string rom = argv[1];
+        const uint64_t instructions_per_frame = std::stoull(argv[2]);
+        const size_t frames = std::stoul(argv[3]);
+        const auto duration = std::chrono::seconds{std::stoll(argv[4])};
+        const std::string output = argv[5];
+        const size_t threads = argc == 7 ? std::stoul(argv[6]) : std::thread::hardware_concurrency();
+
+        if (instructions_per_frame == 0 || frames == 0) {
+            throw std::invalid_argument{"instructions per frame and frames per run must be positive"};
+        }
+
+        // NOTE: the seed is fixed so every run (and every saved movie)
+        // starts from exactly the same state
+        constexpr uint64_t SEED = 0;
+
+        const auto image = Chip8::read_rom(rom);
+        std::vector<uint8_t> snapshot;
+
+        {
+            Chip8 emu{};
+
+            emu.seed(SEED);
+            emu.load_image(image);
+            emu.save_state(snapshot);
+        }
+
+        Shared shared;
+        Pool pool{threads};
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + duration;
+
+        shared.corpus.push_back(Input(frames, 0));
+
+        // NOTE: workers pull in what the others have found every so often,
+        // rather than after every run (though they check the time before
+        // every run, which costs next to nothing next to one, so a worker
+        // stops within a run of the deadline rather than an interval)
+        constexpr uint64_t SYNC_INTERVAL = 1 << 12;
+
+        pool.run(pool.threads(), [&](size_t worker, size_t) {
+            Chip8 emu{};
+            auto coverage = std::make_unique<Coverage>();
+            auto explored = std::make_unique<Explored>();
+            Random random{worker + 1};
+            std::vector<Input> corpus;
+            std::set<std::pair<Fault, uint16_t>> seen;
+            Input input;
+            Crash crash;
+
+            emu.set_coverage(coverage.get());
+
+            for (uint64_t runs = SYNC_INTERVAL; runs == SYNC_INTERVAL;) {
+                {
+                    std::lock_guard lock{shared.mutex};
+
+                    corpus.insert(corpus.end(), shared.corpus.begin() + corpus.size(), shared.corpus.end());
+                }
+
+                for (runs = 0; runs < SYNC_INTERVAL && std::chrono::steady_clock::now() < deadline; ++runs) {
+                    // NOTE: assigned rather than copied, so its storage
+                    // gets reused
+                    input = corpus[random.next() % corpus.size()];
+
+                    mutate(input, corpus[random.next() % corpus.size()], random);
+
+                    const bool crashed = run(emu, snapshot, input, instructions_per_frame, *coverage, *explored, crash)
+                        && seen.emplace(crash.fault, crash.pc).second;
+                    const bool fresh = shared.coverage.merge(*coverage) > 0;
+
+                    if (!crashed && !fresh) {
+                        continue;
+                    }
+
+                    std::lock_guard lock{shared.mutex};
+
+                    if (fresh) {
+                        shared.corpus.push_back(input);
+                    }
+
+                    if (crashed) {
+                        shared.crashes.emplace(std::make_pair(crash.fault, crash.pc), input);
+                    }
+                }
+
+                shared.runs += runs;
+                shared.cut_short += std::exchange(explored->cut_short, 0);
+            }
+        });
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        size_t number = 0;
+
+        for (const auto& [key, input] : shared.crashes) {
+            const std::string movie = output + "/crash-" + std::to_string(number++) + ".c8mv";
+
+            save_movie(movie, snapshot, input, SEED, instructions_per_frame);
+
+            std::cout << "{\"error\":" << quote(message(key.first))
+                << ",\"pc\":" << key.second
+                << ",\"movie\":" << quote(movie)
+                << "}\n";
+        }
+
+        std::cerr << "chip8-fuzz: " << shared.runs << " runs in " << elapsed.count() << " s ("
+            << static_cast<uint64_t>(shared.runs / elapsed.count()) << " per second, "
+            << shared.cut_short << " cut short), "
+            << shared.coverage.count() << " edges, "
+            << shared.corpus.size() << " inputs kept, "
+            << shared.crashes.size() << " distinct errors\n";
+
+        return shared.crashes.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+        std::cerr << "chip8-fuzz: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
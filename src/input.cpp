@@ -0,0 +1,63 @@
+#include "input.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+
+KeySchedule::KeySchedule(const clock::duration period, const uint64_t cycles_per_frame)
+    : period{period}, cycles_per_frame{cycles_per_frame} {}
+
+void KeySchedule::add(const clock::time_point at, const uint8_t key, const bool down) {
+    pending.push_back({at, key, down});
+}
+
+const std::vector<KeyEvent>& KeySchedule::take(const clock::time_point due) {
+    constexpr uint64_t NOT_PRESSED = std::numeric_limits<uint64_t>::max();
+
+    const auto start = due - period;
+    const auto end = std::find_if(pending.begin(), pending.end(), [&](const Pending& input) {
+        return input.at >= due;
+    });
+
+    // the cycle each key went down at this frame, if it did
+    std::array<uint64_t, 16> pressed;
+
+    pressed.fill(NOT_PRESSED);
+    events.clear();
+
+    for (auto input = pending.begin(); input != end; ++input) {
+        const uint8_t key = input->key % pressed.size();
+        uint64_t cycle = 0;
+
+        // NOTE: anything from before the period (e.g. while we were held up
+        // catching up on frames) happens at the start of the frame
+        if (input->at > start && cycles_per_frame > 0) {
+            const double into = std::chrono::duration<double>(input->at - start) / period;
+
+            cycle = std::min(static_cast<uint64_t>(into * cycles_per_frame), cycles_per_frame - 1);
+        }
+
+        // NOTE: a release on the same cycle as its press would mean the ROM
+        // never saw the key down at all, so it's held for a cycle at least
+        if (!input->down && pressed[key] != NOT_PRESSED && cycle <= pressed[key]) {
+            cycle = pressed[key] + 1;
+        }
+
+        if (input->down) {
+            pressed[key] = cycle;
+        }
+
+        events.push_back({cycle, key, input->down});
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const KeyEvent& a, const KeyEvent& b) {
+        return a.cycle < b.cycle;
+    });
+
+    pending.erase(pending.begin(), end);
+
+    return events;
+}
+
+void KeySchedule::clear() {
+    pending.clear();
+}
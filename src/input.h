@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+#ifndef CHIP8_INPUT_H
+#define CHIP8_INPUT_H
+
+// a key on the keypad going down or up `cycle` instructions into a frame
+struct KeyEvent {
+    uint64_t cycle = 0;
+    uint8_t key = 0;
+    bool down = false;
+};
+
+// run a frame of `cycles` instructions on `chip8`, pressing and releasing
+// keys as the events from `first` to `last` (anything with a `cycle`, `key`
+// and `down`, in cycle order) say, each just before the instruction at its
+// cycle; `run` is handed how many instructions to run next (e.g. to
+// `Chip8::run_decoded`) and returns false to give up on the rest of the
+// frame, in which case so do we
+//
+// NOTE: a ROM that starts idling (see `Chip8::run`) only sits out the cycles
+// up to the next event, not the rest of the frame, so e.g. FX0A sees a press
+// at the cycle it happened at
+template <typename Iterator, typename Run>
+bool run_keyed(Chip8& chip8, const uint64_t cycles, Iterator first, const Iterator last, Run&& run) {
+    uint64_t at = 0;
+
+    for (; first != last; ++first) {
+        const auto& event = *first;
+        const uint64_t until = std::min<uint64_t>(event.cycle, cycles);
+
+        if (until > at) {
+            if (!run(until - at)) {
+                return false;
+            }
+
+            at = until;
+        }
+
+        chip8.keys_pressed[event.key % chip8.keys_pressed.size()] = event.down;
+    }
+
+    return at == cycles || run(cycles - at);
+}
+
+// turns presses and releases stamped with when they happened into
+// `KeyEvent`s at the cycles they'd have happened at, for frames of
+// `cycles_per_frame` instructions that each come due `period` after the last
+//
+// everything that happens before a frame comes due goes into that frame, as
+// far into it as it was into the period before it came due; so inputs land
+// one frame late, but always exactly one frame late, and however close
+// together two of them are (e.g. a tap shorter than a frame), the ROM sees
+// both, in order
+class KeySchedule {
+public:
+    using clock = std::chrono::steady_clock;
+
+    KeySchedule(const clock::duration period, const uint64_t cycles_per_frame);
+
+    // `key` went down (or up) at `at`; these have to come in the order they
+    // happened
+    void add(const clock::time_point at, const uint8_t key, const bool down);
+
+    // the events for the frame that came due at `due`, in cycle order; only
+    // good until the next call
+    const std::vector<KeyEvent>& take(const clock::time_point due);
+
+    // forget everything that hasn't been taken yet
+    void clear();
+
+private:
+    struct Pending {
+        clock::time_point at{};
+        uint8_t key = 0;
+        bool down = false;
+    };
+
+    clock::duration period;
+    uint64_t cycles_per_frame;
+
+    // NOTE: in the order they happened, which is also the order they get
+    // taken in
+    std::vector<Pending> pending;
+    std::vector<KeyEvent> events;
+};
+
+#endif
@@ -0,0 +1,898 @@
+#include "jit.h"
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define JIT_SUPPORTED
+#include <atomic>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+constexpr size_t CODE_SIZE = 1 << 20;
+
+// enough room for the longest translated instruction (a return, plus the code
+// that backs out of it if the stack's empty)
+constexpr size_t MAX_INSTRUCTION_SIZE = 80;
+
+// don't let a single block run on forever (also bounds how far past the
+// cycle budget we'd have to fall back to the interpreter, and how far back a
+// write has to look for the blocks it lands in)
+constexpr uint16_t MAX_BLOCK_LENGTH = 64;
+
+// the most bytes before its start a block can also be translated from (see
+// `Block::behind`)
+constexpr uint16_t MAX_BEHIND = 4;
+
+// where `V0`-`VF` live while translated code runs: `V0`-`V7` and `VF` (which
+// nearly every ROM leans on hardest) get a host register each, and the rest
+// stay in `registers`, through rdi
+//
+// NOTE: rax and rcx are scratch, r8 holds `index`, r9 the cycle budget and
+// r10 `entries`, which leaves exactly nine
+constexpr uint8_t SPILLED = 0xFF;
+constexpr std::array<uint8_t, 16> PINNED = {
+    2, 3, 5, 6, 11, 12, 13, 14,  // rdx, rbx, rbp, rsi, r11-r14
+    SPILLED, SPILLED, SPILLED, SPILLED, SPILLED, SPILLED, SPILLED,
+    15  // r15
+};
+
+// the scratch registers, as the reg operand of an instruction
+constexpr uint8_t AL = 0;
+constexpr uint8_t CL = 1;
+
+// condition codes, as in jcc, setcc and cmovcc
+constexpr uint8_t BELOW = 0x2;
+constexpr uint8_t ABOVE_OR_EQUAL = 0x3;
+constexpr uint8_t EQUAL = 0x4;
+constexpr uint8_t NOT_EQUAL = 0x5;
+constexpr uint8_t NOT_SIGN = 0x9;
+constexpr uint8_t ZERO = EQUAL;
+
+Jit::Jit(Chip8& chip8) : chip8{chip8} {
+    const auto offset = [&](const void* member) {
+        return static_cast<int32_t>(
+            reinterpret_cast<intptr_t>(member) - reinterpret_cast<intptr_t>(chip8.registers.data()));
+    };
+
+    pc_offset = offset(&chip8.pc);
+    idle_offset = offset(&chip8.idle);
+    index_offset = offset(&chip8.index);
+    delay_timer_offset = offset(&chip8.delay_timer);
+    sound_timer_offset = offset(&chip8.sound_timer);
+    keys_offset = offset(chip8.keys_pressed.data());
+    stack_offset = offset(chip8.stack.stack.data());
+    stack_pointer_offset = offset(&chip8.stack.stack_pointer);
+
+    #ifdef JIT_SUPPORTED
+    // NOTE: the same memory gets mapped twice, so there's nowhere it's both
+    // writable and executable, without having to `mprotect` it back and forth
+    // every time something's translated
+    #ifdef __linux__
+    const int fd = memfd_create("chip8-jit", 0);
+    #else
+    static std::atomic<uint32_t> created{0};
+    const std::string name = "/chip8-jit-" + std::to_string(getpid()) + "-" + std::to_string(created++);
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd != -1) {
+        shm_unlink(name.c_str());
+    }
+    #endif
+
+    if (fd == -1 || ftruncate(fd, CODE_SIZE) != 0) {
+        if (fd != -1) {
+            close(fd);
+        }
+
+        throw std::runtime_error{"error mapping memory for translated code"};
+    }
+
+    void* for_writing = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* for_running = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (for_writing == MAP_FAILED || for_running == MAP_FAILED) {
+        if (for_writing != MAP_FAILED) {
+            munmap(for_writing, CODE_SIZE);
+        }
+
+        if (for_running != MAP_FAILED) {
+            munmap(for_running, CODE_SIZE);
+        }
+
+        throw std::runtime_error{"error mapping memory for translated code"};
+    }
+
+    code = static_cast<uint8_t*>(for_writing);
+    executable = static_cast<const uint8_t*>(for_running);
+    translate_prologue();
+    #endif
+
+    entries.fill(exit);
+}
+
+Jit::~Jit() {
+    #ifdef JIT_SUPPORTED
+    munmap(code, CODE_SIZE);
+    munmap(const_cast<uint8_t*>(executable), CODE_SIZE);
+    #endif
+}
+
+// NOTE: just like `Chip8::run_decoded`, this stops early if the ROM starts
+// idling, and returns how many cycles actually ran
+uint64_t Jit::run(const uint64_t cycles) {
+    uint64_t executed = 0;
+
+    // cycles the interpreter has already elided itself, since it stopped to
+    // idle partway through instructions we handed it
+    uint64_t elided = 0;
+
+    // NOTE: what some instructions translate to depends on the profile, so
+    // changing it throws away everything translated so far
+    if (chip8.profile != profile) {
+        flush();
+        profile = chip8.profile;
+        with_quirks(profile, [&](auto quirks) {
+            reset_vf = decltype(quirks)::RESET_VF;
+            shift_vy = decltype(quirks)::SHIFT_VY;
+        });
+    }
+
+    chip8.idle = false;
+    chip8.fault = Fault::none;
+
+    while (executed < cycles && !chip8.idle) {
+        sync();
+
+        const uint16_t pc = chip8.pc;
+        const uint64_t budget = cycles - executed;
+
+        // NOTE: let the interpreter deal with (i.e. throw on) a runaway `pc`
+        if (pc >= blocks.size()) {
+            executed += chip8.run_decoded(1);
+            continue;
+        }
+
+        const Block& block = blocks[pc].translated ? blocks[pc] : translate(pc);
+
+        // NOTE: translated code carries on from block to block until it runs
+        // out of budget or reaches something it has to hand back to us
+        if (block.entry && block.length <= budget) {
+            uint64_t left = budget;
+
+            chip8.pc = enter(chip8.registers.data(), &left, entries.data(), block.entry);
+            executed += budget - left;
+
+            // NOTE: the interpreter hands a fault back (see `interpret`), since
+            // it can't throw through translated code
+            if (chip8.fault != Fault::none) {
+                Chip8::raise(chip8.fault);
+            }
+
+            // NOTE: translated code backs out of an instruction that's about
+            // to fault, so if it couldn't even get past the first one, the
+            // interpreter has to run (i.e. throw on) it
+            if (left == budget) {
+                executed += chip8.run_decoded(1);
+            }
+
+            continue;
+        }
+
+        // NOTE: blocks only run as a whole, so the tail end of the budget gets
+        // interpreted to land on exactly `cycles`
+        const uint64_t count = block.entry ? budget : std::min<uint64_t>(block.length, budget);
+        const uint64_t ran = chip8.run_decoded(count);
+
+        executed += ran;
+        elided += chip8.idle ? count - ran : 0;
+    }
+
+    chip8.elided_cycles += cycles - executed - elided;
+
+    return executed;
+}
+
+// whether `instruction` is one translated code hands to the interpreter (see
+// `interpret`) rather than backing out to `run` for
+//
+// NOTE: none of these branch or idle, so a run of them carries on right after
+// its last one (unless it faults, or writes over itself)
+bool Jit::interpretable(const uint16_t instruction) {
+    switch (instruction >> 12) {
+        case 0x0: return instruction == 0x00E0;
+        case 0xC: return true;
+        case 0xD: return true;
+        case 0xF: return (instruction & 0xFF) == 0x33
+            || (instruction & 0xFF) == 0x55
+            || (instruction & 0xFF) == 0x65;
+        default: return false;
+    }
+}
+
+// run the `count` instructions at `address` for translated code; -1 if it can
+// carry on after them, otherwise how many of them ran before it has to back
+// out, because one faulted (which `run` then throws) or something translated
+// was written over
+//
+// NOTE: this is called from translated code, so it mustn't throw; it's also
+// called often enough that it dispatches straight to the handlers `translate`
+// looked up, rather than going through `Chip8::run`
+int32_t Jit::interpret(Jit& jit, const uint16_t address, const uint16_t count) noexcept {
+    Chip8& chip8 = jit.chip8;
+
+    for (uint16_t i = 0; i < count; ++i) {
+        const Chip8::Decoded& current = jit.interpreted[address + 2 * i];
+
+        chip8.operands = current.operands;
+        chip8.pc = address + 2 * (i + 1);
+        current.handler(chip8);
+
+        if (chip8.fault != Fault::none) {
+            return i;
+        }
+
+        if (chip8.overwritten) {
+            return i + 1;
+        }
+    }
+
+    return -1;
+}
+
+// drop every block that was translated from memory that's since been written
+// (see `Chip8::watched`)
+void Jit::sync() {
+    if (!chip8.overwritten) {
+        return;
+    }
+
+    chip8.overwritten = false;
+
+    for (size_t page = 0; page < watched.size(); ++page) {
+        const auto written = watched[page] & ~chip8.watched[page];
+
+        if (written.none()) {
+            continue;
+        }
+
+        for (size_t byte = 0; byte < PAGE_BYTES; ++byte) {
+            if (written.test(byte)) {
+                drop(page * PAGE_BYTES + byte);
+            }
+        }
+
+        watched[page] = chip8.watched[page];
+    }
+}
+
+// throw away every block that was translated from the byte at `address`
+void Jit::drop(const uint16_t address) {
+    const uint16_t first = address >= 2 * MAX_BLOCK_LENGTH ? address - 2 * MAX_BLOCK_LENGTH + 1 : 0;
+    const uint16_t last = std::min<size_t>(address + MAX_BEHIND, blocks.size() - 1);
+
+    for (uint16_t start = first; start <= last; ++start) {
+        Block& block = blocks[start];
+
+        if (block.translated
+            && address + block.behind >= start
+            && address < start + 2 * block.length) {
+            block = {};
+            entries[start] = exit;
+        }
+    }
+}
+
+Jit::Block& Jit::translate(const uint16_t address) {
+    if (code_used + MAX_BLOCK_LENGTH * MAX_INSTRUCTION_SIZE > CODE_SIZE) {
+        flush();
+    }
+
+    Block& block = blocks[address];
+    uint16_t length = 0;
+
+    behind = 0;
+
+    #ifdef JIT_SUPPORTED
+    const size_t start = code_used;
+    const auto fetch = [&](const uint16_t at) {
+        return static_cast<uint16_t>(chip8.memory[at] << 8 | chip8.memory[at + 1]);
+    };
+
+    // sub r9, length; jb <back out> (the block's length gets filled in once
+    // we know it)
+    //
+    // NOTE: this is the only check of the budget, so a block that starts runs
+    // to its end
+    emit({0x49, 0x83, 0xE9, 0x00});
+    const size_t subtracted = code_used - 1;
+    emit_bail(BELOW, address);
+
+    uint16_t at = address;
+    bool ended = false;
+
+    for (; length < MAX_BLOCK_LENGTH && at < chip8.memory.size() - 1; at += 2) {
+        const uint16_t instruction = fetch(at);
+
+        if (translate_instruction(instruction)) {
+            ++length;
+            continue;
+        }
+
+        // NOTE: a whole run of these gets handed to the interpreter at once
+        if (interpretable(instruction)) {
+            uint16_t count = 1;
+
+            while (length + count < MAX_BLOCK_LENGTH
+                && at + 2u * count < chip8.memory.size() - 1
+                && interpretable(fetch(at + 2 * count))) {
+                ++count;
+            }
+
+            for (uint16_t i = 0; i < count; ++i) {
+                const uint16_t handed = fetch(at + 2 * i);
+
+                interpreted[at + 2 * i] = {chip8.handler(handed), Chip8::unpack(handed)};
+            }
+
+            emit_interpret(at, count);
+            length += count;
+            at += 2 * (count - 1);
+            continue;
+        }
+
+        if (translate_branch(instruction, at, address)) {
+            ++length;
+            ended = true;
+        }
+
+        break;
+    }
+
+    if (!ended) {
+        emit_continue(at);
+    }
+
+    if (length > 0) {
+        code[subtracted] = length;
+
+        for (const Bail& bail : bails) {
+            const int32_t distance = code_used - (bail.jump + 4);
+
+            std::copy_n(reinterpret_cast<const uint8_t*>(&distance), 4, code + bail.jump);
+            emit_back_out(bail, address, length);
+        }
+
+        block.entry = executable + start;
+        entries[address] = block.entry;
+    } else {
+        // NOTE: there's no telling whether an instruction translates without
+        // trying, so each one is translated and thrown away again, up to the
+        // next that would start a block of its own
+        for (at = address; length < MAX_BLOCK_LENGTH && at < chip8.memory.size() - 1; at += 2) {
+            code_used = start;
+            bails.clear();
+
+            const uint16_t instruction = fetch(at);
+
+            if (length > 0
+                && (translate_instruction(instruction)
+                    || interpretable(instruction)
+                    || translate_branch(instruction, at, at))) {
+                break;
+            }
+
+            ++length;
+        }
+
+        code_used = start;
+        behind = 0;
+    }
+
+    bails.clear();
+    #endif
+
+    // NOTE: an instruction that hangs off the end of memory can't be
+    // translated, but it still has to be handed to the interpreter
+    length = std::max<uint16_t>(length, 1);
+
+    for (size_t byte = address - behind; byte < std::min<size_t>(address + 2 * length, chip8.memory.size()); ++byte) {
+        watched[byte / PAGE_BYTES].set(byte % PAGE_BYTES);
+        chip8.watched[byte / PAGE_BYTES].set(byte % PAGE_BYTES);
+    }
+
+    block.length = length;
+    block.behind = behind;
+    block.translated = true;
+
+    return block;
+}
+
+// emit the code for a single straight-line instruction; false if it ends the
+// block
+//
+// NOTE: these deliberately mirror the interpreter's order of reads and writes
+// (e.g. `VF` is written before `VX`), so aliasing `VF` behaves the same
+bool Jit::translate_instruction(const uint16_t instruction) {
+    const uint8_t x = (instruction & 0x0F00) >> 8;
+    const uint8_t y = (instruction & 0x00F0) >> 4;
+    const uint8_t n = instruction & 0x000F;
+    const uint8_t nn = instruction & 0x00FF;
+    const uint16_t nnn = instruction & 0x0FFF;
+
+    switch (instruction >> 12) {
+        // 6XNN: mov VX, NN
+        case 0x6:
+            emit_v({0xC6}, 0, x);
+            emit({nn});
+            return true;
+        // 7XNN: add VX, NN
+        case 0x7:
+            emit_v({0x80}, 0, x);
+            emit({nn});
+            return true;
+        case 0x8:
+            switch (n) {
+                // 8XY0: mov al, VY; mov VX, al
+                case 0x0:
+                    emit_v({0x8A}, AL, y);
+                    emit_v({0x88}, AL, x);
+                    return true;
+                // 8XY1/8XY2/8XY3: mov al, VY; or/and/xor VX, al
+                // (then mov VF, 0 if `RESET_VF`)
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    emit_v({0x8A}, AL, y);
+                    emit_v({static_cast<uint8_t>(n == 0x1 ? 0x08 : n == 0x2 ? 0x20 : 0x30)}, AL, x);
+
+                    if (reset_vf) {
+                        emit_v({0xC6}, 0, 0xF);
+                        emit({0x00});
+                    }
+
+                    return true;
+                // 8XY4: mov al, VX; add al, VY; setc cl; mov VF, cl; mov VX, al
+                case 0x4:
+                    emit_v({0x8A}, AL, x);
+                    emit_v({0x02}, AL, y);
+                    emit({0x0F, 0x92, 0xC1});
+                    emit_v({0x88}, CL, 0xF);
+                    emit_v({0x88}, AL, x);
+                    return true;
+                // 8XY5: mov al, VX; cmp al, VY; seta cl; mov VF, cl;
+                // mov al, VX; sub al, VY; mov VX, al
+                // 8XY7: the same, with `VX` and `VY` swapped (other than
+                // where the result goes)
+                case 0x5:
+                case 0x7: {
+                    const uint8_t minuend = n == 0x5 ? x : y;
+                    const uint8_t subtrahend = n == 0x5 ? y : x;
+
+                    emit_v({0x8A}, AL, minuend);
+                    emit_v({0x3A}, AL, subtrahend);
+                    emit({0x0F, 0x97, 0xC1});
+                    emit_v({0x88}, CL, 0xF);
+                    emit_v({0x8A}, AL, minuend);
+                    emit_v({0x2A}, AL, subtrahend);
+                    emit_v({0x88}, AL, x);
+                    return true;
+                }
+                // 8XY6/8XYE (shifting `VY` if `SHIFT_VY`, otherwise `VX`):
+                // mov al, VX/VY; shr al, 1 (or add al, al); setc cl;
+                // mov VF, cl; mov VX, al
+                case 0x6:
+                case 0xE:
+                    emit_v({0x8A}, AL, shift_vy ? y : x);
+                    emit({static_cast<uint8_t>(n == 0x6 ? 0xD0 : 0x00), static_cast<uint8_t>(n == 0x6 ? 0xE8 : 0xC0)});
+                    emit({0x0F, 0x92, 0xC1});
+                    emit_v({0x88}, CL, 0xF);
+                    emit_v({0x88}, AL, x);
+                    return true;
+                default: return false;
+            }
+        // ANNN: mov r8d, NNN
+        case 0xA:
+            emit({0x41, 0xB8});
+            emit_le(nnn, 4);
+            return true;
+        case 0xF:
+            switch (nn) {
+                // FX07: mov al, [delay_timer]; mov VX, al
+                case 0x07:
+                    emit_member({0x8A}, AL, delay_timer_offset);
+                    emit_v({0x88}, AL, x);
+                    return true;
+                // FX15/FX18: mov al, VX; mov [delay_timer/sound_timer], al
+                case 0x15:
+                case 0x18:
+                    emit_v({0x8A}, AL, x);
+                    emit_member({0x88}, AL, nn == 0x15 ? delay_timer_offset : sound_timer_offset);
+                    return true;
+                // FX1E: movzx eax, VX; add r8w, ax
+                case 0x1E:
+                    emit_v({0x0F, 0xB6}, AL, x);
+                    emit({0x66, 0x41, 0x01, 0xC0});
+                    return true;
+                // FX29: movzx eax, VX; lea r8d, [rax + rax * 4 + FONT_ADDRESS]
+                case 0x29:
+                    static_assert(FONT_STRIDE == 5 && FONT_ADDRESS < 0x80);
+                    emit_v({0x0F, 0xB6}, AL, x);
+                    emit({0x44, 0x8D, 0x44, 0x80, FONT_ADDRESS});
+                    return true;
+                default: return false;
+            }
+        default: return false;
+    }
+}
+
+// emit the code for an instruction that ends a block (which starts at
+// `start`) by choosing where to go next, and going there; false if the
+// interpreter has to run it
+bool Jit::translate_branch(const uint16_t instruction, const uint16_t address, const uint16_t start) {
+    const uint8_t x = (instruction & 0x0F00) >> 8;
+    const uint8_t y = (instruction & 0x00F0) >> 4;
+    const uint8_t n = instruction & 0x000F;
+    const uint8_t nn = instruction & 0x00FF;
+    const uint16_t nnn = instruction & 0x0FFF;
+
+    // the addresses we'd end up at if a skip isn't/is taken
+    const uint16_t next = address + 2;
+    const uint16_t skipped = address + 4;
+
+    // which way the comparison has to come out for a skip to be taken
+    uint8_t skip = EQUAL;
+
+    // NOTE: a skip off the end of memory has no block to carry on at, so
+    // anything that close to the end is left to the interpreter
+    if (skipped >= blocks.size()) {
+        return false;
+    }
+
+    switch (instruction >> 12) {
+        // 00EE: mov rax, [stack_pointer]; test rax, rax; jz <back out>;
+        // dec rax; mov [stack_pointer], rax; movzx eax, word [stack + rax * 2];
+        // cmp eax, 0xFFF; ja exit; jmp [r10 + rax * 8]
+        case 0x0:
+            if (instruction != 0x00EE) {
+                return false;
+            }
+
+            emit_member({0x48, 0x8B}, AL, stack_pointer_offset);
+            emit({0x48, 0x85, 0xC0});
+            emit_bail(ZERO, address);
+            emit({0x48, 0xFF, 0xC8});
+            emit_member({0x48, 0x89}, AL, stack_pointer_offset);
+            emit({0x0F, 0xB7, 0x84, 0x47});
+            emit_le(stack_offset, 4);
+            emit({0x3D});
+            emit_le(blocks.size() - 1, 4);
+            emit({0x0F, 0x87});
+            emit_rel(exit);
+            emit({0x41, 0xFF, 0x24, 0xC2});
+            return true;
+        // 1NNN (see `emit_continue`)
+        //
+        // NOTE: jumps that idle (see `Chip8::jump`) set `idle` just like the
+        // interpreter's do, so `run` stops for them
+        case 0x1:
+            // to itself: mov byte [idle], 1; mov eax, nnn; jmp exit
+            if (nnn == address) {
+                emit_member({0xC6}, 0, idle_offset);
+                emit({0x01, 0xB8});
+                emit_le(nnn, 4);
+                emit({0xE9});
+                emit_rel(exit);
+                return true;
+            }
+
+            // back to `FX07; 3X00`: cmp byte [delay_timer], 0;
+            // setne byte [idle]; mov eax, nnn; jne exit; jmp [r10 + rax * 8]
+            //
+            // NOTE: whether this idles depends on the instructions it jumps
+            // back to (see `Chip8::jump`), which (since the skip ends a
+            // block) are usually just before this one
+            if (nnn == static_cast<uint16_t>(address - 4)) {
+                behind = nnn < start ? start - nnn : 0;
+
+                const bool delay_loop = (chip8.memory[nnn] & 0xF0) == 0xF0
+                    && chip8.memory[nnn + 1] == 0x07
+                    && chip8.memory[nnn + 2] == (0x30 | (chip8.memory[nnn] & 0x0F))
+                    && chip8.memory[nnn + 3] == 0x00;
+
+                if (delay_loop) {
+                    emit_member({0x80}, 7, delay_timer_offset);
+                    emit({0x00});
+                    emit_member({0x0F, 0x95}, 0, idle_offset);
+                    emit({0xB8});
+                    emit_le(nnn, 4);
+                    emit({0x0F, 0x80 | NOT_EQUAL});
+                    emit_rel(exit);
+                    emit({0x41, 0xFF, 0x24, 0xC2});
+                    return true;
+                }
+            }
+
+            emit_continue(nnn);
+            return true;
+        // 2NNN: mov rax, [stack_pointer]; cmp rax, 16; jae <back out>;
+        // mov word [stack + rax * 2], next; inc qword [stack_pointer]
+        case 0x2:
+            emit_member({0x48, 0x8B}, AL, stack_pointer_offset);
+            emit({0x48, 0x83, 0xF8, static_cast<uint8_t>(chip8.stack.stack.size())});
+            emit_bail(ABOVE_OR_EQUAL, address);
+            emit({0x66, 0xC7, 0x84, 0x47});
+            emit_le(stack_offset, 4);
+            emit_le(next, 2);
+            emit_member({0x48, 0xFF}, 0, stack_pointer_offset);
+            emit_continue(nnn);
+            return true;
+        // 3XNN/4XNN: cmp VX, NN
+        case 0x3:
+        case 0x4:
+            emit_v({0x80}, 7, x);
+            emit({nn});
+            skip = instruction >> 12 == 0x3 ? EQUAL : NOT_EQUAL;
+            break;
+        // 5XY0/9XY0: mov al, VX; cmp al, VY
+        case 0x5:
+        case 0x9:
+            if (n != 0) {
+                return false;
+            }
+
+            emit_v({0x8A}, AL, x);
+            emit_v({0x3A}, AL, y);
+            skip = instruction >> 12 == 0x5 ? EQUAL : NOT_EQUAL;
+            break;
+        // EX9E/EXA1: movzx eax, VX; cmp eax, 16; jae <back out>;
+        // cmp byte [keys_pressed + rax], 0
+        case 0xE:
+            if (nn != 0x9E && nn != 0xA1) {
+                return false;
+            }
+
+            emit_v({0x0F, 0xB6}, AL, x);
+            emit({0x83, 0xF8, static_cast<uint8_t>(chip8.keys_pressed.size())});
+            emit_bail(ABOVE_OR_EQUAL, address);
+            emit({0x80, 0xBC, 0x07});
+            emit_le(keys_offset, 4);
+            emit({0x00});
+            skip = nn == 0x9E ? NOT_EQUAL : EQUAL;
+            break;
+        default: return false;
+    }
+
+    // mov eax, next; mov ecx, skipped; cmovcc eax, ecx; jmp [r10 + rax * 8]
+    // NOTE: `mov` leaves the flags from the comparison alone
+    emit({0xB8});
+    emit_le(next, 4);
+    emit({0xB9});
+    emit_le(skipped, 4);
+    emit({0x0F, static_cast<uint8_t>(0x40 | skip), 0xC1});
+    emit({0x41, 0xFF, 0x24, 0xC2});
+
+    return true;
+}
+
+// emit the code `enter` points to, which loads everything translated code
+// keeps in host registers and jumps to a block, along with `exit`, which
+// stores it all again and returns whatever `pc` it was given in eax, and
+// `call_interpret`, which calls `interpret` (with the address and count in
+// eax and ecx) from the middle of a block and returns what it did
+void Jit::translate_prologue() {
+    // push rbx; push rbp; push r12; push r13; push r14; push r15; push rsi
+    emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x56});
+    // mov r9, [rsi]; mov r10, rdx; movzx r8d, word [index]
+    emit({0x4C, 0x8B, 0x0E, 0x49, 0x89, 0xD2});
+    emit_member({0x0F, 0xB7}, 8, index_offset);
+
+    // movzx <host register>, byte [registers + X]
+    for (uint8_t x = 0; x < PINNED.size(); ++x) {
+        if (PINNED[x] != SPILLED) {
+            emit_member({0x0F, 0xB6}, PINNED[x], x);
+        }
+    }
+
+    // jmp rcx
+    emit({0xFF, 0xE1});
+
+    exit = executable + code_used;
+
+    // mov byte [registers + X], <host register>
+    for (uint8_t x = 0; x < PINNED.size(); ++x) {
+        if (PINNED[x] != SPILLED) {
+            emit_member({0x88}, PINNED[x], x);
+        }
+    }
+
+    // mov [index], r8w; pop rsi; mov [rsi], r9
+    emit({0x66});
+    emit_member({0x89}, 8, index_offset);
+    emit({0x5E, 0x4C, 0x89, 0x0E});
+    // pop r15; pop r14; pop r13; pop r12; pop rbp; pop rbx; ret
+    emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});
+
+    call_interpret = executable + code_used;
+
+    // store everything the call to `interpret` could clobber or read, the same
+    // as `exit` does
+    for (uint8_t x = 0; x < PINNED.size(); ++x) {
+        if (PINNED[x] != SPILLED) {
+            emit_member({0x88}, PINNED[x], x);
+        }
+    }
+
+    // mov [index], r8w; push rdi; push r9; push r10; mov esi, eax;
+    // mov edx, ecx
+    //
+    // NOTE: along with the return address, the pushes keep the stack aligned
+    // for the call
+    emit({0x66});
+    emit_member({0x89}, 8, index_offset);
+    emit({0x57, 0x41, 0x51, 0x41, 0x52, 0x89, 0xC6, 0x89, 0xCA});
+    // mov rdi, this; mov rax, &interpret; call rax
+    emit({0x48, 0xBF});
+    emit_le(reinterpret_cast<uintptr_t>(this), 8);
+    emit({0x48, 0xB8});
+    emit_le(reinterpret_cast<uintptr_t>(&interpret), 8);
+    emit({0xFF, 0xD0});
+    // pop r10; pop r9; pop rdi; movzx r8d, word [index]
+    emit({0x41, 0x5A, 0x41, 0x59, 0x5F});
+    emit_member({0x0F, 0xB7}, 8, index_offset);
+
+    // movzx <host register>, byte [registers + X], without touching eax
+    for (uint8_t x = 0; x < PINNED.size(); ++x) {
+        if (PINNED[x] != SPILLED) {
+            emit_member({0x0F, 0xB6}, PINNED[x], x);
+        }
+    }
+
+    // ret
+    emit({0xC3});
+
+    enter = reinterpret_cast<Enter>(executable);
+    prologue_size = code_used;
+}
+
+// emit a byte-sized instruction whose r/m operand is `VX`, wherever that
+// lives, and whose reg operand is `reg` (a register, or the extension of an
+// opcode that has one)
+//
+// NOTE: there's always a REX prefix, so 4-7 mean spl, bpl, sil and dil rather
+// than ah, ch, dh and bh
+void Jit::emit_v(std::initializer_list<uint8_t> opcode, const uint8_t reg, const uint8_t x) {
+    const uint8_t host = PINNED[x];
+    const bool pinned = host != SPILLED;
+
+    emit({static_cast<uint8_t>(0x40 | (reg & 0x8) >> 1 | (pinned ? (host & 0x8) >> 3 : 0))});
+    emit(opcode);
+
+    if (pinned) {
+        emit({static_cast<uint8_t>(0xC0 | (reg & 0x7) << 3 | (host & 0x7))});
+    } else {
+        emit({static_cast<uint8_t>(0x47 | (reg & 0x7) << 3), x});
+    }
+}
+
+// emit an instruction whose r/m operand is the member of `chip8` at `offset`
+// from `registers`, and whose reg operand is `reg`
+//
+// NOTE: the same goes for the REX prefix as in `emit_v` (and `opcode` can
+// start with one of its own, e.g. for REX.W, which is merged into it)
+void Jit::emit_member(std::initializer_list<uint8_t> opcode, const uint8_t reg, const int32_t offset) {
+    const uint8_t* first = opcode.begin();
+    uint8_t rex = 0x40 | (reg & 0x8) >> 1;
+
+    if ((*first & 0xF0) == 0x40) {
+        rex |= *first++;
+    }
+
+    emit({rex});
+
+    for (; first != opcode.end(); ++first) {
+        emit({*first});
+    }
+
+    emit({static_cast<uint8_t>(0x87 | (reg & 0x7) << 3)});
+    emit_le(offset, 4);
+}
+
+// emit the code to carry on at `address`: mov eax, address;
+// jmp [r10 + rax * 8] (or jmp exit, if it's off the end of memory)
+void Jit::emit_continue(const uint16_t address) {
+    emit({0xB8});
+    emit_le(address, 4);
+
+    if (address < entries.size()) {
+        emit({0x41, 0xFF, 0x24, 0xC2});
+    } else {
+        emit({0xE9});
+        emit_rel(exit);
+    }
+}
+
+// emit a jump (if `condition` holds) to code that backs out of the block at
+// the instruction at `address` (or, if `interpreted`, wherever the interpreter
+// stopped), and leaves the rest to `run`; the code itself goes after the end
+// of the block (see `translate` and `emit_back_out`)
+void Jit::emit_bail(const uint8_t condition, const uint16_t address, const bool interpreted) {
+    emit({0x0F, static_cast<uint8_t>(0x80 | condition)});
+    bails.push_back({code_used, address, interpreted});
+    emit_le(0, 4);
+}
+
+// emit the code `bail` jumps to, for the block of `length` instructions at
+// `address`, which gives back the budget of every instruction it skips and
+// exits with the `pc` to carry on at
+void Jit::emit_back_out(const Bail& bail, const uint16_t address, const uint16_t length) {
+    // add r9, length - (bail.address - address) / 2
+    emit({0x49, 0x83, 0xC1, static_cast<uint8_t>(length - (bail.address - address) / 2)});
+
+    if (bail.interpreted) {
+        // mov eax, eax; sub r9, rax (however many `interpret` ran); movzx
+        // eax, word [pc] (which it left just past the last of them)
+        //
+        // NOTE: `interpret` returns an `int32_t`, so the upper half of rax
+        // is whatever the callee left there; it's zero-extended first, which
+        // is enough since we only get here when eax isn't negative
+        emit({0x89, 0xC0});
+        emit({0x49, 0x29, 0xC1});
+        emit_member({0x0F, 0xB7}, AL, pc_offset);
+    } else {
+        // mov eax, bail.address
+        emit({0xB8});
+        emit_le(bail.address, 4);
+    }
+
+    emit({0xE9});
+    emit_rel(exit);
+}
+
+// emit the code to hand the `count` instructions at `address` to the
+// interpreter (see `interpret`): mov eax, address; mov ecx, count;
+// call <call_interpret>; test eax, eax; jns <back out>
+void Jit::emit_interpret(const uint16_t address, const uint16_t count) {
+    emit({0xB8});
+    emit_le(address, 4);
+    emit({0xB9});
+    emit_le(count, 4);
+    emit({0xE8});
+    emit_rel(call_interpret);
+    emit({0x85, 0xC0});
+    emit_bail(NOT_SIGN, address, true);
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes) {
+    std::copy(bytes.begin(), bytes.end(), code + code_used);
+    code_used += bytes.size();
+}
+
+// emit the rel32 operand of a jump or call to `target`
+void Jit::emit_rel(const uint8_t* target) {
+    emit_le(target - (executable + code_used + 4), 4);
+}
+
+// emit the lowest `size` bytes of `value`, little-endian
+void Jit::emit_le(const uint64_t value, const size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        code[code_used++] = value >> (i * 8);
+    }
+}
+
+void Jit::flush() {
+    std::fill(blocks.begin(), blocks.end(), Block{});
+    entries.fill(exit);
+
+    for (size_t page = 0; page < watched.size(); ++page) {
+        chip8.watched[page] &= ~watched[page];
+        watched[page].reset();
+    }
+
+    code_used = prologue_size;
+}
@@ -0,0 +1,127 @@
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+#include "chip8.h"
+
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+// translates straight-line runs of instructions (plus the jump, call, return
+// or skip that ends them) into native x86-64 code, which jumps straight from
+// one block to the next without coming back here; runs of instructions that
+// can't be translated (draws, random numbers, memory stores, ...) are handed
+// to the interpreter from inside the block, and anything else it can't
+// translate sends it back to `run`, so on other architectures this is just a
+// slower way of calling `Chip8::run_decoded`
+class Jit {
+public:
+    explicit Jit(Chip8& chip8);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // same as calling `run_decoded` on the underlying `Chip8`
+    uint64_t run(const uint64_t cycles);
+
+private:
+    // takes `registers`, the cycle budget (which is written back with however
+    // much of it is left), `entries` and the block to start at in the System V
+    // argument registers (rdi, rsi, rdx and rcx), and returns the new `pc`
+    using Enter = uint16_t (*)(uint8_t*, uint64_t*, const uint8_t* const*, const uint8_t*);
+
+    // the instructions starting at some address, either translated or (if the
+    // first of them can't be) to be handed to the interpreter in one go
+    struct Block {
+        const uint8_t* entry = nullptr;
+        uint16_t length = 0;
+        bool translated = false;
+
+        // how many bytes just before its address it was translated from too
+        // (see `translate_branch`)
+        uint8_t behind = 0;
+    };
+
+    Chip8& chip8;
+    std::array<Block, 4096> blocks = {};
+
+    // where translated code jumps to carry on at an address: the block there,
+    // or `exit` (back to `run`) if there isn't one yet
+    std::array<const uint8_t*, 4096> entries = {};
+
+    // how to run each instruction translated code hands to the interpreter
+    // (see `interpret`)
+    std::array<Chip8::Decoded, 4096> interpreted{};
+
+    // the bytes of memory some block was translated from, as we last asked
+    // the machine to watch them (see `Chip8::watched`)
+    std::array<std::bitset<PAGE_BYTES>, 4096 / PAGE_BYTES> watched{};
+
+    // the profile everything in `blocks` was translated for, and the quirks
+    // it has that change what we translate
+    Profile profile = Profile::modern;
+    bool reset_vf = false;
+    bool shift_vy = false;
+
+    // the code buffer, as we write to it and as it's run (the same memory,
+    // mapped twice, so it's never writable and executable at once)
+    uint8_t* code = nullptr;
+    const uint8_t* executable = nullptr;
+    size_t code_used = 0;
+    size_t prologue_size = 0;
+    Enter enter = nullptr;
+    const uint8_t* exit = nullptr;
+    const uint8_t* call_interpret = nullptr;
+
+    // where the members translated code uses live, relative to `registers`
+    // (which it addresses through rdi)
+    int32_t pc_offset = 0;
+    int32_t idle_offset = 0;
+    int32_t index_offset = 0;
+    int32_t delay_timer_offset = 0;
+    int32_t sound_timer_offset = 0;
+    int32_t keys_offset = 0;
+    int32_t stack_offset = 0;
+    int32_t stack_pointer_offset = 0;
+
+    // ways out of a block that aren't its end (before the instruction at
+    // `address`, or wherever the interpreter stopped if `interpreted`),
+    // waiting for the code that backs out of it to be emitted (see
+    // `translate`)
+    struct Bail {
+        size_t jump = 0;
+        uint16_t address = 0;
+        bool interpreted = false;
+    };
+
+    std::vector<Bail> bails;
+
+    // how many bytes before the start of the block being translated it
+    // depends on (see `Block::behind`)
+    uint8_t behind = 0;
+
+    // helpers
+
+    static bool interpretable(const uint16_t instruction);
+    static int32_t interpret(Jit& jit, const uint16_t address, const uint16_t count) noexcept;
+    void sync();
+    void drop(const uint16_t address);
+    Block& translate(const uint16_t address);
+    bool translate_instruction(const uint16_t instruction);
+    bool translate_branch(const uint16_t instruction, const uint16_t address, const uint16_t start);
+    void translate_prologue();
+    void emit_v(std::initializer_list<uint8_t> opcode, const uint8_t reg, const uint8_t x);
+    void emit_member(std::initializer_list<uint8_t> opcode, const uint8_t reg, const int32_t offset);
+    void emit_continue(const uint16_t address);
+    void emit_bail(const uint8_t condition, const uint16_t address, const bool interpreted = false);
+    void emit_back_out(const Bail& bail, const uint16_t address, const uint16_t length);
+    void emit_interpret(const uint16_t address, const uint16_t count);
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit_rel(const uint8_t* target);
+    void emit_le(const uint64_t value, const size_t size);
+    void flush();
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#ifndef CHIP8_JSON_H
+#define CHIP8_JSON_H
+
+// `text` as a JSON string, quoted and escaped, for the tools that print their
+// results as JSON lines
+inline std::string quote(const std::string& text) {
+    std::ostringstream out;
+
+    out << '"';
+
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int{c};
+        } else {
+            out << c;
+        }
+    }
+
+    out << '"';
+
+    return out.str();
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "latency.h"
+#include <algorithm>
+
+void Latency::pressed(const clock::time_point at) {
+    expire(at);
+
+    if (!waiting) {
+        waiting = at;
+    }
+}
+
+void Latency::presented(const clock::time_point at) {
+    if (expire(at) || !waiting) {
+        return;
+    }
+
+    // NOTE: a press is only stamped to the millisecond, so it can look like
+    // it came (just) after a frame it made it into
+    const auto latency = std::max(at - *waiting, clock::duration::zero());
+    const auto bucket = std::chrono::duration_cast<std::chrono::milliseconds>(latency).count();
+
+    ++histogram[std::min<size_t>(bucket, histogram.size() - 1)];
+    ++count;
+    total += latency;
+    worst = std::max(worst, latency);
+    waiting.reset();
+}
+
+uint64_t Latency::measured() const {
+    return count;
+}
+
+uint64_t Latency::unanswered() const {
+    return given_up;
+}
+
+std::chrono::milliseconds Latency::percentile(const double fraction) const {
+    const double wanted = fraction * count;
+    uint64_t seen = 0;
+
+    for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+        seen += histogram[bucket];
+
+        if (seen > 0 && seen >= wanted) {
+            return std::chrono::milliseconds{bucket};
+        }
+    }
+
+    return LIMIT;
+}
+
+void Latency::report(std::ostream& out) const {
+    using milliseconds = std::chrono::duration<double, std::milli>;
+
+    out << "input latency: " << count << " presses measured";
+
+    if (count > 0) {
+        out << ", mean " << milliseconds{total / count}.count() << " ms"
+            << ", median " << percentile(0.5).count() << " ms"
+            << ", 99th percentile " << percentile(0.99).count() << " ms"
+            << ", worst " << milliseconds{worst}.count() << " ms";
+    }
+
+    out << "; " << given_up << " changed nothing within " << LIMIT.count() << " ms\n";
+}
+
+// give up on the press we're waiting on if it's been too long; true if we did
+bool Latency::expire(const clock::time_point now) {
+    if (!waiting || now - *waiting <= LIMIT) {
+        return false;
+    }
+
+    ++given_up;
+    waiting.reset();
+
+    return true;
+}
@@ -0,0 +1,57 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+
+#ifndef CHIP8_LATENCY_H
+#define CHIP8_LATENCY_H
+
+// measures input latency: how long it takes from the player pressing a key
+// to the first frame presented after it that differs from the one before,
+// as a histogram with a bucket per millisecond
+//
+// NOTE: we can't tell whether a change was caused by the press, so a ROM
+// that's animating anyway looks faster than it is; and presses that come
+// while we're still waiting on an earlier one are put down to the same
+// change, so only the earliest is measured
+class Latency {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // presses that haven't changed anything after this long are given up on
+    // (and counted as `unanswered`)
+    static constexpr auto LIMIT = std::chrono::milliseconds{500};
+
+    // a key went down at `at`
+    void pressed(const clock::time_point at);
+
+    // a frame that differed from the one before went up on the display at
+    // `at`
+    void presented(const clock::time_point at);
+
+    // how many presses have been measured, and how many were given up on
+    uint64_t measured() const;
+    uint64_t unanswered() const;
+
+    // the latency that `fraction` (e.g. 0.99) of measured presses were at or
+    // under, to the millisecond
+    std::chrono::milliseconds percentile(const double fraction) const;
+
+    // a one-line summary
+    void report(std::ostream& out) const;
+
+private:
+    std::array<uint64_t, LIMIT.count() + 1> histogram = {};
+    uint64_t count = 0;
+    uint64_t given_up = 0;
+    clock::duration total{};
+    clock::duration worst{};
+
+    // the earliest press we haven't seen the display change since
+    std::optional<clock::time_point> waiting;
+
+    bool expire(const clock::time_point now);
+};
+
+#endif
@@ -0,0 +1,663 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "chip8.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#ifndef CHIP8_LOCKSTEP_H
+#define CHIP8_LOCKSTEP_H
+
+// NOTE: vectors wider than the target's registers get split up badly, so by
+// default a lane's 16-bit values (e.g. `pc`) all fit in one register
+#ifdef __AVX512BW__
+constexpr size_t LOCKSTEP_LANES = 32;
+#else
+constexpr size_t LOCKSTEP_LANES = 16;
+#endif
+
+// runs `LANES` copies of a machine side by side (e.g. the same ROM with
+// different inputs), keeping their registers, timers, etc. structure-of-arrays
+// (one vector of `LANES` values each) so an instruction runs for every lane
+// that's reached it at once, in as few SIMD instructions as the target allows
+// (so build with `-mavx2` or `-mavx512bw`, or it's mostly a slow way of
+// running `LANES` `Chip8`s)
+//
+// every lane behaves exactly like a `Chip8` calling `run_decoded` (idling
+// included); lanes whose `pc`s have drifted apart run one group (same `pc`,
+// same instruction) at a time, with the other lanes masked out, so this is
+// at its best when the lanes mostly agree
+//
+// NOTE: each lane still has its own memory, screen and stack entries, so the
+// instructions that index those (draws, calls, stores, ...) run lane by lane;
+// every lane runs under the same `Policy` (see `Checked` and `Masked`) and
+// with the same `Quirks` (see `with_quirks` for picking them from a
+// `Profile`)
+template <size_t LANES = LOCKSTEP_LANES, typename Policy = Checked, typename Quirks = Modern>
+class Lockstep {
+    static_assert(LANES >= 16 && (LANES & (LANES - 1)) == 0, "lanes have to fill whole vectors");
+    static_assert(LANES <= 32, "vectors wider than a 512-bit register get split up badly");
+
+public:
+    // the first `used` lanes start out as copies of `initial` (e.g. a `Chip8`
+    // that's just had a ROM loaded); the rest are never run or copied into,
+    // so a group that doesn't fill every lane only pays for the ones it has
+    explicit Lockstep(const Chip8& initial, const size_t used = LANES) {
+        if (used == 0 || used > LANES) {
+            throw std::invalid_argument{"expected between 1 and " + std::to_string(LANES) + " lanes"};
+        }
+
+        for (size_t lane = used; lane < LANES; ++lane) {
+            unused[lane] = 0xFF;
+        }
+
+        for (size_t lane = 0; lane < used; ++lane) {
+            for (size_t address = 0; address < MEMORY_SIZE; ++address) {
+                memory[lane].bytes[address] = initial.memory[address];
+            }
+
+            screens[lane] = initial.screen;
+            random[lane] = initial.random;
+
+            for (size_t i = 0; i < 16; ++i) {
+                v[i][lane] = initial.registers[i];
+                keys[i][lane] = initial.keys_pressed[i];
+                stack[i][lane] = initial.stack.stack[i];
+            }
+
+            stack_pointer[lane] = initial.stack.stack_pointer;
+            index[lane] = initial.index;
+            pc[lane] = initial.pc;
+            delay_timer[lane] = initial.delay_timer;
+            sound_timer[lane] = initial.sound_timer;
+        }
+    }
+
+    // run up to `cycles` instructions on every lane, same as calling
+    // `run<Policy>(cycles)` on each of them; a lane that faults stops where
+    // it is for good, see `fault`
+    void run(const uint64_t cycles) {
+        std::array<uint64_t, LANES> ran = {};
+        Words counts;
+
+        idle = Bytes{};
+
+        // NOTE: lanes count their cycles in 16 bits to keep the vectors
+        // narrow, so long runs go a chunk at a time
+        for (uint64_t remaining = cycles; remaining > 0; remaining -= counts_limit(remaining)) {
+            run_chunk(counts_limit(remaining), counts);
+
+            for (size_t lane = 0; lane < LANES; ++lane) {
+                ran[lane] += counts[lane];
+            }
+        }
+
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            // NOTE: like a `Chip8`'s, a lane's cycles aren't counted in the
+            // run that faulted
+            if (!faulted[lane]) {
+                executed_cycles[lane] += ran[lane];
+                elided_cycles[lane] += cycles - ran[lane];
+            }
+        }
+    }
+
+    // carry on with `lane` on `chip8` from exactly where it is, e.g. once the
+    // lanes have drifted apart (see `lane_steps`); `chip8` has to have the same
+    // ROM loaded and the same profile
+    void copy_to(const size_t lane, Chip8& chip8) const {
+        const auto changed = chip8.memory.restore(memory.at(lane).bytes.data());
+
+        for (size_t i = 0; i < 16; ++i) {
+            chip8.registers[i] = v[i][lane];
+            chip8.keys_pressed[i] = keys[i][lane] != 0;
+            chip8.stack.stack[i] = stack[i][lane];
+        }
+
+        chip8.stack.stack_pointer = stack_pointer[lane];
+        chip8.index = index[lane];
+        chip8.pc = pc[lane];
+        chip8.delay_timer = delay_timer[lane];
+        chip8.sound_timer = sound_timer[lane];
+        chip8.screen = screens[lane];
+        chip8.random = random[lane];
+        chip8.elided_cycles = elided_cycles[lane];
+        chip8.instruction = 0;
+        chip8.operands = {};
+        chip8.idle = false;
+
+        for (size_t page = 0; page < changed.size(); ++page) {
+            if (changed[page]) {
+                chip8.invalidate(page * PAGE_BYTES, PAGE_BYTES);
+            }
+        }
+    }
+
+    // how many lanes have run an instruction, and how many groups of them
+    // ran them together (see `run_chunk`), so far; the first over the second
+    // is how many lanes each instruction ran for on average, which is all
+    // that makes this faster than running the lanes one at a time
+    uint64_t lane_steps() const {
+        return lanes_run;
+    }
+
+    uint64_t group_steps() const {
+        return groups_run;
+    }
+
+    // same as `Chip8::decrement_timers`, for every lane
+    void decrement_timers() {
+        const Bytes live = ~faulted & ~unused;
+
+        delay_timer -= (Bytes) (delay_timer > 0) & live & 1;
+        sound_timer -= (Bytes) (sound_timer > 0) & live & 1;
+    }
+
+    void set_key(const size_t lane, const uint8_t key, const bool down) {
+        keys.at(key)[lane] = down ? 1 : 0;
+    }
+
+    std::array<uint8_t, 16> get_registers(const size_t lane) const {
+        std::array<uint8_t, 16> registers;
+
+        for (size_t i = 0; i < registers.size(); ++i) {
+            registers[i] = v[i][lane];
+        }
+
+        return registers;
+    }
+
+    uint16_t get_index(const size_t lane) const {
+        return index[lane];
+    }
+
+    uint16_t get_pc(const size_t lane) const {
+        return pc[lane];
+    }
+
+    const Screen<64, 32>& screen(const size_t lane) const {
+        return screens.at(lane);
+    }
+
+    // the total number of cycles `lane` has run or skipped over (see
+    // `Chip8::elided`) so far
+    uint64_t executed(const size_t lane) const {
+        return executed_cycles.at(lane);
+    }
+
+    uint64_t elided(const size_t lane) const {
+        return elided_cycles.at(lane);
+    }
+
+    // what stopped `lane`, or `Fault::none` if it's still running
+    Fault fault(const size_t lane) const {
+        return faults.at(lane);
+    }
+
+private:
+    static constexpr size_t MEMORY_SIZE = 4096;
+    static constexpr size_t STACK_SIZE = 16;
+
+    // NOTE: GCC ignores a dependent `vector_size` unless the element type is
+    // dependent too, hence the indirection
+    template <typename T>
+    struct Vector {
+        typedef T type __attribute__((vector_size(LANES * sizeof(T))));
+    };
+
+    // NOTE: masks are stored the same way as values, with every bit of a
+    // lane set if it's in the mask and clear if it isn't
+    using Bytes = typename Vector<uint8_t>::type;
+    using Words = typename Vector<uint16_t>::type;
+
+    std::array<Bytes, 16> v = {};
+    std::array<Bytes, 16> keys = {};
+    std::array<Words, STACK_SIZE> stack = {};
+    Bytes stack_pointer = {};
+    Words index = {};
+    Words pc = {};
+    Bytes delay_timer = {};
+    Bytes sound_timer = {};
+    Bytes idle = {};
+    Bytes faulted = {};
+    Bytes unused = {};
+
+    // NOTE: padded out so that the same address in different lanes doesn't
+    // land in the same cache set (which is what a 4 KiB stride would do)
+    struct Memory {
+        std::array<uint8_t, MEMORY_SIZE> bytes = {};
+        std::array<uint8_t, 64> padding = {};
+    };
+
+    std::array<Memory, LANES> memory = {};
+    std::array<Screen<64, 32>, LANES> screens = {};
+    std::array<Random, LANES> random = {};
+
+    // which lanes have written to each 256-byte page of memory, one bit each
+    std::array<uint64_t, 16> written = {};
+
+    uint64_t lanes_run = 0;
+    uint64_t groups_run = 0;
+
+    std::array<uint64_t, LANES> executed_cycles = {};
+    std::array<uint64_t, LANES> elided_cycles = {};
+    std::array<Fault, LANES> faults = {};
+
+    // helpers
+
+    // the lanes in `mask`, one bit each
+    static uint64_t bits(const Bytes& mask) {
+        uint64_t lanes = 0;
+
+        #ifdef __SSE2__
+        // NOTE: compilers don't reliably spot that this is a movemask, so
+        // spell it out 16 lanes at a time
+        for (size_t lane = 0; lane < LANES; lane += 16) {
+            __m128i chunk;
+
+            std::memcpy(&chunk, reinterpret_cast<const uint8_t*>(&mask) + lane, sizeof(chunk));
+            lanes |= uint64_t{static_cast<uint32_t>(_mm_movemask_epi8(chunk))} << lane;
+        }
+        #else
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            lanes |= uint64_t{mask[lane] & 1u} << lane;
+        }
+        #endif
+
+        return lanes;
+    }
+
+    // the smallest value in any lane
+    static uint16_t minimum(const Words& words) {
+        uint16_t result = UINT16_MAX;
+
+        #ifdef __SSE4_1__
+        for (size_t lane = 0; lane < LANES; lane += 8) {
+            __m128i chunk;
+
+            std::memcpy(&chunk, reinterpret_cast<const uint16_t*>(&words) + lane, sizeof(chunk));
+            result = std::min<uint16_t>(result, _mm_cvtsi128_si32(_mm_minpos_epu16(chunk)));
+        }
+        #else
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            result = std::min<uint16_t>(result, words[lane]);
+        }
+        #endif
+
+        return result;
+    }
+
+    // NOTE: vectors are only ever passed around by reference, since passing
+    // ones wider than the target's registers by value changes the ABI (and
+    // GCC warns about it)
+    static void blend(Bytes& target, const Bytes& value, const Bytes& mask) {
+        target = (value & mask) | (target & ~mask);
+    }
+
+    static void blend(Words& target, const Words& value, const Words& mask) {
+        target = (value & mask) | (target & ~mask);
+    }
+
+    // NOTE: masked, the instruction at the very end of memory wraps around
+    // to the start of it
+    uint16_t fetch(const size_t lane, const uint16_t address) const {
+        return memory[lane].bytes[address] << 8 | memory[lane].bytes[(address + 1) & (MEMORY_SIZE - 1)];
+    }
+
+    // same as `Chip8::write`
+    //
+    // NOTE: unchecked, since every instruction that writes checks (or masks)
+    // its addresses up front, same as the reference
+    void write(const size_t lane, const uint16_t address, const uint8_t value) {
+        memory[lane].bytes[address] = value;
+        written[address >> 8] |= uint64_t{1} << lane;
+    }
+
+    // stop `lane` for good on `fault`, same as `Chip8::fail`
+    void fail(const size_t lane, const Fault fault) {
+        faulted[lane] = 0xFF;
+        faults[lane] = fault;
+    }
+
+    static uint16_t counts_limit(const uint64_t cycles) {
+        return std::min<uint64_t>(cycles, UINT16_MAX);
+    }
+
+    // the guts of `run`, leaving how many cycles each lane ran in `ran`
+    void run_chunk(const uint16_t cycles, Words& ran) {
+        Bytes live = ~idle & ~faulted & ~unused;
+        uint64_t lanes = bits(live);
+
+        ran = Words{};
+
+        while (lanes) {
+            // NOTE: masked, the lanes about to run wrap their `pc`s around
+            // the same as `Chip8::loop` does just before fetching
+            if constexpr (Policy::MASKED) {
+                const Words wide = -__builtin_convertvector(live & 1, Words);
+
+                blend(pc, pc & (MEMORY_SIZE - 1), wide);
+            }
+
+            // NOTE: lanes can't affect each other, so there's no need to keep
+            // them on the same cycle; always running the lanes furthest
+            // behind in the program lets lanes that branched different ways
+            // meet up again (e.g. at the top of a loop)
+            const Words wide = -__builtin_convertvector(live & 1, Words);
+            const uint16_t address = minimum(pc | ~wide);
+            Bytes group = live & __builtin_convertvector(pc == address, Bytes);
+            uint64_t members = bits(group);
+
+            if (!Policy::MASKED && address >= MEMORY_SIZE - 1) {
+                for (uint64_t rest = members; rest; rest &= rest - 1) {
+                    fail(std::countr_zero(rest), Fault::fetch_outside_memory);
+                }
+            } else {
+                // NOTE: every lane starts out with the same memory, so only
+                // the ones that have written over this instruction could
+                // disagree on what it is; the instruction's taken from a lane
+                // that hasn't (if there is one), and any that disagree with it
+                // get left for a later group
+                const uint64_t suspects = written[address >> 8] | written[((address + 1) & (MEMORY_SIZE - 1)) >> 8];
+                const uint64_t clean = members & ~suspects;
+                const uint16_t instruction = fetch(std::countr_zero(clean ? clean : members), address);
+
+                for (uint64_t rest = members & suspects; rest; rest &= rest - 1) {
+                    const size_t lane = std::countr_zero(rest);
+
+                    if (fetch(lane, address) != instruction) {
+                        group[lane] = 0;
+                        members &= ~(uint64_t{1} << lane);
+                    }
+                }
+
+                execute(instruction, address, group, members);
+                lanes_run += std::popcount(members);
+                ++groups_run;
+            }
+
+            ran += __builtin_convertvector(group & 1, Words);
+            live &= ~idle & ~faulted & ~unused & ~__builtin_convertvector(ran == cycles, Bytes);
+            lanes = bits(live);
+        }
+    }
+
+    // run `instruction` on each of `lanes` one at a time (any of which can
+    // `fail` without stopping the rest)
+    template <typename Instruction>
+    void each_lane(const uint64_t lanes, Instruction&& instruction) {
+        for (uint64_t rest = lanes; rest; rest &= rest - 1) {
+            instruction(std::countr_zero(rest));
+        }
+    }
+
+    // run the instruction at `address` for every lane in `mask` (which have
+    // all reached it, and are also given one bit each in `lanes`), mirroring
+    // the instructions on `Chip8`
+    void execute(const uint16_t instruction, const uint16_t address, const Bytes& mask, const uint64_t lanes) {
+        const uint16_t nnn = instruction & 0x0FFF;
+        const uint8_t nn = instruction & 0x00FF;
+        const uint8_t n = instruction & 0x000F;
+        const uint8_t x = (instruction & 0x0F00) >> 8;
+        const uint8_t y = (instruction & 0x00F0) >> 4;
+        const uint16_t next = address + 2;
+        // NOTE: masks have to be sign-extended rather than zero-extended
+        const Words wide = -__builtin_convertvector(mask & 1, Words);
+
+        const auto set = [&](Bytes& target, const Bytes& value) {
+            blend(target, value, mask);
+        };
+
+        const auto skip_if = [&](const Bytes& condition) {
+            pc += __builtin_convertvector(condition & mask & 1, Words) * 2;
+        };
+
+        const auto reset_vf = [&] {
+            if constexpr (Quirks::RESET_VF) {
+                set(v[0xF], Bytes{});
+            }
+        };
+
+        const auto illegal = [&] {
+            each_lane(lanes, [&](size_t lane) {
+                fail(lane, Fault::illegal_instruction);
+            });
+        };
+
+        blend(pc, Words{} + next, wide);
+
+        switch (instruction >> 12) {
+            case 0x0:
+                if (nn == 0xE0) {
+                    each_lane(lanes, [&](size_t lane) {
+                        screens[lane].clear();
+                    });
+                } else if (nn == 0xEE) {
+                    each_lane(lanes, [&](size_t lane) {
+                        if constexpr (Policy::MASKED) {
+                            stack_pointer[lane] = (stack_pointer[lane] + STACK_SIZE - 1) % STACK_SIZE;
+                        } else if (stack_pointer[lane] == 0) {
+                            return fail(lane, Fault::stack_underflow);
+                        } else {
+                            --stack_pointer[lane];
+                        }
+
+                        pc[lane] = stack[stack_pointer[lane]][lane];
+                    });
+                } else {
+                    illegal();
+                }
+                break;
+            case 0x1: {
+                // see `Chip8::jump`
+                Bytes delay_loop = {};
+
+                if (nnn == address - 4) {
+                    for (uint64_t rest = lanes; rest; rest &= rest - 1) {
+                        const size_t lane = std::countr_zero(rest);
+                        const auto& bytes = memory[lane].bytes;
+
+                        delay_loop[lane] = -(delay_timer[lane] > 0
+                            && (bytes[nnn] & 0xF0) == 0xF0
+                            && bytes[nnn + 1] == 0x07
+                            && bytes[nnn + 2] == (0x30 | (bytes[nnn] & 0x0F))
+                            && bytes[nnn + 3] == 0x00);
+                    }
+                }
+
+                blend(idle, nnn == address ? ~Bytes{} : delay_loop, mask);
+                blend(pc, Words{} + nnn, wide);
+                break;
+            }
+            case 0x2:
+                each_lane(lanes, [&](size_t lane) {
+                    if constexpr (Policy::MASKED) {
+                        // NOTE: like `Stack::push_wrapped`
+                        stack_pointer[lane] %= STACK_SIZE;
+                        stack[stack_pointer[lane]++][lane] = next;
+                    } else if (stack_pointer[lane] >= STACK_SIZE) {
+                        return fail(lane, Fault::stack_overflow);
+                    } else {
+                        stack[stack_pointer[lane]++][lane] = next;
+                    }
+
+                    pc[lane] = nnn;
+                });
+                break;
+            case 0x3: skip_if((Bytes) (v[x] == nn)); break;
+            case 0x4: skip_if((Bytes) (v[x] != nn)); break;
+            case 0x5: n ? illegal() : skip_if((Bytes) (v[x] == v[y])); break;
+            case 0x6: set(v[x], Bytes{} + nn); break;
+            case 0x7: set(v[x], v[x] + nn); break;
+            case 0x8:
+                // NOTE: `VF` is written before `VX` is read back, same as the
+                // reference, in case they're the same register
+                switch (n) {
+                    case 0x0: set(v[x], v[y]); break;
+                    case 0x1: set(v[x], v[x] | v[y]); reset_vf(); break;
+                    case 0x2: set(v[x], v[x] & v[y]); reset_vf(); break;
+                    case 0x3: set(v[x], v[x] ^ v[y]); reset_vf(); break;
+                    case 0x4: {
+                        const Bytes sum = v[x] + v[y];
+
+                        set(v[0xF], (Bytes) (sum < v[x]) & 1);
+                        set(v[x], sum);
+                        break;
+                    }
+                    case 0x5:
+                        set(v[0xF], (Bytes) (v[x] > v[y]) & 1);
+                        set(v[x], v[x] - v[y]);
+                        break;
+                    case 0x6: {
+                        const Bytes source = Quirks::SHIFT_VY ? v[y] : v[x];
+
+                        set(v[0xF], source & 1);
+                        set(v[x], source >> 1);
+                        break;
+                    }
+                    case 0x7:
+                        set(v[0xF], (Bytes) (v[y] > v[x]) & 1);
+                        set(v[x], v[y] - v[x]);
+                        break;
+                    case 0xE: {
+                        const Bytes source = Quirks::SHIFT_VY ? v[y] : v[x];
+
+                        set(v[0xF], source >> 7);
+                        set(v[x], source << 1);
+                        break;
+                    }
+                    default: illegal(); break;
+                }
+                break;
+            case 0x9: n ? illegal() : skip_if((Bytes) (v[x] != v[y])); break;
+            case 0xA: blend(index, Words{} + nnn, wide); break;
+            case 0xB: blend(pc, __builtin_convertvector(v[Quirks::JUMP_VX ? x : 0], Words) + nnn, wide); break;
+            case 0xC:
+                each_lane(lanes, [&](size_t lane) {
+                    v[x][lane] = random[lane].byte() & nn;
+                });
+                break;
+            case 0xD:
+                each_lane(lanes, [&](size_t lane) {
+                    bool collision = false;
+
+                    if (!Policy::MASKED && index[lane] + n > MEMORY_SIZE) {
+                        return fail(lane, Fault::draw_outside_memory);
+                    }
+
+                    // NOTE: clipped, only the start wraps (see `Chip8::drw_vx_vy_n`)
+                    const uint8_t left = Quirks::CLIP ? v[x][lane] % screens[lane].width() : v[x][lane];
+                    const uint8_t top = Quirks::CLIP ? v[y][lane] % screens[lane].height() : v[y][lane];
+
+                    for (uint8_t dy = 0; dy < n; ++dy) {
+                        collision |= screens[lane].template draw<Quirks::CLIP>(left, top + dy, memory[lane].bytes[(index[lane] + dy) & (MEMORY_SIZE - 1)]);
+                    }
+
+                    v[0xF][lane] = collision;
+                });
+                break;
+            case 0xE:
+                if (nn == 0x9E || nn == 0xA1) {
+                    Bytes pressed = {};
+
+                    each_lane(lanes, [&](size_t lane) {
+                        if (!Policy::MASKED && v[x][lane] >= keys.size()) {
+                            return fail(lane, Fault::key_out_of_range);
+                        }
+
+                        pressed[lane] = -(keys[v[x][lane] % keys.size()][lane] != 0);
+                    });
+
+                    // NOTE: lanes with out of range keys have faulted by now
+                    skip_if((nn == 0x9E ? pressed : ~pressed) & ~faulted);
+                } else {
+                    illegal();
+                }
+                break;
+            case 0xF:
+                switch (nn) {
+                    case 0x07: set(v[x], delay_timer); break;
+                    case 0x0A:
+                        each_lane(lanes, [&](size_t lane) {
+                            for (uint8_t key = 0; key < keys.size(); ++key) {
+                                if (keys[key][lane]) {
+                                    v[x][lane] = key;
+                                    return;
+                                }
+                            }
+
+                            pc[lane] -= 2;
+                            idle[lane] = 0xFF;
+                        });
+                        break;
+                    case 0x15: set(delay_timer, v[x]); break;
+                    case 0x18: set(sound_timer, v[x]); break;
+                    case 0x1E: blend(index, index + __builtin_convertvector(v[x], Words), wide); break;
+                    case 0x29: blend(index, __builtin_convertvector(v[x], Words) * FONT_STRIDE + FONT_ADDRESS, wide); break;
+                    case 0x33:
+                        each_lane(lanes, [&](size_t lane) {
+                            const uint8_t value = v[x][lane];
+
+                            if (!Policy::MASKED && index[lane] + 2u >= MEMORY_SIZE) {
+                                return fail(lane, Fault::write_outside_memory);
+                            }
+
+                            write(lane, index[lane] & (MEMORY_SIZE - 1), value / 100);
+                            write(lane, (index[lane] + 1) & (MEMORY_SIZE - 1), value / 10 % 10);
+                            write(lane, (index[lane] + 2) & (MEMORY_SIZE - 1), value % 10);
+                        });
+                        break;
+                    case 0x55:
+                        each_lane(lanes, [&](size_t lane) {
+                            if (!Policy::MASKED && index[lane] + x >= MEMORY_SIZE) {
+                                return fail(lane, Fault::write_outside_memory);
+                            }
+
+                            for (uint8_t i = 0; i <= x; ++i) {
+                                write(lane, (index[lane] + i) & (MEMORY_SIZE - 1), v[i][lane]);
+                            }
+
+                            if constexpr (Quirks::INCREMENT_INDEX == IndexIncrement::x) {
+                                index[lane] += x;
+                            } else if constexpr (Quirks::INCREMENT_INDEX == IndexIncrement::x_plus_1) {
+                                index[lane] += x + 1;
+                            }
+                        });
+                        break;
+                    case 0x65:
+                        each_lane(lanes, [&](size_t lane) {
+                            if (!Policy::MASKED && index[lane] + x >= MEMORY_SIZE) {
+                                return fail(lane, Fault::read_outside_memory);
+                            }
+
+                            for (uint8_t i = 0; i <= x; ++i) {
+                                v[i][lane] = memory[lane].bytes[(index[lane] + i) & (MEMORY_SIZE - 1)];
+                            }
+
+                            if constexpr (Quirks::INCREMENT_INDEX == IndexIncrement::x) {
+                                index[lane] += x;
+                            } else if constexpr (Quirks::INCREMENT_INDEX == IndexIncrement::x_plus_1) {
+                                index[lane] += x + 1;
+                            }
+                        });
+                        break;
+                    default: illegal(); break;
+                }
+                break;
+        }
+    }
+};
+
+#endif
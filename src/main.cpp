@@ -1,59 +1,445 @@
 #include "chip8.h"
+#include "audio.h"
 #include "platform.h"
+#include "frame_clock.h"
+#include "input.h"
+#include "rewind.h"
+#include "movie.h"
+#include "run_ahead.h"
+#include "triple_buffer.h"
 #include <stdexcept>
 #include <iostream>
-#include <chrono>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <optional>
+#include <random>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "SDL2/SDL.h"
 
+// the newest frame the emulator's finished, for the window to present
+using Frames = TripleBuffer<Screen<64, 32>>;
+
+// what the player's doing right now, as far as the emulator's concerned (see
+// `Input`); the keypad's keys also go to a `KeySchedule`, which has them
+// happen on the machine when they actually happened
+struct Controls {
+    std::array<bool, 16> keys = {};
+    bool rewinding = false;
+    bool break_requested = false;
+};
+
+// catch up on everything the player's done since we last looked
+static void apply(Inputs& inputs, Controls& controls, KeySchedule& schedule) {
+    for (Input input; inputs.pop(input);) {
+        switch (input.kind) {
+            case Input::Kind::press:
+            case Input::Kind::release:
+                controls.keys[input.key] = input.kind == Input::Kind::press;
+                schedule.add(input.at, input.key, controls.keys[input.key]);
+                break;
+            case Input::Kind::rewind_press: controls.rewinding = true; break;
+            case Input::Kind::rewind_release: controls.rewinding = false; break;
+            case Input::Kind::debug_break: controls.break_requested = true; break;
+        }
+    }
+}
+
+// hand `screen` over to the window if anything's been drawn on it since we
+// last did
+static void publish(Frames& frames, Screen<64, 32>& screen) {
+    if (!screen.dirty()) {
+        return;
+    }
+
+    frames.back() = screen;
+    frames.publish();
+    screen.clean();
+}
+
+// run a frame's worth of instructions with `debugger` attached, handing over
+// to its console on the terminal (with the screen as it is) whenever it stops
+// the machine; false if told to quit from there
+static bool run_debugged(Chip8& emu, Debugger& debugger, Frames& frames, const uint64_t cycles) {
+    uint64_t left = cycles;
+
+    for (;;) {
+        left -= emu.run_decoded(left);
+
+        if (!debugger.stopped()) {
+            return true;
+        }
+
+        publish(frames, emu.screen);
+
+        if (!debugger.console(emu, std::cin, std::cout)) {
+            return false;
+        }
+    }
+}
+
+#ifdef PROFILE
+// write what `profiler` found out to `<prefix>.txt` (the report) and
+// `<prefix>.folded` (for flame graphs)
+static void write_profile(const Profiler& profiler, const std::string& prefix) {
+    std::ofstream report{prefix + ".txt"};
+    std::ofstream folded{prefix + ".folded"};
+
+    if (!report.is_open() || !folded.is_open()) {
+        throw std::runtime_error{"error opening profile files"};
+    }
+
+    profiler.report(report);
+    profiler.folded(folded);
+}
+#endif
+
 int main(int argc, char** argv) {
-    if (argc != 4) {
-        std::cerr << "usage: chip8 <ROM> <video delay> <cycle delay>";
-        return EXIT_FAILURE;
+    std::string record_path;
+    std::string replay_path;
+    uint64_t frame = 0;
+    unsigned run_ahead_frames = 0;
+    bool usage = argc < 4;
+    bool debugging = false;
+    std::vector<uint16_t> breakpoints;
+    std::string quirks = profile_name(Profile::modern);
+    std::string keys{DEFAULT_KEYMAP};
+    bool measure_latency = false;
+    unsigned long audio_buffer = 256;
+
+    #ifdef PROFILE
+    std::string profile_prefix = "chip8-profile";
+    #endif
+
+    #ifdef TRACE
+    std::string trace_prefix;
+    #endif
+
+    for (int i = 4; i < argc && !usage; ++i) {
+        const std::string option = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (option == "--record" && has_value) {
+            record_path = argv[++i];
+        } else if (option == "--replay" && has_value) {
+            replay_path = argv[++i];
+        } else if (option == "--seek" && has_value) {
+            frame = std::stoull(argv[++i]);
+        } else if (option == "--run-ahead" && has_value) {
+            run_ahead_frames = std::stoul(argv[++i]);
+        } else if (option == "--debug") {
+            debugging = true;
+        } else if (option == "--break" && has_value) {
+            breakpoints.push_back(std::stoul(argv[++i], nullptr, 16));
+        } else if (option == "--quirks" && has_value) {
+            quirks = argv[++i];
+        } else if (option == "--keymap" && has_value) {
+            keys = argv[++i];
+        } else if (option == "--latency") {
+            measure_latency = true;
+        } else if (option == "--audio-buffer" && has_value) {
+            audio_buffer = std::stoul(argv[++i]);
+        #ifdef PROFILE
+        } else if (option == "--profile" && has_value) {
+            profile_prefix = argv[++i];
+        #endif
+        #ifdef TRACE
+        } else if (option == "--trace" && has_value) {
+            trace_prefix = argv[++i];
+        #endif
+        } else {
+            usage = true;
+        }
     }
 
-    // these names are SO long
-    using std::chrono::high_resolution_clock;
-    using std::chrono::duration;
-    using std::chrono::milliseconds;
+    // NOTE: neither a window without pixels nor a frame without instructions
+    // makes sense, and a negative count would wrap around to a huge one once
+    // it's handed to `run_keyed`
+    const int video_scale = usage ? 0 : std::stoi(argv[2]);
+    const int instructions_per_frame = usage ? 0 : std::stoi(argv[3]);
+
+    usage = usage || video_scale <= 0 || instructions_per_frame <= 0;
+
+    const bool recording = !record_path.empty();
+    const bool replaying = !replay_path.empty();
+
+    // NOTE: a movie's frames have to run in full, so there's no stopping
+    // partway through one to debug it
+    const bool start_paused = debugging;
+    debugging = debugging || !breakpoints.empty();
+
+    if (usage || audio_buffer > UINT16_MAX || (recording && replaying) || (frame > 0 && !replaying) || (debugging && (recording || replaying))) {
+        std::cerr << "usage: chip8 <ROM> <video scale> <instructions per frame> "
+            "[--record <movie> | --replay <movie> [--seek <frame>] | --debug [--break <hex address>]...] "
+            "[--run-ahead <frames>] [--quirks <vip|chip48|schip|modern>] "
+            "[--keymap <keys for 0 to F, e.g. " << DEFAULT_KEYMAP << ">] [--latency] "
+            "[--audio-buffer <samples, or 0 for no sound>]"
+            #ifdef PROFILE
+            " [--profile <prefix>]"
+            #endif
+            #ifdef TRACE
+            " [--trace <prefix>]"
+            #endif
+            ;
+        return EXIT_FAILURE;
+    }
 
     char* filename = argv[1];
-    int video_scale = std::stoi(argv[2]);
-    int cycle_delay = std::stoi(argv[3]);
-    bool quit = false;
-    auto prev = high_resolution_clock::now();
 
-    Chip8 emu{};
+    Keymap keymap;
 
-    int pitch = sizeof(uint32_t) * emu.screen.width();
+    try {
+        keymap = parse_keymap(keys);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "chip8: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    Chip8 emu{};
 
     Platform platform{
         emu.screen.width(), 
         emu.screen.height(), 
-        video_scale, 
-        pitch};
+        video_scale,
+        keymap};
 
-    try {
-        emu.load_rom(filename);
+    // one frame per tick of the delay and sound timers
+    FrameClock clock{TIMER_FREQUENCY};
+
+    // NOTE: no sound device isn't worth giving up over
+    std::optional<Audio> audio;
 
-        while (!quit) {
-            quit = platform.update_keys(emu.keys_pressed.data());
+    if (audio_buffer > 0) {
+        try {
+            audio.emplace(audio_buffer, TIMER_FREQUENCY);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "chip8: " << e.what() << " (carrying on without sound)\n";
+        }
+    }
+
+    // the last 5 minutes, with a keyframe every second
+    Rewind rewind{5 * 60 * TIMER_FREQUENCY, TIMER_FREQUENCY};
 
-            auto now = high_resolution_clock::now();
-            auto dt = duration<float, milliseconds::period>(now - prev).count();
+    // NOTE: a replay runs at the speed it was recorded at, and takes its
+    // keys from the movie rather than the keyboard; rewinding is off while
+    // recording or replaying, since the movie couldn't follow it
+    std::optional<Movie> movie;
 
-            if (dt > cycle_delay) {
-                prev = now;
+    // NOTE: off unless asked for, since it costs an extra frame of emulation
+    // per frame (more whenever the keys change)
+    std::optional<RunAhead> run_ahead;
+
+    // NOTE: `--debug` starts out stopped at the first instruction, and F12
+    // stops wherever we are; either way the console's on the terminal
+    Debugger debugger;
+
+    if (debugging) {
+        for (const uint16_t address : breakpoints) {
+            debugger.add_breakpoint(address);
+        }
 
-                emu.cycle();
-                platform.update_display(emu.screen.data());
+        if (start_paused) {
+            debugger.pause();
+        }
+
+        emu.set_debugger(&debugger);
+    }
+
+    // NOTE: written out however we exit (see `write_profile`); speculative
+    // frames aren't profiled, only the ones that actually happen
+    #ifdef PROFILE
+    Profiler profiler;
+    emu.set_profiler(&profiler);
+    #endif
+
+    // NOTE: this keeps the last 16 million instructions or so on disk (read
+    // them back with `chip8-trace`); it's drained and closed however we exit,
+    // so a fault's lead-up is always there
+    #ifdef TRACE
+    constexpr uint64_t TRACE_KEEP = 16'000'000;
+    std::optional<Tracer> tracer;
+    #endif
+
+    // NOTE: the emulator runs on a thread of its own, paced by its own clock,
+    // so a slow present (or the window being dragged around, etc.) can't
+    // hold it up; it hands finished frames over through `frames`, and this
+    // thread hands the player's inputs back through `inputs` and presents
+    // whatever frame is newest once per refresh
+    Frames frames;
+    Inputs inputs;
+    std::atomic<bool> quitting{false};
+    std::atomic<bool> finished{false};
+    int status = EXIT_SUCCESS;
+
+    const auto emulate = [&]() -> int {
+        try {
+            #ifdef TRACE
+            if (!trace_prefix.empty()) {
+                tracer.emplace(trace_prefix, TRACE_KEEP);
+                emu.set_tracer(&*tracer);
+            }
+            #endif
+
+            if (replaying) {
+                movie = Movie::load(replay_path);
+            } else {
+                movie.emplace(std::random_device{}(), instructions_per_frame);
+            }
+
+            if (run_ahead_frames > 0) {
+                run_ahead.emplace(run_ahead_frames, movie->get_instructions_per_frame());
+            }
+
+            // NOTE: a movie doesn't remember which profile it was recorded
+            // with, so it has to be replayed with the same `--quirks`
+            emu.set_profile(find_profile(quirks));
+            emu.seed(movie->get_seed());
+            emu.load_rom(filename);
+
+            // NOTE: this runs headless as fast as it can, rather than in real
+            // time
+            if (replaying) {
+                movie->seek(emu, frame);
+            }
+
+            Screen<64, 32>* shown = &emu.screen;
+            Controls controls;
+            KeySchedule schedule{clock.get_period(), static_cast<uint64_t>(instructions_per_frame)};
+            bool quit = false;
+
+            const auto run = [&](const uint64_t cycles) {
+                emu.run_decoded(cycles);
+                return true;
+            };
+
+            const auto run_with_debugger = [&](const uint64_t cycles) {
+                return run_debugged(emu, debugger, frames, cycles);
+            };
+
+            while (!quit && !quitting.load(std::memory_order_relaxed)) {
+                apply(inputs, controls, schedule);
+
+                if (std::exchange(controls.break_requested, false) && debugging) {
+                    debugger.pause();
+                }
+
+                for (auto due = clock.advance(); due > 0; --due, ++frame) {
+                    // NOTE: taken whatever we do with them, so they don't
+                    // pile up (e.g. while replaying, which ignores them)
+                    const auto& events = schedule.take(clock.due_at(due));
+                    bool beeped = false;
+                    bool rewound = false;
+
+                    if (replaying) {
+                        beeped = movie->run_frame(emu, frame);
+                    } else if (recording) {
+                        movie->record(emu, events);
+                        beeped = movie->run_frame(emu, frame);
+                    } else if (controls.rewinding) {
+                        // NOTE: the keys are whatever the player is holding
+                        // now, not whatever they were holding back then; and
+                        // rewinding is silent
+                        rewind.step_back(emu);
+                        emu.keys_pressed = controls.keys;
+                        shown = &emu.screen;
+                        rewound = true;
+
+                        if (run_ahead) {
+                            run_ahead->forget();
+                        }
+                    } else if (debugging) {
+                        quit = !run_keyed(emu, instructions_per_frame, events.begin(), events.end(), run_with_debugger);
+                        beeped = emu.decrement_timers();
+                        rewind.record(emu);
+
+                        if (quit) {
+                            break;
+                        }
+                    } else {
+                        run_keyed(emu, instructions_per_frame, events.begin(), events.end(), run);
+                        beeped = emu.decrement_timers();
+                        rewind.record(emu);
+                    }
+
+                    if (audio) {
+                        audio->frame(beeped);
+                    }
+
+                    if (run_ahead && !rewound) {
+                        const bool keyed = replaying ? movie->keyed(frame) : !events.empty();
+
+                        shown = &run_ahead->speculate(emu, keyed);
+                    }
+                }
+
+                publish(frames, *shown);
+                clock.wait();
             }
+
+            if (recording) {
+                movie->save(record_path);
+            }
+
+            #ifdef PROFILE
+            write_profile(profiler, profile_prefix);
+            #endif
+
+        } catch (const std::exception& e) {
+            std::cerr << "chip8: " << e.what() << '\n';
+
+            // NOTE: a recording that ends in an error is exactly the one
+            // worth keeping
+            if (recording && movie) {
+                try {
+                    movie->save(record_path);
+                } catch (const std::exception& e) {
+                    std::cerr << "chip8: " << e.what() << '\n';
+                }
+            }
+
+            #ifdef PROFILE
+            try {
+                write_profile(profiler, profile_prefix);
+            } catch (const std::exception& e) {
+                std::cerr << "chip8: " << e.what() << '\n';
+            }
+            #endif
+
+            return EXIT_FAILURE;
         }
 
-    } catch (const std::exception& e) {
-        std::cerr << "chip8: " << e.what() << '\n';
-        return EXIT_FAILURE;
+        return EXIT_SUCCESS;
+    };
+
+    std::thread emulator{[&] {
+        status = emulate();
+        finished.store(true, std::memory_order_release);
+    }};
+
+    while (!finished.load(std::memory_order_acquire)) {
+        if (platform.poll(inputs)) {
+            quitting.store(true, std::memory_order_relaxed);
+        }
+
+        if (frames.update()) {
+            platform.present(frames.front());
+        }
+
+        platform.wait();
+    }
+
+    emulator.join();
+
+    if (measure_latency) {
+        platform.get_latency().report(std::cout);
+
+        if (audio) {
+            audio->report(std::cout);
+        }
     }
 
-    return EXIT_SUCCESS; // unreachable
+    return status;
 }
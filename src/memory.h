@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "fingerprint.h"
+
+#ifndef CHIP8_MEMORY_H
+#define CHIP8_MEMORY_H
+
+constexpr size_t PAGE_BYTES = 256;
+
+// NOTE: pages are cache line aligned so a page never shares a line with its
+// neighbours (which may belong to machines on the same thread doing
+// something else entirely)
+struct alignas(64) Page {
+    std::array<uint8_t, PAGE_BYTES> bytes;
+};
+
+// an arena that `Memory`s get their private pages from; pages are carved out
+// of ever larger slabs and recycled once released, so machines that are reset
+// over and over stop allocating altogether
+//
+// NOTE: this isn't thread-safe, so every `Memory` sharing one has to stay on
+// the same thread
+class Pages {
+public:
+    Page* acquire() {
+        if (free.empty()) {
+            grow();
+        }
+
+        Page* page = free.back();
+        free.pop_back();
+
+        return page;
+    }
+
+    void release(Page* page) noexcept {
+        free.push_back(page);
+    }
+
+private:
+    // NOTE: the first slab is just big enough for one machine that writes
+    // everywhere, so a lone machine doesn't pay for an arena it won't use
+    static constexpr size_t FIRST_SLAB = 16;
+    static constexpr size_t LARGEST_SLAB = 4096;
+
+    std::vector<std::unique_ptr<Page[]>> slabs;
+    std::vector<Page*> free;
+
+    void grow() {
+        const size_t count = std::min(FIRST_SLAB << slabs.size(), LARGEST_SLAB);
+
+        // NOTE: `new` rather than `make_unique` so the slab isn't zeroed,
+        // since a page is always copied over before it's handed out
+        slabs.emplace_back(new Page[count]);
+
+        // NOTE: room for every page there is, so `release` never allocates
+        free.reserve(free.size() + count);
+
+        // NOTE: backwards, so pages get handed out in address order
+        for (size_t i = count; i-- > 0;) {
+            free.push_back(&slabs.back()[i]);
+        }
+    }
+};
+
+// `N` bytes of copy-on-write memory: reads go to a shared, immutable image
+// (e.g. the fontset plus a ROM) until a page is first written, at which point
+// this machine gets its own copy of that page from a `Pages` arena
+//
+// NOTE: a fingerprint of the contents (see `fingerprint.h`) is kept up to date
+// on every write, a page at a time, so reading it doesn't mean going over all
+// `N` bytes
+template <size_t N>
+class Memory {
+    static_assert(N % PAGE_BYTES == 0, "memory has to be made of whole pages");
+
+public:
+    static constexpr size_t PAGES = N / PAGE_BYTES;
+
+    using Image = std::array<uint8_t, N>;
+
+    Memory(std::shared_ptr<const Image> image, std::shared_ptr<Pages> arena)
+        : image{std::move(image)}, arena{std::move(arena)} {
+        fingerprint_image();
+        share_all();
+    }
+
+    // NOTE: a copy gets its own copies of the written pages, from the same
+    // arena (so it has to stay on the same thread)
+    Memory(const Memory& other)
+        : image{other.image}, arena{other.arena}, image_fingerprints{other.image_fingerprints} {
+        share_all();
+
+        for (size_t page = 0; page < PAGES; ++page) {
+            if (other.owned[page]) {
+                own(page, other.owned[page]->bytes.data());
+            }
+        }
+
+        page_fingerprints = other.page_fingerprints;
+        whole = other.whole;
+    }
+
+    Memory(Memory&& other) noexcept
+        : image{other.image},
+          arena{other.arena},
+          pages{other.pages},
+          owned{other.owned},
+          image_fingerprints{other.image_fingerprints},
+          page_fingerprints{other.page_fingerprints},
+          whole{other.whole} {
+        other.owned = {};
+        other.share_all();
+    }
+
+    Memory& operator=(Memory other) noexcept {
+        std::swap(image, other.image);
+        std::swap(arena, other.arena);
+        std::swap(pages, other.pages);
+        std::swap(owned, other.owned);
+        std::swap(image_fingerprints, other.image_fingerprints);
+        std::swap(page_fingerprints, other.page_fingerprints);
+        std::swap(whole, other.whole);
+
+        return *this;
+    }
+
+    ~Memory() {
+        release_all();
+    }
+
+    constexpr size_t size() const noexcept {
+        return N;
+    }
+
+    // the image every page not yet written to is read from
+    const std::shared_ptr<const Image>& shared() const noexcept {
+        return image;
+    }
+
+    // NOTE: unchecked, like `std::array`'s
+    uint8_t operator[](const size_t address) const noexcept {
+        return pages[address / PAGE_BYTES][address % PAGE_BYTES];
+    }
+
+    uint8_t at(const size_t address) const {
+        check(address);
+        return (*this)[address];
+    }
+
+    void set(const size_t address, const uint8_t value) {
+        check(address);
+
+        const size_t page = address / PAGE_BYTES;
+
+        const uint8_t old = pages[page][address % PAGE_BYTES];
+
+        if (old == value) {
+            return;
+        }
+
+        if (!owned[page]) {
+            own(page, pages[page]);
+        }
+
+        const uint64_t change = byte_key(Part::memory, address, old)
+            ^ byte_key(Part::memory, address, value);
+
+        owned[page]->bytes[address % PAGE_BYTES] = value;
+        page_fingerprints[page] ^= change;
+        whole ^= change;
+    }
+
+    // a fingerprint of all `N` bytes: memories with the same contents have
+    // the same fingerprint, however they got there
+    uint64_t fingerprint() const noexcept {
+        return whole;
+    }
+
+    // copy all `N` bytes out to `out`
+    void copy_to(uint8_t* out) const noexcept {
+        for (size_t page = 0; page < PAGES; ++page) {
+            std::copy_n(pages[page], PAGE_BYTES, out + page * PAGE_BYTES);
+        }
+    }
+
+    // replace all `N` bytes with the ones at `bytes`, sharing any page that
+    // matches the image again; returns which pages changed
+    std::bitset<PAGES> restore(const uint8_t* bytes) {
+        std::bitset<PAGES> changed;
+
+        for (size_t page = 0; page < PAGES; ++page) {
+            const uint8_t* contents = bytes + page * PAGE_BYTES;
+            const uint8_t* original = image->data() + page * PAGE_BYTES;
+
+            if (std::equal(contents, contents + PAGE_BYTES, pages[page])) {
+                continue;
+            }
+
+            changed[page] = true;
+            whole ^= page_fingerprints[page];
+
+            if (std::equal(contents, contents + PAGE_BYTES, original)) {
+                arena->release(owned[page]);
+                owned[page] = nullptr;
+                pages[page] = original;
+                page_fingerprints[page] = image_fingerprints[page];
+            } else {
+                if (owned[page]) {
+                    std::copy_n(contents, PAGE_BYTES, owned[page]->bytes.begin());
+                } else {
+                    own(page, contents);
+                }
+
+                page_fingerprints[page] = fingerprint_page(page, contents);
+            }
+
+            whole ^= page_fingerprints[page];
+        }
+
+        return changed;
+    }
+
+    // go back to reading everything from `image` (which may be the one we
+    // already had), handing the pages we wrote back to the arena; returns
+    // which pages those were, since anything derived from them is now stale
+    //
+    // NOTE: this only touches the pages that were written, so it's cheap
+    // enough to do between every run of a ROM
+    std::bitset<PAGES> reset(std::shared_ptr<const Image> image) noexcept {
+        std::bitset<PAGES> written;
+
+        for (size_t page = 0; page < PAGES; ++page) {
+            written[page] = owned[page] != nullptr;
+        }
+
+        release_all();
+
+        if (image != this->image) {
+            this->image = std::move(image);
+            fingerprint_image();
+        }
+
+        share_all();
+
+        return written;
+    }
+
+private:
+    std::shared_ptr<const Image> image;
+    std::shared_ptr<Pages> arena;
+
+    // where each page is read from (the image, or our own copy once we've
+    // written to it), and our own copy of each page (if we have one)
+    std::array<const uint8_t*, PAGES> pages = {};
+    std::array<Page*, PAGES> owned = {};
+
+    // the fingerprints of each page of the image and of each page as it is
+    // now, and of everything together
+    std::array<uint64_t, PAGES> image_fingerprints = {};
+    std::array<uint64_t, PAGES> page_fingerprints = {};
+    uint64_t whole = 0;
+
+    static void check(const size_t address) {
+        if (address >= N) {
+            throw std::out_of_range{"attempted to access outside memory"};
+        }
+    }
+
+    void own(const size_t page, const uint8_t* contents) {
+        Page* copy = arena->acquire();
+
+        std::copy_n(contents, PAGE_BYTES, copy->bytes.begin());
+        owned[page] = copy;
+        pages[page] = copy->bytes.data();
+    }
+
+    static uint64_t fingerprint_page(const size_t page, const uint8_t* contents) noexcept {
+        uint64_t fingerprint = 0;
+
+        for (size_t i = 0; i < PAGE_BYTES; ++i) {
+            fingerprint ^= byte_key(Part::memory, page * PAGE_BYTES + i, contents[i]);
+        }
+
+        return fingerprint;
+    }
+
+    // NOTE: only done when the image changes, so going back to it (`reset`)
+    // doesn't have to go over the pages again
+    void fingerprint_image() noexcept {
+        for (size_t page = 0; page < PAGES; ++page) {
+            image_fingerprints[page] = fingerprint_page(page, image->data() + page * PAGE_BYTES);
+        }
+    }
+
+    void share_all() noexcept {
+        whole = 0;
+
+        for (size_t page = 0; page < PAGES; ++page) {
+            pages[page] = image->data() + page * PAGE_BYTES;
+            page_fingerprints[page] = image_fingerprints[page];
+            whole ^= image_fingerprints[page];
+        }
+    }
+
+    void release_all() noexcept {
+        for (Page*& page : owned) {
+            if (page) {
+                arena->release(page);
+                page = nullptr;
+            }
+        }
+    }
+};
+
+#endif
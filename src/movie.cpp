@@ -0,0 +1,239 @@
+#include "movie.h"
+#include "bytes.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+// movie files start with this, then `MOVIE_VERSION`
+constexpr std::array<uint8_t, 4> MOVIE_MAGIC = {'C', '8', 'M', 'V'};
+
+// NOTE: bump this whenever the layout of a movie file changes
+constexpr uint16_t MOVIE_VERSION = 2;
+
+// pulls values out of a movie file, making sure they're actually there
+struct Reader {
+    const std::vector<uint8_t>& bytes;
+    size_t at = 0;
+
+    void need(const size_t count) const {
+        if (bytes.size() - at < count) {
+            throw std::runtime_error{"movie file is corrupt"};
+        }
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+
+        need(sizeof(T));
+        get_le(bytes.data() + at, value);
+        at += sizeof(T);
+
+        return value;
+    }
+
+    // 7 bits at a time, least significant first, with the top bit set on
+    // every byte but the last
+    uint64_t read_varint() {
+        uint64_t value = 0;
+
+        for (size_t shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = read<uint8_t>();
+
+            value |= uint64_t{byte & 0x7Fu} << shift;
+
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+
+        throw std::runtime_error{"movie file is corrupt"};
+    }
+};
+
+static void write_varint(std::vector<uint8_t>& out, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+    }
+
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+Movie::Movie(const uint64_t seed, const uint64_t instructions_per_frame)
+    : seed{seed}, instructions_per_frame{instructions_per_frame} {}
+
+// the layout is the magic and version, the seed, instructions per frame and
+// length, then the inputs (each one the number of frames since the last and
+// the cycle into its frame, as varints, then a byte with the key in the low
+// nibble and the top bit set if it went down), then the checkpoints (each
+// one its frame, then the save state with its size in front)
+Movie Movie::load(const std::string& filename) {
+    std::ifstream file{filename, std::ios::binary | std::ios::in};
+
+    if (!file.is_open()) {
+        throw std::runtime_error{"error opening movie file"};
+    }
+
+    const std::vector<uint8_t> bytes{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    Reader reader{bytes};
+
+    reader.need(MOVIE_MAGIC.size());
+
+    if (!std::equal(MOVIE_MAGIC.begin(), MOVIE_MAGIC.end(), bytes.begin())) {
+        throw std::runtime_error{"not a movie file"};
+    }
+
+    reader.at = MOVIE_MAGIC.size();
+
+    if (reader.read<uint16_t>() != MOVIE_VERSION) {
+        throw std::runtime_error{"movie file is from an incompatible version"};
+    }
+
+    const auto seed = reader.read<uint64_t>();
+    const auto instructions_per_frame = reader.read<uint64_t>();
+    Movie movie{seed, instructions_per_frame};
+
+    movie.frames = reader.read<uint64_t>();
+
+    uint64_t frame = 0;
+
+    for (auto count = reader.read<uint64_t>(); count > 0; --count) {
+        frame += reader.read_varint();
+
+        const auto cycle = reader.read_varint();
+        const auto key = reader.read<uint8_t>();
+
+        movie.inputs.push_back({frame, cycle, static_cast<uint8_t>(key & 0x0F), (key & 0x80) != 0});
+    }
+
+    for (auto count = reader.read<uint64_t>(); count > 0; --count) {
+        Checkpoint checkpoint;
+
+        checkpoint.frame = reader.read<uint64_t>();
+
+        const auto size = reader.read<uint32_t>();
+
+        reader.need(size);
+        checkpoint.state.assign(bytes.begin() + reader.at, bytes.begin() + reader.at + size);
+        reader.at += size;
+        movie.checkpoints.push_back(std::move(checkpoint));
+    }
+
+    return movie;
+}
+
+void Movie::save(const std::string& filename) const {
+    std::vector<uint8_t> bytes{MOVIE_MAGIC.begin(), MOVIE_MAGIC.end()};
+    auto out = std::back_inserter(bytes);
+
+    out = put_le(out, MOVIE_VERSION);
+    out = put_le(out, seed);
+    out = put_le(out, instructions_per_frame);
+    out = put_le(out, frames);
+    out = put_le(out, static_cast<uint64_t>(inputs.size()));
+
+    uint64_t frame = 0;
+
+    for (const auto& input : inputs) {
+        write_varint(bytes, input.frame - frame);
+        write_varint(bytes, input.cycle);
+        bytes.push_back(input.key | (input.down ? 0x80 : 0x00));
+        frame = input.frame;
+    }
+
+    out = put_le(out, static_cast<uint64_t>(checkpoints.size()));
+
+    for (const auto& checkpoint : checkpoints) {
+        out = put_le(out, checkpoint.frame);
+        out = put_le(out, static_cast<uint32_t>(checkpoint.state.size()));
+        bytes.insert(bytes.end(), checkpoint.state.begin(), checkpoint.state.end());
+    }
+
+    std::ofstream file{filename, std::ios::binary | std::ios::out | std::ios::trunc};
+
+    // NOTE: this cast is fine for the same reason as in `Chip8::read_rom`
+    if (!file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size())) {
+        throw std::runtime_error{"error writing movie file"};
+    }
+}
+
+uint64_t Movie::get_seed() const {
+    return seed;
+}
+
+uint64_t Movie::get_instructions_per_frame() const {
+    return instructions_per_frame;
+}
+
+uint64_t Movie::length() const {
+    return frames;
+}
+
+void Movie::record(const Chip8& chip8, const std::vector<KeyEvent>& events) {
+    for (uint8_t key = 0; key < keys.size(); ++key) {
+        if (chip8.keys_pressed[key] != keys[key]) {
+            keys[key] = chip8.keys_pressed[key];
+            inputs.push_back({frames, 0, key, keys[key]});
+        }
+    }
+
+    for (const KeyEvent& event : events) {
+        const uint8_t key = event.key % keys.size();
+
+        keys[key] = event.down;
+        inputs.push_back({frames, event.cycle, key, event.down});
+    }
+
+    if (frames % CHECKPOINT_INTERVAL == 0) {
+        checkpoints.push_back({frames, {}});
+        chip8.save_state(checkpoints.back().state);
+    }
+
+    ++frames;
+}
+
+void Movie::seek(Chip8& chip8, const uint64_t frame) const {
+    const auto after = std::upper_bound(checkpoints.begin(), checkpoints.end(), frame, [](const uint64_t frame, const Checkpoint& checkpoint) {
+        return frame < checkpoint.frame;
+    });
+
+    uint64_t at = 0;
+
+    chip8.seed(seed);
+
+    if (after != checkpoints.begin()) {
+        chip8.load_state(std::prev(after)->state);
+        at = std::prev(after)->frame;
+    } else {
+        chip8.reset();
+    }
+
+    for (; at < frame; ++at) {
+        run_frame(chip8, at);
+    }
+}
+
+bool Movie::run_frame(Chip8& chip8, const uint64_t frame) const {
+    const auto first = std::lower_bound(inputs.begin(), inputs.end(), frame, [](const Input& input, const uint64_t frame) {
+        return input.frame < frame;
+    });
+    const auto last = std::upper_bound(first, inputs.end(), frame, [](const uint64_t frame, const Input& input) {
+        return frame < input.frame;
+    });
+
+    run_keyed(chip8, instructions_per_frame, first, last, [&](const uint64_t cycles) {
+        chip8.run_decoded(cycles);
+        return true;
+    });
+
+    return chip8.decrement_timers();
+}
+
+bool Movie::keyed(const uint64_t frame) const {
+    const auto first = std::lower_bound(inputs.begin(), inputs.end(), frame, [](const Input& input, const uint64_t frame) {
+        return input.frame < frame;
+    });
+
+    return first != inputs.end() && first->frame == frame;
+}
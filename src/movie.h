@@ -0,0 +1,79 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "input.h"
+
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+
+// a recording of a run that can be played back exactly: the seed and speed it
+// ran at, every change to the keys (by frame), and a save state every so
+// often (a checkpoint) so it can be picked up partway through without
+// replaying everything before that
+//
+// a frame is the same as in the interactive build: a frame's worth of
+// instructions (with the keys going down and up partway through as
+// recorded), then a timer tick
+class Movie {
+public:
+    // one checkpoint a minute
+    static constexpr uint64_t CHECKPOINT_INTERVAL = 60 * TIMER_FREQUENCY;
+
+    Movie(const uint64_t seed, const uint64_t instructions_per_frame);
+
+    static Movie load(const std::string& filename);
+    void save(const std::string& filename) const;
+
+    uint64_t get_seed() const;
+    uint64_t get_instructions_per_frame() const;
+
+    // how many frames have been recorded
+    uint64_t length() const;
+
+    // call at the start of every frame (before it runs) to record the keys
+    // that `chip8` is about to start it with, and `events` that happen
+    // during it (as for `run_keyed`)
+    void record(const Chip8& chip8, const std::vector<KeyEvent>& events = {});
+
+    // bring `chip8` (which should have the recorded ROM loaded) to the start
+    // of `frame`, as fast as it can run, from the last checkpoint before it
+    void seek(Chip8& chip8, const uint64_t frame) const;
+
+    // run `frame` on `chip8` the same way it was recorded; true if it beeped
+    // (as for `Chip8::decrement_timers`)
+    bool run_frame(Chip8& chip8, const uint64_t frame) const;
+
+    // whether any keys went down or up during `frame`
+    bool keyed(const uint64_t frame) const;
+
+private:
+    struct Input {
+        uint64_t frame = 0;
+        uint64_t cycle = 0;
+        uint8_t key = 0;
+        bool down = false;
+    };
+
+    // the state at the start of `frame`
+    struct Checkpoint {
+        uint64_t frame = 0;
+        std::vector<uint8_t> state;
+    };
+
+    uint64_t seed;
+    uint64_t instructions_per_frame;
+    uint64_t frames = 0;
+
+    // the keys as of the end of the last recorded frame
+    std::array<bool, 16> keys = {};
+
+    // NOTE: both of these are in frame order (and `inputs` in cycle order
+    // within a frame)
+    std::vector<Input> inputs;
+    std::vector<Checkpoint> checkpoints;
+};
+
+#endif
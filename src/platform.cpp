@@ -1,10 +1,38 @@
 #include "platform.h"
 #include "SDL2/SDL.h"
 #include "chip8.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
-Platform::Platform(int width, int height, int scale, int pitch) : pitch{pitch} {
+Keymap parse_keymap(const std::string_view keys) {
+    Keymap keymap;
+
+    if (keys.size() != keymap.size()) {
+        throw std::invalid_argument{"a keymap needs a key for each of 0 to F"};
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keymap[i] = SDL_GetKeyFromName(std::string(1, keys[i]).c_str());
+
+        if (keymap[i] == SDLK_UNKNOWN) {
+            throw std::invalid_argument{"unknown key in keymap: " + std::string(1, keys[i])};
+        }
+
+        if (std::find(keymap.begin(), keymap.begin() + i, keymap[i]) != keymap.begin() + i) {
+            throw std::invalid_argument{"key used twice in keymap: " + std::string(1, keys[i])};
+        }
+    }
+
+    return keymap;
+}
+
+Platform::Platform(int width, int height, int scale, const Keymap& keymap) : keymap{keymap} {
     SDL_Init(SDL_INIT_VIDEO);
 
+    ticks_epoch = std::chrono::steady_clock::now() - std::chrono::milliseconds{SDL_GetTicks()};
+
     window = SDL_CreateWindow(
         "chip8 emulator", 
         SDL_WINDOWPOS_CENTERED, 
@@ -13,10 +41,12 @@ Platform::Platform(int width, int height, int scale, int pitch) : pitch{pitch} {
         height * scale, 
         SDL_WINDOW_SHOWN);
 
+    // NOTE: presenting waits for the display to refresh, which only ever
+    // holds up this thread, not the emulator's
     renderer = SDL_CreateRenderer(
         window, 
         -1, 
-        SDL_RENDERER_ACCELERATED);
+        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
     texture = SDL_CreateTexture(
         renderer, 
@@ -24,6 +54,19 @@ Platform::Platform(int width, int height, int scale, int pitch) : pitch{pitch} {
         SDL_TEXTUREACCESS_STREAMING, 
         width, 
         height);
+
+    SDL_DisplayMode mode;
+    int refresh_rate = 60;
+
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0
+            && mode.refresh_rate > 0) {
+        refresh_rate = mode.refresh_rate;
+    }
+
+    // NOTE: leave some slack, so that jitter in when we wake up doesn't make
+    // us miss every other refresh
+    refresh_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(0.75 / refresh_rate));
 }
 
 Platform::~Platform() {
@@ -34,82 +77,104 @@ Platform::~Platform() {
     SDL_Quit();
 }
 
-void Platform::update_display(uint32_t* screen) {
-	SDL_UpdateTexture(texture, nullptr, screen, pitch);
-	SDL_RenderClear(renderer);
-	SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-	SDL_RenderPresent(renderer);
+// present `screen`; only the rows that differ from what's already presented
+// get expanded to actual pixels, straight into the texture's memory
+void Platform::present(const Screen<64, 32>& screen) {
+    const auto& rows = screen.packed();
+    int first = 0;
+    int last = rows.size();
+
+    if (filled) {
+        while (first < last && rows[first] == presented[first]) {
+            ++first;
+        }
+
+        while (last > first && rows[last - 1] == presented[last - 1]) {
+            --last;
+        }
+
+        if (first == last) {
+            return;
+        }
+    }
+
+    const SDL_Rect changed{0, first, static_cast<int>(screen.width()), last - first};
+    void* pixels = nullptr;
+    int pitch = 0;
+
+    if (SDL_LockTexture(texture, &changed, &pixels, &pitch) == 0) {
+        screen.expand(static_cast<uint32_t*>(pixels), pitch / sizeof(uint32_t), first, last);
+        SDL_UnlockTexture(texture);
+        presented = rows;
+        filled = true;
+    }
+
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+
+    // NOTE: with vsync on, that returns once the frame's gone up (or is
+    // about to), which is as close as we can get to when it's seen
+    latency.presented(std::chrono::steady_clock::now());
 }
 
-constexpr uint32_t keymap[] = {
-    SDLK_x,
-    SDLK_1,
-    SDLK_2,
-    SDLK_3,
-    SDLK_q,
-    SDLK_w,
-    SDLK_e,
-    SDLK_a,
-    SDLK_s,
-    SDLK_d,
-    SDLK_z,
-    SDLK_c,
-    SDLK_4,
-    SDLK_r,
-    SDLK_f,
-    SDLK_v
-};
-
-bool Platform::update_keys(bool *keys) {
+// sleep until it's time to look for another frame to present (about once per
+// refresh of the display)
+void Platform::wait() {
+    const auto due = last_wake + refresh_interval;
 
+    std::this_thread::sleep_until(due);
+    last_wake = std::max(due, std::chrono::steady_clock::now());
+}
+
+const Latency& Platform::get_latency() const {
+    return latency;
+}
+
+// hand everything the player's done since we last looked over to `inputs`;
+// true if they've asked to quit
+//
+// NOTE: if the emulator's too busy to take them (e.g. it's stopped in the
+// debugger), inputs past what `inputs` can hold are dropped
+bool Platform::poll(Inputs& inputs) {
     bool quit = false;
 
     SDL_Event event;
 
     while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-            case SDL_QUIT: quit = true; break;
-            case SDL_KEYUP: 
-                switch (event.key.keysym.sym) {
-                    case keymap[0]: keys[0] = false; break;
-                    case keymap[1]: keys[1] = false; break;
-                    case keymap[2]: keys[2] = false; break;
-                    case keymap[3]: keys[3] = false; break;
-                    case keymap[4]: keys[4] = false; break;
-                    case keymap[5]: keys[5] = false; break;
-                    case keymap[6]: keys[6] = false; break;
-                    case keymap[7]: keys[7] = false; break;
-                    case keymap[8]: keys[8] = false; break;
-                    case keymap[9]: keys[9] = false; break;
-                    case keymap[10]: keys[10] = false; break;
-                    case keymap[11]: keys[11] = false; break;
-                    case keymap[12]: keys[12] = false; break;
-                    case keymap[13]: keys[13] = false; break;
-                    case keymap[14]: keys[14] = false; break;
-                    case keymap[15]: keys[15] = false; break;
-                }
-                break;
-            case SDL_KEYDOWN:
-                switch (event.key.keysym.sym) {
-                    case SDLK_ESCAPE: quit = true; break;
-                    case keymap[0]: keys[0] = true; break;
-                    case keymap[1]: keys[1] = true; break;
-                    case keymap[2]: keys[2] = true; break;
-                    case keymap[3]: keys[3] = true; break;
-                    case keymap[4]: keys[4] = true; break;
-                    case keymap[5]: keys[5] = true; break;
-                    case keymap[6]: keys[6] = true; break;
-                    case keymap[7]: keys[7] = true; break;
-                    case keymap[8]: keys[8] = true; break;
-                    case keymap[9]: keys[9] = true; break;
-                    case keymap[10]: keys[10] = true; break;
-                    case keymap[11]: keys[11] = true; break;
-                    case keymap[12]: keys[12] = true; break;
-                    case keymap[13]: keys[13] = true; break;
-                    case keymap[14]: keys[14] = true; break;
-                    case keymap[15]: keys[15] = true; break;
+        const bool down = event.type == SDL_KEYDOWN;
+
+        // NOTE: when SDL saw the event, which can be a while before we get
+        // to it, rather than now
+        const auto now = std::chrono::steady_clock::now();
+        const auto at = std::min(ticks_epoch + std::chrono::milliseconds{event.key.timestamp}, now);
+
+        if (event.type == SDL_QUIT) {
+            quit = true;
+        } else if ((event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) || event.key.repeat) {
+            continue;
+        } else if (event.key.keysym.sym == SDLK_ESCAPE) {
+            quit = quit || down;
+        } else if (event.key.keysym.sym == SDLK_BACKSPACE) {
+            inputs.push({down ? Input::Kind::rewind_press : Input::Kind::rewind_release, 0, at});
+        } else if (event.key.keysym.sym == SDLK_F12) {
+            if (down) {
+                inputs.push({Input::Kind::debug_break, 0, at});
+            }
+        } else {
+            const auto key = std::find(keymap.begin(), keymap.end(), event.key.keysym.sym);
+
+            if (key != keymap.end()) {
+                inputs.push({
+                    down ? Input::Kind::press : Input::Kind::release,
+                    static_cast<uint8_t>(key - keymap.begin()),
+                    at
+                });
+
+                if (down) {
+                    latency.pressed(at);
                 }
-                break;
+            }
         }
     }
 
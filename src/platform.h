@@ -1,17 +1,68 @@
 #include "SDL2/SDL.h"
+#include <array>
 #include <string_view>
 #include <cstdint>
+#include <chrono>
+#include "latency.h"
+#include "screen.h"
+#include "spsc_queue.h"
 
+// something the player did that the emulator needs to know about, and when:
+// a key on the keypad (`key`) going down or up, the rewind key (backspace)
+// going down or up, or asking to break into the debugger (F12)
+struct Input {
+    enum class Kind : uint8_t { press, release, rewind_press, rewind_release, debug_break };
+
+    Kind kind = Kind::press;
+    uint8_t key = 0;
+    std::chrono::steady_clock::time_point at{};
+};
+
+using Inputs = SpscQueue<Input, 256>;
+
+// which key on the keyboard stands for each key on the keypad, 0 to F
+using Keymap = std::array<SDL_Keycode, 16>;
+
+// the keypad's layout on the left of a QWERTY keyboard, 1 to V
+constexpr std::string_view DEFAULT_KEYMAP = "x123qweasdzc4rfv";
+
+// the keymap with the keys in `keys` (one character each, for keypad keys 0
+// to F in order), or throws `std::invalid_argument`
+Keymap parse_keymap(const std::string_view keys);
+
+// the window: presents frames and turns the player's key presses into
+// `Input`s, measuring how long it takes for them to show (see `Latency`)
+//
+// NOTE: SDL wants its window and events handled on the thread that set it up
+// (the main one), so that's the only thread this should be used from
 class Platform {
 public:
-    Platform(int width, int height, int scale, int pitch);
+    Platform(int width, int height, int scale, const Keymap& keymap);
     ~Platform();
-    void update_display(uint32_t* screen);
-    bool update_keys(bool* keys);
+    void present(const Screen<64, 32>& screen);
+    bool poll(Inputs& inputs);
+    void wait();
+    const Latency& get_latency() const;
 
 private:
     SDL_Window* window = nullptr;
     SDL_Renderer* renderer = nullptr;
     SDL_Texture* texture = nullptr;
-    int pitch;
+    Keymap keymap;
+
+    // SDL stamps events with the milliseconds since it started, so this is
+    // when it started, as far as `steady_clock` is concerned
+    std::chrono::steady_clock::time_point ticks_epoch{};
+
+    Latency latency;
+
+    // how often the display actually refreshes, and when we last woke up to
+    // handle one (there's no point presenting more often than that)
+    std::chrono::steady_clock::duration refresh_interval{};
+    std::chrono::steady_clock::time_point last_wake{};
+
+    // the rows of what's in the texture (and so on the display) right now,
+    // which is nothing in particular until we first present something
+    std::array<uint64_t, 32> presented = {};
+    bool filled = false;
 };
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifndef CHIP8_POOL_H
+#define CHIP8_POOL_H
+
+// runs a fixed batch of independent tasks (numbered 0 to `count - 1`) across a
+// set of worker threads; each worker starts out with an even share of the
+// tasks and, once it runs out, steals from the others, so a few long tasks
+// don't leave the rest of the cores sitting idle
+class Pool {
+public:
+    explicit Pool(const size_t threads)
+        : queues(std::max<size_t>(threads, 1)) {}
+
+    size_t threads() const noexcept {
+        return queues.size();
+    }
+
+    // call `task(worker, i)` for every `i` below `count`, where `worker` is
+    // the number of the thread running it (so callers can keep per-thread
+    // state without locking); returns once every task has finished
+    //
+    // NOTE: tasks should catch their own exceptions; if one escapes anyway,
+    // the rest of the batch still runs and the first one is rethrown here
+    template <typename Task>
+    void run(const size_t count, Task&& task) {
+        for (size_t i = 0; i < count; ++i) {
+            queues[i % queues.size()].tasks.push_back(i);
+        }
+
+        std::vector<std::thread> workers;
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        for (size_t worker = 0; worker < queues.size(); ++worker) {
+            workers.emplace_back([&, worker] {
+                while (auto i = next(worker)) {
+                    try {
+                        task(worker, *i);
+                    } catch (...) {
+                        std::lock_guard lock{error_mutex};
+
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+            });
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    // NOTE: each queue gets its own cache line so workers popping from their
+    // own queues don't contend with each other
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<Queue> queues;
+
+    // the next task for `worker`: its own most recently queued task if it has
+    // any, otherwise the oldest task of the first other worker that does
+    std::optional<size_t> next(const size_t worker) {
+        if (auto task = take(queues[worker], false)) {
+            return task;
+        }
+
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            if (auto task = take(queues[(worker + offset) % queues.size()], true)) {
+                return task;
+            }
+        }
+
+        // NOTE: nothing gets queued once the batch has started, so if every
+        // queue is empty we're done
+        return std::nullopt;
+    }
+
+    static std::optional<size_t> take(Queue& queue, const bool steal) {
+        std::lock_guard lock{queue.mutex};
+
+        if (queue.tasks.empty()) {
+            return std::nullopt;
+        }
+
+        size_t task;
+
+        if (steal) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        } else {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+
+        return task;
+    }
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+// NOTE: only built into the `profile` target, so nothing else pays for the
+// tables below
+#ifdef PROFILE
+
+// what each kind of instruction is called in the report, indexed by `classes`
+static const std::array<const char*, Profiler::OPCODES> NAMES = {
+    "00E0 CLS", "00EE RET", "1NNN JP", "2NNN CALL", "3XNN SE", "4XNN SNE",
+    "5XY0 SE", "6XNN LD", "7XNN ADD", "8XY0 LD", "8XY1 OR", "8XY2 AND",
+    "8XY3 XOR", "8XY4 ADD", "8XY5 SUB", "8XY6 SHR", "8XY7 SUBN", "8XYE SHL",
+    "9XY0 SNE", "ANNN LD I", "BNNN JP V0", "CXNN RND", "DXYN DRW", "EX9E SKP",
+    "EXA1 SKNP", "FX07 LD DT", "FX0A LD K", "FX15 LD DT", "FX18 LD ST",
+    "FX1E ADD I", "FX29 LD F", "FX33 LD B", "FX55 LD [I]", "FX65 LD [I]",
+    "illegal"
+};
+
+// NOTE: mirrors `Chip8::decode`, but works out which of `NAMES` every
+// instruction is once up front, so recording one is just a lookup
+const std::array<uint8_t, 65536> Profiler::classes = [] {
+    std::array<uint8_t, 65536> classes = {};
+
+    for (size_t instruction = 0; instruction < classes.size(); ++instruction) {
+        const uint8_t nn = instruction & 0xFF;
+        const uint8_t n = instruction & 0xF;
+        uint8_t kind = OPCODES - 1;
+
+        switch (instruction >> 12) {
+            case 0x0: kind = nn == 0xE0 ? 0 : nn == 0xEE ? 1 : kind; break;
+            case 0x5: kind = n == 0 ? 6 : kind; break;
+            case 0x8: kind = n <= 0x7 ? 9 + n : n == 0xE ? 17 : kind; break;
+            case 0x9: kind = n == 0 ? 18 : kind; break;
+            case 0xE: kind = nn == 0x9E ? 23 : nn == 0xA1 ? 24 : kind; break;
+            case 0xF:
+                switch (nn) {
+                    case 0x07: kind = 25; break;
+                    case 0x0A: kind = 26; break;
+                    case 0x15: kind = 27; break;
+                    case 0x18: kind = 28; break;
+                    case 0x1E: kind = 29; break;
+                    case 0x29: kind = 30; break;
+                    case 0x33: kind = 31; break;
+                    case 0x55: kind = 32; break;
+                    case 0x65: kind = 33; break;
+                }
+                break;
+            case 0x1: kind = 2; break;
+            case 0x2: kind = 3; break;
+            case 0x3: kind = 4; break;
+            case 0x4: kind = 5; break;
+            case 0x6: kind = 7; break;
+            case 0x7: kind = 8; break;
+            case 0xA: kind = 19; break;
+            case 0xB: kind = 20; break;
+            case 0xC: kind = 21; break;
+            case 0xD: kind = 22; break;
+        }
+
+        classes[instruction] = kind;
+    }
+
+    return classes;
+}();
+
+Profiler::Profiler() : nodes(1) {}
+
+void Profiler::restart() noexcept {
+    current = 0;
+}
+
+void Profiler::call(const uint16_t from, const uint16_t routine) {
+    ++calls[{from, routine}];
+
+    const auto child = nodes[current].children.find(routine);
+
+    if (child != nodes[current].children.end()) {
+        current = child->second;
+        return;
+    }
+
+    // NOTE: `nodes` may move here, so no references into it are held
+    const size_t node = nodes.size();
+
+    nodes.emplace_back();
+    nodes[node].routine = routine;
+    nodes[node].parent = current;
+    nodes[current].children[routine] = node;
+    current = node;
+}
+
+void Profiler::ret() noexcept {
+    current = nodes[current].parent;
+}
+
+static std::string hex(const uint16_t value) {
+    std::ostringstream out;
+
+    out << "0x" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << value;
+
+    return out.str();
+}
+
+static double percent(const uint64_t part, const uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+void Profiler::report(std::ostream& out) const {
+    constexpr size_t HOTTEST = 32;
+
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+
+    for (const Totals& opcode : opcodes) {
+        count += opcode.count;
+        ticks += opcode.ticks;
+    }
+
+    const auto by_ticks = [](const auto& a, const auto& b) {
+        return a.second.ticks > b.second.ticks;
+    };
+
+    out << std::fixed << std::setprecision(1)
+        #if defined(__x86_64__) || defined(__i386__)
+        << count << " instructions in " << ticks << " TSC ticks\n";
+        #else
+        << count << " instructions in " << ticks << " ns\n";
+        #endif
+
+    std::vector<std::pair<size_t, Totals>> kinds;
+
+    for (size_t kind = 0; kind < opcodes.size(); ++kind) {
+        if (opcodes[kind].count) {
+            kinds.emplace_back(kind, opcodes[kind]);
+        }
+    }
+
+    std::sort(kinds.begin(), kinds.end(), by_ticks);
+
+    out << "\nby instruction\n"
+        << std::left << std::setw(14) << "  instruction" << std::right
+        << std::setw(14) << "count" << std::setw(8) << "%"
+        << std::setw(16) << "ticks" << std::setw(8) << "%"
+        << std::setw(12) << "ticks each" << '\n';
+
+    for (const auto& [kind, totals] : kinds) {
+        out << "  " << std::left << std::setw(12) << NAMES[kind] << std::right
+            << std::setw(14) << totals.count << std::setw(8) << percent(totals.count, count)
+            << std::setw(16) << totals.ticks << std::setw(8) << percent(totals.ticks, ticks)
+            << std::setw(12) << static_cast<double>(totals.ticks) / totals.count << '\n';
+    }
+
+    std::vector<std::pair<uint16_t, Totals>> hottest;
+
+    for (size_t pc = 0; pc < pcs.size(); ++pc) {
+        if (pcs[pc].count) {
+            hottest.emplace_back(pc, pcs[pc]);
+        }
+    }
+
+    std::sort(hottest.begin(), hottest.end(), by_ticks);
+    hottest.resize(std::min(hottest.size(), HOTTEST));
+
+    out << "\nhottest addresses\n"
+        << std::left << std::setw(8) << "  pc" << std::right
+        << std::setw(14) << "count" << std::setw(8) << "%"
+        << std::setw(16) << "ticks" << std::setw(8) << "%" << '\n';
+
+    for (const auto& [pc, totals] : hottest) {
+        out << "  " << std::left << std::setw(6) << hex(pc) << std::right
+            << std::setw(14) << totals.count << std::setw(8) << percent(totals.count, count)
+            << std::setw(16) << totals.ticks << std::setw(8) << percent(totals.ticks, ticks) << '\n';
+    }
+
+    // NOTE: a routine's own time, summed over every chain of calls it was
+    // reached through (the top level counts as a routine of its own)
+    std::map<int, Totals> routines;
+
+    for (size_t node = 0; node < nodes.size(); ++node) {
+        Totals& routine = routines[node ? nodes[node].routine : -1];
+
+        routine.count += nodes[node].count;
+        routine.ticks += nodes[node].ticks;
+    }
+
+    std::vector<std::pair<int, Totals>> sorted{routines.begin(), routines.end()};
+
+    std::sort(sorted.begin(), sorted.end(), by_ticks);
+
+    out << "\nby routine (own time)\n"
+        << std::left << std::setw(8) << "  routine" << std::right
+        << std::setw(13) << "count" << std::setw(8) << "%"
+        << std::setw(16) << "ticks" << std::setw(8) << "%" << '\n';
+
+    for (const auto& [routine, totals] : sorted) {
+        out << "  " << std::left << std::setw(7) << (routine < 0 ? "top" : hex(routine)) << std::right
+            << std::setw(13) << totals.count << std::setw(8) << percent(totals.count, count)
+            << std::setw(16) << totals.ticks << std::setw(8) << percent(totals.ticks, ticks) << '\n';
+    }
+
+    std::vector<std::pair<std::pair<uint16_t, uint16_t>, uint64_t>> edges{calls.begin(), calls.end()};
+
+    std::sort(edges.begin(), edges.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+    });
+
+    out << "\ncalls\n"
+        << std::left << std::setw(18) << "  from -> routine" << std::right
+        << std::setw(14) << "count" << '\n';
+
+    for (const auto& [edge, times] : edges) {
+        out << "  " << hex(edge.first) << " -> " << hex(edge.second)
+            << std::setw(14) << times << '\n';
+    }
+}
+
+void Profiler::folded(std::ostream& out) const {
+    // NOTE: parents always come before their children, so each node's chain
+    // can be built from its parent's
+    std::vector<std::string> chains(nodes.size());
+
+    for (size_t node = 0; node < nodes.size(); ++node) {
+        chains[node] = node ? chains[nodes[node].parent] + ';' + hex(nodes[node].routine) : "top";
+
+        if (nodes[node].ticks) {
+            out << chains[node] << ' ' << nodes[node].ticks << '\n';
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef CHIP8_PROFILER_H
+#define CHIP8_PROFILER_H
+
+// counts how often each kind of instruction and each `pc` runs, and how long
+// they take on the host, and attributes that to the subroutines (found by
+// following calls and returns) they ran in, so it's clear which of a ROM's
+// routines and which instructions dominate
+//
+// NOTE: a machine only reports to one when built with `PROFILE`, and then only
+// from the interpreter (`cycle` and `run_decoded`), not from translated code
+class Profiler {
+public:
+    // the kinds of instruction there are (as decoded), plus illegal ones
+    static constexpr size_t OPCODES = 35;
+
+    Profiler();
+
+    // a timestamp on the host: TSC ticks where there's a TSC, nanoseconds
+    // otherwise
+    static uint64_t now() noexcept {
+        #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+        #else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+    }
+
+    // `instruction` just ran at `pc`, and took `ticks` (see `now`)
+    void record(const uint16_t pc, const uint16_t instruction, const uint64_t ticks) {
+        Totals& opcode = opcodes[classes[instruction]];
+        Totals& at = pcs[pc % pcs.size()];
+        Node& node = nodes[current];
+
+        ++opcode.count;
+        opcode.ticks += ticks;
+        ++at.count;
+        at.ticks += ticks;
+        ++node.count;
+        node.ticks += ticks;
+
+        // NOTE: calls and returns are only followed once they've gone
+        // through, so a failed one (over- or underflowing the stack) doesn't
+        // throw the call graph off; like the decoder, any 0?EE is a return
+        if (instruction >> 12 == 0x2) {
+            call(pc, instruction & 0x0FFF);
+        } else if (instruction >> 12 == 0x0 && (instruction & 0xFF) == 0xEE) {
+            ret();
+        }
+    }
+
+    // forget which routine we're in (e.g. after a reset or loading a state,
+    // when the stack is no longer the one we followed), starting over at the
+    // top level; everything counted so far is kept
+    void restart() noexcept;
+
+    // everything counted so far as a human-readable report, with the biggest
+    // costs first
+    void report(std::ostream& out) const;
+
+    // the time spent in each chain of calls, in the "folded stacks" format
+    // flame graph tools take (`0x200;0x2F4;0x31A <ticks>` per line)
+    void folded(std::ostream& out) const;
+
+private:
+    struct Totals {
+        uint64_t count = 0;
+        uint64_t ticks = 0;
+    };
+
+    // a routine, as reached through one particular chain of calls (so the
+    // same routine called from two places is two nodes)
+    struct Node {
+        uint16_t routine = 0;
+        size_t parent = 0;
+        uint64_t count = 0;
+        uint64_t ticks = 0;
+        std::map<uint16_t, size_t> children;
+    };
+
+    static const std::array<uint8_t, 65536> classes;
+
+    std::array<Totals, OPCODES> opcodes = {};
+    std::array<Totals, 4096> pcs = {};
+
+    // NOTE: node 0 is the top level, which never returns
+    std::vector<Node> nodes;
+    size_t current = 0;
+
+    // how many times each call site called each routine
+    std::map<std::pair<uint16_t, uint16_t>, uint64_t> calls;
+
+    void call(const uint16_t from, const uint16_t routine);
+    void ret() noexcept;
+};
+
+#endif
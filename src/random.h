@@ -0,0 +1,46 @@
+#include <cstdint>
+
+#ifndef CHIP8_RANDOM_H
+#define CHIP8_RANDOM_H
+
+// a small, fast PRNG (SplitMix64) that each machine keeps for itself, so runs
+// are reproducible from the seed alone and machines on different threads
+// don't share any state; every seed (0 included) is fine, and the whole state
+// is the one word, so it's trivial to save and restore
+class Random {
+public:
+    Random() noexcept = default;
+
+    explicit Random(const uint64_t seed) noexcept
+        : state{seed} {}
+
+    void seed(const uint64_t seed) noexcept {
+        state = seed;
+    }
+
+    // the current state, which can be handed back to `seed` to carry on from
+    // exactly here
+    uint64_t get_state() const noexcept {
+        return state;
+    }
+
+    uint64_t next() noexcept {
+        state += 0x9E3779B97F4A7C15;
+
+        uint64_t z = state;
+
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+
+        return z ^ (z >> 31);
+    }
+
+    uint8_t byte() noexcept {
+        return next() >> 56;
+    }
+
+private:
+    uint64_t state = 0;
+};
+
+#endif
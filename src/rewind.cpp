@@ -0,0 +1,151 @@
+#include "rewind.h"
+#include <algorithm>
+#include <cstring>
+
+// NOTE: runs shorter than this are cheaper to store as part of the
+// surrounding changes than as a run of their own
+constexpr size_t MIN_UNCHANGED_RUN = 4;
+
+Rewind::Rewind(const size_t frames, const size_t keyframe_interval)
+    : keyframe_interval{std::max<size_t>(keyframe_interval, 1)},
+      ring(std::max<size_t>(frames, 1)) {}
+
+void Rewind::record(const Chip8& chip8) {
+    if (end - first == ring.size()) {
+        drop_oldest();
+    }
+
+    const bool keyframe = first == end || end - at(end - 1).keyframe >= keyframe_interval;
+    Frame& frame = at(end);
+
+    if (keyframe) {
+        frame.keyframe = end;
+        chip8.save_state(frame.data);
+    } else {
+        frame.keyframe = at(end - 1).keyframe;
+        chip8.save_state(state);
+        encode(state, at(frame.keyframe).data, frame.data);
+    }
+
+    ++end;
+}
+
+bool Rewind::step_back(Chip8& chip8) {
+    if (end - first < 2) {
+        return false;
+    }
+
+    --end;
+
+    const Frame& frame = at(end - 1);
+
+    if (frame.keyframe == end - 1) {
+        chip8.load_state(frame.data);
+    } else {
+        decode(frame.data, at(frame.keyframe).data, state);
+        chip8.load_state(state);
+    }
+
+    return true;
+}
+
+size_t Rewind::frames() const {
+    return end - first;
+}
+
+size_t Rewind::bytes() const {
+    size_t total = 0;
+
+    for (uint64_t sequence = first; sequence < end; ++sequence) {
+        total += ring[sequence % ring.size()].data.size();
+    }
+
+    return total;
+}
+
+Rewind::Frame& Rewind::at(const uint64_t sequence) {
+    return ring[sequence % ring.size()];
+}
+
+// forget the oldest frame, along with any frames after it that were relative
+// to it (which would be useless without it)
+void Rewind::drop_oldest() {
+    do {
+        ++first;
+    } while (first < end && at(first).keyframe != first);
+}
+
+// `delta` is a series of `<unchanged> <changed> <bytes>`, where `unchanged`
+// and `changed` are 16-bit counts of bytes (little-endian), followed by the
+// `changed` bytes of `state` XORed with `keyframe`; anything past the end of
+// the last series is unchanged
+//
+// NOTE: 16 bits is plenty, since a save state is only a few KB
+void Rewind::encode(const std::vector<uint8_t>& state, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& delta) {
+    const size_t size = state.size();
+    size_t i = 0;
+
+    delta.clear();
+
+    while (true) {
+        const size_t start = i;
+
+        // NOTE: most of the state doesn't change, so skip over it a word at a
+        // time
+        while (i + 8 <= size && std::memcmp(&state[i], &keyframe[i], 8) == 0) {
+            i += 8;
+        }
+
+        while (i < size && state[i] == keyframe[i]) {
+            ++i;
+        }
+
+        if (i == size) {
+            return;
+        }
+
+        const size_t changed = i;
+        size_t unchanged = 0;
+
+        for (; i < size && unchanged < MIN_UNCHANGED_RUN; ++i) {
+            unchanged = state[i] == keyframe[i] ? unchanged + 1 : 0;
+        }
+
+        if (unchanged == MIN_UNCHANGED_RUN) {
+            i -= unchanged;
+        }
+
+        const size_t unchanged_length = changed - start;
+        const size_t changed_length = i - changed;
+
+        delta.push_back(unchanged_length & 0xFF);
+        delta.push_back(unchanged_length >> 8);
+        delta.push_back(changed_length & 0xFF);
+        delta.push_back(changed_length >> 8);
+
+        for (size_t j = changed; j < i; ++j) {
+            delta.push_back(state[j] ^ keyframe[j]);
+        }
+    }
+}
+
+void Rewind::decode(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& state) {
+    state.assign(keyframe.begin(), keyframe.end());
+
+    size_t at = 0;
+
+    for (size_t i = 0; i + 4 <= delta.size();) {
+        const size_t unchanged = delta[i] | delta[i + 1] << 8;
+        const size_t changed = delta[i + 2] | delta[i + 3] << 8;
+
+        at += unchanged;
+        i += 4;
+
+        for (size_t j = 0; j < changed; ++j) {
+            state[at + j] ^= delta[i + j];
+        }
+
+        at += changed;
+        i += changed;
+    }
+}
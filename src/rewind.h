@@ -0,0 +1,62 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+// a ring buffer of the last however many frames' save states, for stepping
+// back through them one at a time
+//
+// every `keyframe_interval`th state is kept whole (a keyframe); the rest are
+// kept as the run-length encoded XOR of themselves and the last keyframe,
+// which is mostly zeros since a frame rarely touches more than a few
+// registers, rows of the screen and bytes of memory, so minutes of history
+// only take a few MB; once a slot's storage has grown to fit, recording
+// doesn't allocate either
+class Rewind {
+public:
+    Rewind(const size_t frames, const size_t keyframe_interval);
+
+    // save `chip8`'s state as the newest frame, forgetting the oldest one(s)
+    // if we're full
+    void record(const Chip8& chip8);
+
+    // forget the newest frame and load the one before it into `chip8`
+    // (which becomes the newest, so recording picks up from there); false if
+    // there's nothing to go back to
+    bool step_back(Chip8& chip8);
+
+    // how many frames we can currently step back through
+    size_t frames() const;
+
+    // how many bytes the recorded frames take up
+    size_t bytes() const;
+
+private:
+    struct Frame {
+        // the sequence number of the keyframe this is relative to (its own,
+        // if it is one)
+        uint64_t keyframe = 0;
+        std::vector<uint8_t> data;
+    };
+
+    size_t keyframe_interval;
+    std::vector<Frame> ring;
+
+    // sequence numbers of the oldest frame and one past the newest; frame
+    // `i` lives in `ring[i % ring.size()]`
+    uint64_t first = 0;
+    uint64_t end = 0;
+
+    // scratch space for the state being saved or loaded
+    std::vector<uint8_t> state;
+
+    Frame& at(const uint64_t sequence);
+    void drop_oldest();
+    static void encode(const std::vector<uint8_t>& state, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& delta);
+    static void decode(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& state);
+};
+
+#endif
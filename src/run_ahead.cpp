@@ -0,0 +1,50 @@
+#include "run_ahead.h"
+#include <stdexcept>
+
+RunAhead::RunAhead(const unsigned frames, const uint64_t instructions_per_frame)
+    : frames{frames}, instructions_per_frame{instructions_per_frame} {}
+
+Screen<64, 32>& RunAhead::speculate(const Chip8& chip8, const bool keyed) {
+    // NOTE: if the ROM is going to run into an error, the real machine will
+    // find out soon enough; until then we just show where it's actually at
+    try {
+        if (synced && !keyed && chip8.keys_pressed == keys) {
+            run_frame();
+        } else {
+            // NOTE: a save state doesn't carry the profile, so it's copied
+            // over too in case it's changed since
+            chip8.save_state(state);
+            ahead.load_state(state);
+            ahead.set_profile(chip8.get_profile());
+            keys = chip8.keys_pressed;
+            synced = true;
+
+            for (unsigned i = 0; i < frames; ++i) {
+                run_frame();
+            }
+        }
+    } catch (const std::exception&) {
+        synced = false;
+    }
+
+    const auto& shown = synced ? ahead.screen : chip8.screen;
+
+    if (shown.packed() != screen.packed()) {
+        screen.restore(shown.packed());
+    }
+
+    return screen;
+}
+
+void RunAhead::forget() {
+    synced = false;
+
+    // NOTE: whatever's been presented in the meantime wasn't ours, so ours
+    // has to be presented again in full
+    screen.restore(screen.packed());
+}
+
+void RunAhead::run_frame() {
+    ahead.run_decoded(instructions_per_frame);
+    ahead.decrement_timers();
+}
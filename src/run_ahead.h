@@ -0,0 +1,55 @@
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+#include "screen.h"
+
+#ifndef CHIP8_RUN_AHEAD_H
+#define CHIP8_RUN_AHEAD_H
+
+// hides a ROM's input lag by showing what the screen will look like a few
+// frames from now if the keys stay as they are, rather than what it looks
+// like right now
+//
+// a second machine is kept `frames` frames ahead of the real one; as long as
+// the keys don't change, it only has to run one frame for every real one,
+// and when they do, it's rolled back to the real machine's state and run
+// ahead again with the new keys
+//
+// NOTE: a key that's tapped (down and back up) within a single frame leaves
+// the keys just as they were by the end of it, but the ROM may well have
+// seen it, so it takes a roll back all the same
+class RunAhead {
+public:
+    RunAhead(const unsigned frames, const uint64_t instructions_per_frame);
+
+    // call after every real frame of `chip8` to bring the speculation up to
+    // date, with `keyed` set if any keys went down or up during it; returns
+    // the screen to present in place of `chip8`'s
+    Screen<64, 32>& speculate(const Chip8& chip8, const bool keyed);
+
+    // throw away the speculation (e.g. after rewinding `chip8`), so the next
+    // `speculate` starts over from `chip8`
+    void forget();
+
+private:
+    unsigned frames;
+    uint64_t instructions_per_frame;
+
+    Chip8 ahead{};
+    bool synced = false;
+
+    // the keys `ahead` has been running with
+    std::array<bool, 16> keys = {};
+
+    // what's being presented; only touched when the speculation's screen
+    // actually differs, so unchanged frames still don't get presented again
+    Screen<64, 32> screen{};
+
+    // scratch space for copying the real machine's state over
+    std::vector<uint8_t> state;
+
+    void run_frame();
+};
+
+#endif
@@ -3,47 +3,184 @@
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include "fingerprint.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef CHIP8_SCREEN_H
 #define CHIP8_SCREEN_H
 
 constexpr uint32_t ACTIVE_COLOR = 0xFFFFFFFF; // white
 
-template <size_t WIDTH, size_t HEIGHT> 
+template <size_t WIDTH, size_t HEIGHT>
 class Screen {
+    // NOTE: sprites wrap around horizontally by rotating within a word (or
+    // get clipped by shifting out of one), so a row has to fill one exactly
+    static_assert(WIDTH == 64, "rows are packed into a single 64-bit word");
+
 public:
-    constexpr size_t width() noexcept { 
-        return WIDTH; 
+    constexpr size_t width() const noexcept {
+        return WIDTH;
     }
 
-    constexpr size_t height() noexcept { 
-        return HEIGHT; 
+    constexpr size_t height() const noexcept {
+        return HEIGHT;
     }
 
-    uint32_t* data() { 
-        return screen.data(); 
+    void clear() noexcept {
+        std::fill(rows.begin(), rows.end(), 0);
+        drawn = true;
     }
 
-    void clear() noexcept { 
-        std::fill(screen.begin(), screen.end(), 0); 
+    // XOR a row of 8 pixels (most significant bit leftmost) onto the screen
+    // starting at (x, y); true if any pixel that was already on got turned off
+    //
+    // pixels off the right or bottom edge wrap around to the other side, or,
+    // if `CLIP`, are dropped (in which case `x` has to be on the screen)
+    template <bool CLIP = false>
+    bool draw(const uint8_t x, const uint8_t y, const uint8_t byte) noexcept {
+        if (CLIP && y >= HEIGHT) {
+            return false;
+        }
+
+        // NOTE: unchecked because we wrapped, which guarantees valid offsets
+        uint64_t& row = rows[y % HEIGHT];
+        const uint64_t placed = uint64_t{byte} << (WIDTH - 8);
+        const uint64_t sprite = CLIP ? placed >> x % WIDTH : rotate_right(placed, x % WIDTH);
+        const bool collision = row & sprite;
+
+        row ^= sprite;
+
+        drawn = drawn || sprite;
+
+        return collision;
     }
 
-    // true if the pixel at (x, y) was already on, false otherwise
-    bool draw(const uint8_t x, const uint8_t y) noexcept {
-        uint8_t wrapped_x = x % WIDTH;
-        uint8_t wrapped_y = y % HEIGHT;
-        size_t offset = wrapped_x + wrapped_y * WIDTH;
-        bool is_on = screen[offset] == ACTIVE_COLOR;
+    // true if anything has been drawn (or cleared) since the last `clean`
+    bool dirty() const noexcept {
+        return drawn;
+    }
 
-        // NOTE: unchecked because we wrapped, which guarantees valid offsets
-        screen[offset] = is_on ? 0 : ACTIVE_COLOR;
+    // forget about everything that's been drawn so far (e.g. once it's been
+    // presented)
+    void clean() noexcept {
+        drawn = false;
+    }
+
+    // true if the pixel at (x, y) is on
+    bool pixel(const uint8_t x, const uint8_t y) const noexcept {
+        return rows[y % HEIGHT] >> (WIDTH - 1 - x % WIDTH) & 1;
+    }
+
+    // a 64-bit FNV-1a hash of the pixels, for telling screens apart without
+    // keeping them around
+    uint64_t hash() const noexcept {
+        uint64_t hash = 0xCBF29CE484222325;
+
+        for (const uint64_t row : rows) {
+            for (size_t byte = 0; byte < sizeof(row); ++byte) {
+                hash ^= row >> (byte * 8) & 0xFF;
+                hash *= 0x100000001B3;
+            }
+        }
+
+        return hash;
+    }
+
+    // a fingerprint of the pixels (see `fingerprint.h`); unlike `hash`, this
+    // only mixes in the rows that have changed since it was last asked for
+    //
+    // NOTE: the rows are compared against the ones we last fingerprinted,
+    // rather than `draw` keeping track, since drawing happens far more often
+    // than fingerprinting; the catch is that this isn't safe to call from two
+    // threads at once, even though it's const
+    uint64_t fingerprint() const noexcept {
+        for (size_t y = 0; y < HEIGHT; ++y) {
+            if (rows[y] != fingerprinted[y]) {
+                whole ^= word_key(Part::screen, y, fingerprinted[y]) ^ word_key(Part::screen, y, rows[y]);
+                fingerprinted[y] = rows[y];
+            }
+        }
+
+        return whole;
+    }
 
-        return is_on;
+    // the pixels, one word per row (see `rows`), e.g. for save states
+    const std::array<uint64_t, HEIGHT>& packed() const noexcept {
+        return rows;
     }
+
+    // replace every pixel with ones previously taken from `packed`
+    void restore(const std::array<uint64_t, HEIGHT>& packed) noexcept {
+        rows = packed;
+        drawn = true;
+    }
+
+    // write the screen out as 32-bit pixels (`ACTIVE_COLOR` if on, 0 if off),
+    // with rows starting `stride` pixels apart
+    void expand(uint32_t* pixels, const size_t stride) const noexcept {
+        expand(pixels, stride, 0, HEIGHT);
+    }
+
+    // same as above, but only for the rows from `first` up to (but not
+    // including) `last`, starting at the beginning of `pixels`
+    void expand(uint32_t* pixels, const size_t stride, const size_t first, const size_t last) const noexcept {
+        for (size_t y = first; y < last; ++y) {
+            expand_row(rows[y], pixels + (y - first) * stride);
+        }
+    }
+
 private:
-    // NOTE: I'm not sure if it's UB to pass a pointer to a multidimensional
-    // array to SDL, so we're gonna use a 1D array with a stride
-    std::array<uint32_t, WIDTH * HEIGHT> screen = {};
+    // one bit per pixel, with the leftmost pixel in the most significant bit
+    std::array<uint64_t, HEIGHT> rows = {};
+
+    // the rows as of the last `fingerprint`, and what it was
+    mutable std::array<uint64_t, HEIGHT> fingerprinted = {};
+    mutable uint64_t whole = blank();
+
+    // whether anything's been drawn since the last `clean` (which rows is up
+    // to whoever presents it, see `Platform::present`); it starts out set so
+    // the first frame always gets presented
+    bool drawn = true;
+
+    static constexpr uint64_t blank() noexcept {
+        uint64_t fingerprint = 0;
+
+        for (size_t y = 0; y < HEIGHT; ++y) {
+            fingerprint ^= word_key(Part::screen, y, 0);
+        }
+
+        return fingerprint;
+    }
+
+    static constexpr uint64_t rotate_right(const uint64_t word, const size_t by) noexcept {
+        return by == 0 ? word : word >> by | word << (64 - by);
+    }
+
+    static void expand_row(const uint64_t row, uint32_t* pixels) noexcept {
+        #ifdef __SSE2__
+        // turn each nibble into 4 pixels at once: broadcast it, pick out one
+        // bit per lane, and compare to get an all-ones or all-zeros mask
+        const __m128i bits = _mm_setr_epi32(8, 4, 2, 1);
+        const __m128i color = _mm_set1_epi32(ACTIVE_COLOR);
+
+        for (size_t x = 0; x < WIDTH; x += 4) {
+            const int nibble = row >> (WIDTH - 4 - x) & 0xF;
+            const __m128i lanes = _mm_and_si128(_mm_set1_epi32(nibble), bits);
+            const __m128i mask = _mm_cmpeq_epi32(lanes, bits);
+
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(pixels + x),
+                _mm_and_si128(mask, color));
+        }
+        #else
+        for (size_t x = 0; x < WIDTH; ++x) {
+            pixels[x] = row >> (WIDTH - 1 - x) & 1 ? ACTIVE_COLOR : 0;
+        }
+        #endif
+    }
 };
 
 #endif
@@ -0,0 +1,29 @@
+#include "specialized.h"
+#include <array>
+#include <cstdint>
+#include <utility>
+
+// NOTE: the handlers themselves are in `specialized/`, and all of this is
+// only built into the `specialized` targets
+#ifdef SPECIALIZED_DISPATCH
+
+template <typename Quirks, size_t... GROUP>
+static Specialized::Table build(std::index_sequence<GROUP...>) {
+    Specialized::Table table = {};
+
+    (Specialized::fill<GROUP, Quirks>(table), ...);
+
+    return table;
+}
+
+// NOTE: each table is built the first time a machine is given its profile,
+// which is the only time it's looked up (a machine keeps a pointer to it)
+const Specialized::Table& Specialized::table(const Profile profile) {
+    return with_quirks(profile, [](auto quirks) -> const Table& {
+        static const Table table = build<decltype(quirks)>(std::make_index_sequence<16>{});
+
+        return table;
+    });
+}
+
+#endif
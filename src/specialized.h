@@ -0,0 +1,58 @@
+#include <array>
+#include <cstdint>
+#include <utility>
+#include "chip8.h"
+
+#ifndef CHIP8_SPECIALIZED_H
+#define CHIP8_SPECIALIZED_H
+
+// an alternative to `Chip8::execute_instruction` (enabled by building with
+// `SPECIALIZED_DISPATCH`) that indexes a table with one handler per possible
+// instruction, each compiled with its operands (and the quirks of the
+// profile the table is for) baked in as constants
+//
+// NOTE: the per-instruction methods on `Chip8` are still the reference for
+// what each instruction does; the handlers either mirror them exactly or just
+// call them
+struct Specialized {
+    using Table = std::array<Chip8::Handler, 65536>;
+
+    // the handlers for every instruction as they behave under `profile`
+    // (see `Chip8::set_profile`)
+    static const Table& table(const Profile profile);
+
+    // fill in the handlers for every instruction starting with the nibble
+    // `GROUP`, as they behave under `Quirks`
+    //
+    // NOTE: each group is instantiated in a translation unit of its own (see
+    // `specialized/`), since all 65,536 handlers at once take far too long
+    // (and far too much memory) to compile
+    template <uint16_t GROUP, typename Quirks>
+    static void fill(Table& table);
+
+private:
+    static constexpr bool quirky(const uint16_t instruction);
+
+    template <uint16_t INSTRUCTION, typename Quirks>
+    static constexpr Chip8::Handler entry();
+
+    template <uint16_t INSTRUCTION>
+    static void handler(Chip8& chip8);
+
+    template <uint16_t INSTRUCTION>
+    static void reference(Chip8& chip8, void (Chip8::*instruction)());
+
+    template <uint16_t INSTRUCTION, typename Quirks>
+    static void quirked(Chip8& chip8);
+
+    template <uint8_t N, typename Quirks>
+    static void draw(Chip8& chip8, const uint8_t x, const uint8_t y);
+
+    template <uint16_t FIRST, typename Quirks, size_t... LOW>
+    static void fill_block(Table& table, std::index_sequence<LOW...>);
+
+    template <uint16_t GROUP, typename Quirks, size_t... BLOCK>
+    static void fill_blocks(Table& table, std::index_sequence<BLOCK...>);
+};
+
+#endif
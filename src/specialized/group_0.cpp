@@ -0,0 +1,10 @@
+#include "handlers.h"
+
+// NOTE: only built into the `specialized` targets, a group to a translation
+// unit (see the Makefile)
+#ifdef SPECIALIZED_DISPATCH
+template void Specialized::fill<0x0, CosmacVip>(Specialized::Table& table);
+template void Specialized::fill<0x0, Chip48>(Specialized::Table& table);
+template void Specialized::fill<0x0, SuperChip>(Specialized::Table& table);
+template void Specialized::fill<0x0, Modern>(Specialized::Table& table);
+#endif
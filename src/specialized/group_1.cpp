@@ -0,0 +1,10 @@
+#include "handlers.h"
+
+// NOTE: only built into the `specialized` targets, a group to a translation
+// unit (see the Makefile)
+#ifdef SPECIALIZED_DISPATCH
+template void Specialized::fill<0x1, CosmacVip>(Specialized::Table& table);
+template void Specialized::fill<0x1, Chip48>(Specialized::Table& table);
+template void Specialized::fill<0x1, SuperChip>(Specialized::Table& table);
+template void Specialized::fill<0x1, Modern>(Specialized::Table& table);
+#endif
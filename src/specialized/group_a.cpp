@@ -0,0 +1,10 @@
+#include "handlers.h"
+
+// NOTE: only built into the `specialized` targets, a group to a translation
+// unit (see the Makefile)
+#ifdef SPECIALIZED_DISPATCH
+template void Specialized::fill<0xA, CosmacVip>(Specialized::Table& table);
+template void Specialized::fill<0xA, Chip48>(Specialized::Table& table);
+template void Specialized::fill<0xA, SuperChip>(Specialized::Table& table);
+template void Specialized::fill<0xA, Modern>(Specialized::Table& table);
+#endif
@@ -0,0 +1,238 @@
+#include <array>
+#include <cstdint>
+#include <utility>
+#include "../specialized.h"
+
+#ifndef CHIP8_SPECIALIZED_HANDLERS_H
+#define CHIP8_SPECIALIZED_HANDLERS_H
+
+// the handlers behind `Specialized`'s tables, included by the translation
+// unit for each group of them (see `Specialized::fill`)
+
+// whether what `instruction` does depends on the profile (see `Profile`),
+// i.e. whether it needs a handler per profile
+constexpr bool Specialized::quirky(const uint16_t instruction) {
+    switch (instruction >> 12) {
+        case 0x8:
+            switch (instruction & 0x000F) {
+                case 0x1: case 0x2: case 0x3: case 0x6: case 0xE: return true;
+                default: return false;
+            }
+        case 0xB: return true;
+        case 0xD: return true;
+        case 0xF: return (instruction & 0x00FF) == 0x55 || (instruction & 0x00FF) == 0x65;
+        default: return false;
+    }
+}
+
+// an instruction that does the same under every profile (see `quirked` for
+// the rest)
+template <uint16_t INSTRUCTION>
+void Specialized::handler(Chip8& chip8) {
+    static_assert(!quirky(INSTRUCTION), "instructions that depend on the profile have a handler per profile");
+
+    constexpr uint16_t nnn = INSTRUCTION & 0x0FFF;
+    constexpr uint8_t nn = INSTRUCTION & 0x00FF;
+    constexpr uint8_t n = INSTRUCTION & 0x000F;
+    constexpr uint8_t x = (INSTRUCTION & 0x0F00) >> 8;
+    constexpr uint8_t y = (INSTRUCTION & 0x00F0) >> 4;
+
+    auto& v = chip8.registers;
+
+    if constexpr (INSTRUCTION >> 12 == 0x0) {
+        if constexpr (nn == 0xE0) {
+            chip8.cls();
+        } else if constexpr (nn == 0xEE) {
+            chip8.ret<Checked>();
+        } else {
+            chip8.illegal();
+        }
+    } else if constexpr (INSTRUCTION >> 12 == 0x1) {
+        chip8.jump(nnn);
+    } else if constexpr (INSTRUCTION >> 12 == 0x2) {
+        reference<INSTRUCTION>(chip8, &Chip8::call_nnn<Checked>);
+    } else if constexpr (INSTRUCTION >> 12 == 0x3) {
+        chip8.skip_if(v[x] == nn);
+    } else if constexpr (INSTRUCTION >> 12 == 0x4) {
+        chip8.skip_if(v[x] != nn);
+    } else if constexpr (INSTRUCTION >> 12 == 0x5) {
+        if constexpr (n) {
+            chip8.illegal();
+        } else {
+            chip8.skip_if(v[x] == v[y]);
+        }
+    } else if constexpr (INSTRUCTION >> 12 == 0x6) {
+        v[x] = nn;
+    } else if constexpr (INSTRUCTION >> 12 == 0x7) {
+        v[x] += nn;
+    } else if constexpr (INSTRUCTION >> 12 == 0x8) {
+        // NOTE: `VF` is always written before `VX`, same as the reference
+        if constexpr (n == 0x0) {
+            v[x] = v[y];
+        } else if constexpr (n == 0x4) {
+            const uint16_t sum = v[x] + v[y];
+
+            v[0xF] = sum > UINT8_MAX;
+            v[x] = sum;
+        } else if constexpr (n == 0x5) {
+            v[0xF] = v[x] > v[y];
+            v[x] -= v[y];
+        } else if constexpr (n == 0x7) {
+            v[0xF] = v[y] > v[x];
+            v[x] = v[y] - v[x];
+        } else {
+            chip8.illegal();
+        }
+    } else if constexpr (INSTRUCTION >> 12 == 0x9) {
+        if constexpr (n) {
+            chip8.illegal();
+        } else {
+            chip8.skip_if(v[x] != v[y]);
+        }
+    } else if constexpr (INSTRUCTION >> 12 == 0xA) {
+        chip8.index = nnn;
+    } else if constexpr (INSTRUCTION >> 12 == 0xC) {
+        reference<INSTRUCTION>(chip8, &Chip8::rnd_vx_nn);
+    } else if constexpr (INSTRUCTION >> 12 == 0xE) {
+        if constexpr (nn == 0x9E || nn == 0xA1) {
+            if (v[x] >= chip8.keys_pressed.size()) {
+                chip8.fail(Fault::key_out_of_range);
+            } else {
+                chip8.skip_if(chip8.keys_pressed[v[x]] == (nn == 0x9E));
+            }
+        } else {
+            chip8.illegal();
+        }
+    } else {
+        if constexpr (nn == 0x07) {
+            v[x] = chip8.delay_timer;
+        } else if constexpr (nn == 0x0A) {
+            reference<INSTRUCTION>(chip8, &Chip8::ld_vx_k);
+        } else if constexpr (nn == 0x15) {
+            chip8.delay_timer = v[x];
+        } else if constexpr (nn == 0x18) {
+            chip8.sound_timer = v[x];
+        } else if constexpr (nn == 0x1E) {
+            chip8.index += v[x];
+        } else if constexpr (nn == 0x29) {
+            chip8.index = v[x] * FONT_STRIDE + FONT_ADDRESS;
+        } else if constexpr (nn == 0x33) {
+            reference<INSTRUCTION>(chip8, &Chip8::ld_b_vx<Checked>);
+        } else {
+            chip8.illegal();
+        }
+    }
+}
+
+// run the reference implementation of an instruction that's not worth
+// specializing (it touches memory, the screen, etc.)
+template <uint16_t INSTRUCTION>
+void Specialized::reference(Chip8& chip8, void (Chip8::*instruction)()) {
+    chip8.operands = {
+        INSTRUCTION & 0x0FFF,
+        INSTRUCTION & 0x00FF,
+        INSTRUCTION & 0x000F,
+        (INSTRUCTION & 0x0F00) >> 8,
+        (INSTRUCTION & 0x00F0) >> 4
+    };
+
+    (chip8.*instruction)();
+}
+
+// an instruction that does something different under some profiles, as it
+// behaves under the one `Quirks` stands for
+template <uint16_t INSTRUCTION, typename Quirks>
+void Specialized::quirked(Chip8& chip8) {
+    constexpr uint16_t nnn = INSTRUCTION & 0x0FFF;
+    constexpr uint8_t nn = INSTRUCTION & 0x00FF;
+    constexpr uint8_t n = INSTRUCTION & 0x000F;
+    constexpr uint8_t x = (INSTRUCTION & 0x0F00) >> 8;
+    constexpr uint8_t y = (INSTRUCTION & 0x00F0) >> 4;
+
+    auto& v = chip8.registers;
+
+    if constexpr (INSTRUCTION >> 12 == 0x8) {
+        if constexpr (n == 0x1) {
+            v[x] |= v[y];
+        } else if constexpr (n == 0x2) {
+            v[x] &= v[y];
+        } else if constexpr (n == 0x3) {
+            v[x] ^= v[y];
+        } else {
+            const uint8_t source = Quirks::SHIFT_VY ? v[y] : v[x];
+
+            v[0xF] = n == 0x6 ? source & 1 : source >> 7;
+            v[x] = n == 0x6 ? source >> 1 : source << 1;
+        }
+
+        if constexpr (n <= 0x3 && Quirks::RESET_VF) {
+            v[0xF] = 0;
+        }
+    } else if constexpr (INSTRUCTION >> 12 == 0xB) {
+        chip8.pc = v[Quirks::JUMP_VX ? x : 0] + nnn;
+    } else if constexpr (INSTRUCTION >> 12 == 0xD) {
+        draw<n, Quirks>(chip8, x, y);
+    } else if constexpr (nn == 0x55) {
+        reference<INSTRUCTION>(chip8, &Chip8::ld_mem_vx<Checked, Quirks>);
+    } else {
+        reference<INSTRUCTION>(chip8, &Chip8::ld_vx_mem<Checked, Quirks>);
+    }
+}
+
+// DXYN, the same as `Chip8::drw_vx_vy_n`, with the height and profile baked
+// in
+//
+// NOTE: the registers aren't, since they'd only save an index and would mean
+// 256 times as many copies of the loop
+template <uint8_t N, typename Quirks>
+void Specialized::draw(Chip8& chip8, const uint8_t x, const uint8_t y) {
+    auto& screen = chip8.screen;
+    const auto& memory = chip8.memory;
+    const size_t index = chip8.index;
+    const uint8_t left = Quirks::CLIP ? chip8.registers[x] % screen.width() : chip8.registers[x];
+    const uint8_t top = Quirks::CLIP ? chip8.registers[y] % screen.height() : chip8.registers[y];
+    bool collision = false;
+
+    if (index + N > memory.size()) {
+        return chip8.fail(Fault::draw_outside_memory);
+    }
+
+    for (uint8_t dy = 0; dy < N; ++dy) {
+        collision |= screen.template draw<Quirks::CLIP>(left, top + dy, memory[index + dy]);
+    }
+
+    chip8.registers[0xF] = collision;
+}
+
+// the handler for `INSTRUCTION` under `Quirks`
+//
+// NOTE: only the instructions that depend on the profile get a copy per
+// profile; the rest are shared by every profile's table
+template <uint16_t INSTRUCTION, typename Quirks>
+constexpr Chip8::Handler Specialized::entry() {
+    if constexpr (quirky(INSTRUCTION)) {
+        return &quirked<INSTRUCTION, Quirks>;
+    } else {
+        return &handler<INSTRUCTION>;
+    }
+}
+
+// fill in the handlers for the 256 instructions starting at `FIRST`
+template <uint16_t FIRST, typename Quirks, size_t... LOW>
+void Specialized::fill_block(Table& table, std::index_sequence<LOW...>) {
+    ((table[FIRST | LOW] = entry<FIRST | LOW, Quirks>()), ...);
+}
+
+template <uint16_t GROUP, typename Quirks, size_t... BLOCK>
+void Specialized::fill_blocks(Table& table, std::index_sequence<BLOCK...>) {
+    (fill_block<GROUP << 12 | BLOCK << 8, Quirks>(table, std::make_index_sequence<256>{}), ...);
+}
+
+// NOTE: a block at a time, which keeps the pack expansions (and the
+// compiler's memory usage) manageable
+template <uint16_t GROUP, typename Quirks>
+void Specialized::fill(Table& table) {
+    fill_blocks<GROUP, Quirks>(table, std::make_index_sequence<16>{});
+}
+
+#endif
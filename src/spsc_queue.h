@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#ifndef CHIP8_SPSC_QUEUE_H
+#define CHIP8_SPSC_QUEUE_H
+
+// a fixed-size queue for passing values from one thread to one other thread
+// without locking (e.g. input events from the window to the emulator)
+//
+// NOTE: `push` fails rather than waiting when the queue's full, so the
+// producer never stalls on a consumer that's busy with something else
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity has to be a power of two");
+
+public:
+    // only for the producer; false (dropping `value`) if the queue's full
+    bool push(const T& value) noexcept {
+        const size_t at = head.load(std::memory_order_relaxed);
+
+        if (at - tail.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+
+        slots[at % CAPACITY] = value;
+        head.store(at + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // only for the consumer; false if there's nothing to take
+    bool pop(T& value) noexcept {
+        const size_t at = tail.load(std::memory_order_relaxed);
+
+        if (at == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = slots[at % CAPACITY];
+        tail.store(at + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // only for the producer; pushes as many of `values` as there's room for
+    // and returns how many that was
+    size_t push(const T* values, const size_t count) noexcept {
+        const size_t at = head.load(std::memory_order_relaxed);
+        const size_t pushed = std::min(count, CAPACITY - (at - tail.load(std::memory_order_acquire)));
+
+        for (size_t i = 0; i < pushed; ++i) {
+            slots[(at + i) % CAPACITY] = values[i];
+        }
+
+        head.store(at + pushed, std::memory_order_release);
+
+        return pushed;
+    }
+
+    // only for the consumer; takes up to `count` values into `values` and
+    // returns how many it took
+    size_t pop(T* values, const size_t count) noexcept {
+        const size_t at = tail.load(std::memory_order_relaxed);
+        const size_t popped = std::min(count, head.load(std::memory_order_acquire) - at);
+
+        for (size_t i = 0; i < popped; ++i) {
+            values[i] = slots[(at + i) % CAPACITY];
+        }
+
+        tail.store(at + popped, std::memory_order_release);
+
+        return popped;
+    }
+
+    // how many values are waiting; only exact from the producer's or
+    // consumer's side, and only as far as their own end goes (the other end
+    // may have moved since)
+    size_t size() const noexcept {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, CAPACITY> slots{};
+
+    // NOTE: on separate cache lines, since each is written by a different
+    // thread
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif
@@ -1,20 +1,55 @@
 #include <array>
 #include <algorithm>
+#include <cstdint>
+#include <stdexcept>
 
 #ifndef CHIP8_STACK_H
 #define CHIP8_STACK_H
 
 template<size_t N>
 class Stack {
+    friend class Chip8;
+    friend class Debugger;
+    friend class Jit;
+    template <size_t, typename, typename> friend class Lockstep;
 public:
+    // NOTE: over- and underflows are checked up front (rather than left to
+    // `at`) so they leave the stack as it was and say what actually happened
     uint16_t pop() {
+        if (stack_pointer == 0) {
+            throw std::out_of_range{"attempted to return with an empty stack"};
+        }
+
         --stack_pointer;
-        return stack.at(stack_pointer);
+        return stack[stack_pointer];
     }
     void push(const uint16_t address) {
-        stack.at(stack_pointer) = address;
+        if (stack_pointer == N) {
+            throw std::out_of_range{"attempted to call with a full stack"};
+        }
+
+        stack[stack_pointer] = address;
         ++stack_pointer;
     }
+    // NOTE: unchecked, for when a ROM's trusted not to over- or underflow
+    // the stack (and it can just wrap around if it does); a full stack still
+    // holds all `N` entries, same as with the checked ones, and only wraps on
+    // the call that would have overflowed it
+    uint16_t pop_wrapped() noexcept {
+        stack_pointer = (stack_pointer - 1) % N;
+        return stack[stack_pointer];
+    }
+    void push_wrapped(const uint16_t address) noexcept {
+        stack_pointer %= N;
+        stack[stack_pointer] = address;
+        ++stack_pointer;
+    }
+    bool empty() const noexcept {
+        return stack_pointer == 0;
+    }
+    bool full() const noexcept {
+        return stack_pointer == N;
+    }
     void clear() {
         std::fill(stack.begin(), stack.end(), 0);
         stack_pointer = 0;
@@ -0,0 +1,381 @@
+#include "trace.h"
+#include "bytes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+// trace segments start with this, then `TRACE_VERSION`, then the sequence
+// number of their first record; after that come chunks, each a record count,
+// a size in bytes, then that many bytes of encoded records
+constexpr std::array<uint8_t, 4> TRACE_MAGIC = {'C', '8', 'T', 'R'};
+constexpr uint16_t TRACE_VERSION = 1;
+constexpr size_t SEGMENT_HEADER_SIZE = 4 + 2 + 8;
+constexpr size_t CHUNK_HEADER_SIZE = 4 + 4;
+
+// at most this many records go into one chunk
+constexpr size_t CHUNK_RECORDS = 1 << 16;
+
+// how many segments are kept on disk: enough that the ones before the one
+// being written hold at least `keep` records between them
+constexpr uint64_t KEPT_SEGMENTS = 5;
+
+// each record is encoded as a byte saying which of its fields weren't what we
+// predicted, followed by just those fields (least significant byte first);
+// we predict that `pc` moved on by one instruction, that the instruction is
+// the one we last saw at that `pc`, and that everything else stayed the same,
+// which is right for most fields of most records in a loop
+//
+// NOTE: each chunk is encoded on its own, so it can be decoded without the
+// ones before it (which may have been deleted)
+class Codec {
+public:
+    void encode(const TraceRecord& record, std::vector<uint8_t>& out) {
+        const uint16_t instruction = instructions[record.pc % instructions.size()];
+        const uint8_t changed = (record.pc != static_cast<uint16_t>(previous.pc + 2)) << 0
+            | (record.instruction != instruction) << 1
+            | (record.index != previous.index) << 2
+            | (record.vx != previous.vx) << 3
+            | (record.vf != previous.vf) << 4;
+        auto into = std::back_inserter(out);
+
+        out.push_back(changed);
+
+        if (changed & 1 << 0) {
+            into = put_le(into, record.pc);
+        }
+
+        if (changed & 1 << 1) {
+            into = put_le(into, record.instruction);
+        }
+
+        if (changed & 1 << 2) {
+            into = put_le(into, record.index);
+        }
+
+        if (changed & 1 << 3) {
+            into = put_le(into, record.vx);
+        }
+
+        if (changed & 1 << 4) {
+            put_le(into, record.vf);
+        }
+
+        remember(record);
+    }
+
+    // false if `in` runs out before the record does
+    bool decode(const uint8_t*& in, const uint8_t* end, TraceRecord& record) {
+        if (in == end) {
+            return false;
+        }
+
+        const uint8_t changed = *in++;
+        const size_t size = (changed & 1 << 0 ? 2 : 0)
+            + (changed & 1 << 1 ? 2 : 0)
+            + (changed & 1 << 2 ? 2 : 0)
+            + (changed & 1 << 3 ? 1 : 0)
+            + (changed & 1 << 4 ? 1 : 0);
+
+        if (static_cast<size_t>(end - in) < size) {
+            return false;
+        }
+
+        record = previous;
+        record.pc = previous.pc + 2;
+
+        if (changed & 1 << 0) {
+            in = get_le(in, record.pc);
+        }
+
+        record.instruction = instructions[record.pc % instructions.size()];
+
+        if (changed & 1 << 1) {
+            in = get_le(in, record.instruction);
+        }
+
+        if (changed & 1 << 2) {
+            in = get_le(in, record.index);
+        }
+
+        if (changed & 1 << 3) {
+            in = get_le(in, record.vx);
+        }
+
+        if (changed & 1 << 4) {
+            in = get_le(in, record.vf);
+        }
+
+        remember(record);
+
+        return true;
+    }
+
+private:
+    TraceRecord previous{};
+    std::array<uint16_t, 4096> instructions = {};
+
+    void remember(const TraceRecord& record) {
+        previous = record;
+        instructions[record.pc % instructions.size()] = record.instruction;
+    }
+};
+
+// every segment with this prefix on disk, oldest first
+static std::vector<std::string> find_segments(const std::string& prefix) {
+    const std::filesystem::path path{prefix};
+    const auto directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path{"."};
+    const std::string stem = path.filename().string() + '.';
+    const std::string extension = ".c8tr";
+    std::vector<std::pair<uint64_t, std::string>> found;
+    std::error_code error;
+
+    for (const auto& entry : std::filesystem::directory_iterator{directory, error}) {
+        const std::string name = entry.path().filename().string();
+
+        if (name.size() <= stem.size() + extension.size()
+                || name.compare(0, stem.size(), stem) != 0
+                || name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+            continue;
+        }
+
+        const std::string number = name.substr(stem.size(), name.size() - stem.size() - extension.size());
+
+        if (std::all_of(number.begin(), number.end(), [](const char c) { return c >= '0' && c <= '9'; })) {
+            found.emplace_back(std::stoull(number), entry.path().string());
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::string> segments;
+
+    for (auto& [number, name] : found) {
+        segments.push_back(std::move(name));
+    }
+
+    return segments;
+}
+
+// NOTE: only the builds that trace need the writer (and a thread to run it
+// on); the reader's always there for `chip8-trace`
+#ifdef TRACE
+
+static std::string segment_name(const std::string& prefix, const uint64_t number) {
+    std::ostringstream name;
+
+    name << prefix << '.' << std::setw(6) << std::setfill('0') << number << ".c8tr";
+
+    return name.str();
+}
+
+Tracer::Tracer(const std::string& prefix, const uint64_t keep)
+    : prefix{prefix},
+      segment_records{std::max<uint64_t>((keep + KEPT_SEGMENTS - 2) / (KEPT_SEGMENTS - 1), CHUNK_RECORDS)},
+      ring{new TraceRecord[RING]} {
+    // NOTE: so a reader doesn't mix what's left over from an earlier trace
+    // into this one
+    for (const auto& name : find_segments(prefix)) {
+        std::remove(name.c_str());
+    }
+
+    open_segment();
+
+    if (!file) {
+        throw std::runtime_error{"error opening trace file"};
+    }
+
+    writer = std::thread{&Tracer::run, this};
+}
+
+Tracer::~Tracer() {
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+}
+
+void Tracer::flush() {
+    while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+}
+
+bool Tracer::failed() const {
+    return error.load(std::memory_order_relaxed);
+}
+
+void Tracer::wait_for_room(const uint64_t at) {
+    for (;;) {
+        cached_tail = tail.load(std::memory_order_acquire);
+
+        if (at - cached_tail < RING) {
+            return;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+// the writer: drain the ring a chunk at a time until we're told to stop (and
+// there's nothing left)
+void Tracer::run() {
+    uint64_t drained = 0;
+
+    for (;;) {
+        // NOTE: checked before looking at `head`, so everything recorded
+        // before stopping still gets drained
+        const bool stop = stopping.load(std::memory_order_acquire);
+        const uint64_t end = head.load(std::memory_order_acquire);
+
+        if (drained == end) {
+            if (stop) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            continue;
+        }
+
+        while (drained < end) {
+            const size_t count = std::min<uint64_t>({end - drained, CHUNK_RECORDS, RING - drained % RING});
+
+            write(&ring[drained % RING], count);
+            drained += count;
+            tail.store(drained, std::memory_order_release);
+        }
+
+        file.flush();
+    }
+}
+
+void Tracer::write(const TraceRecord* records, const size_t count) {
+    if (error.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    Codec codec;
+
+    chunk.resize(CHUNK_HEADER_SIZE);
+
+    for (size_t i = 0; i < count; ++i) {
+        codec.encode(records[i], chunk);
+    }
+
+    put_le(chunk.data(), static_cast<uint32_t>(count));
+    put_le(chunk.data() + 4, static_cast<uint32_t>(chunk.size() - CHUNK_HEADER_SIZE));
+
+    file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    written += count;
+
+    if (written >= (segment + 1) * segment_records) {
+        ++segment;
+        open_segment();
+    }
+
+    if (!file) {
+        error.store(true, std::memory_order_relaxed);
+    }
+}
+
+void Tracer::open_segment() {
+    if (segment >= KEPT_SEGMENTS) {
+        std::remove(segment_name(prefix, segment - KEPT_SEGMENTS).c_str());
+    }
+
+    std::array<uint8_t, SEGMENT_HEADER_SIZE> header;
+
+    put_le(put_le(std::copy(TRACE_MAGIC.begin(), TRACE_MAGIC.end(), header.begin()), TRACE_VERSION), written);
+
+    file.close();
+    file.open(segment_name(prefix, segment), std::ios::binary | std::ios::out | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+}
+
+#endif
+
+TraceReader::TraceReader(const std::string& prefix)
+    : segments{find_segments(prefix)} {
+    if (segments.empty()) {
+        throw std::runtime_error{"no trace found at " + prefix};
+    }
+}
+
+bool TraceReader::next(uint64_t& sequence, TraceRecord& record) {
+    while (at == records.size()) {
+        if (!file.is_open() || !read_chunk()) {
+            if (!open_next()) {
+                return false;
+            }
+        }
+    }
+
+    sequence = this->sequence++;
+    record = records[at++];
+
+    return true;
+}
+
+bool TraceReader::open_next() {
+    if (segment == segments.size()) {
+        return false;
+    }
+
+    const std::string& name = segments[segment++];
+    std::array<uint8_t, SEGMENT_HEADER_SIZE> header;
+    uint16_t version = 0;
+
+    file.close();
+    file.open(name, std::ios::binary | std::ios::in);
+
+    if (!file.read(reinterpret_cast<char*>(header.data()), header.size())
+            || !std::equal(TRACE_MAGIC.begin(), TRACE_MAGIC.end(), header.begin())) {
+        throw std::runtime_error{name + " is not a trace"};
+    }
+
+    get_le(get_le(header.data() + TRACE_MAGIC.size(), version), sequence);
+
+    if (version != TRACE_VERSION) {
+        throw std::runtime_error{name + " is from an incompatible version"};
+    }
+
+    records.clear();
+    at = 0;
+
+    return true;
+}
+
+// NOTE: a chunk cut short (e.g. because the traced process was killed while
+// writing it) is treated as the end of its segment
+bool TraceReader::read_chunk() {
+    std::array<uint8_t, CHUNK_HEADER_SIZE> header;
+    uint32_t count = 0;
+    uint32_t size = 0;
+
+    if (!file.read(reinterpret_cast<char*>(header.data()), header.size())) {
+        return false;
+    }
+
+    get_le(get_le(header.data(), count), size);
+    chunk.resize(size);
+
+    if (!file.read(reinterpret_cast<char*>(chunk.data()), size)) {
+        return false;
+    }
+
+    Codec codec;
+    const uint8_t* in = chunk.data();
+
+    records.resize(count);
+    at = 0;
+
+    for (TraceRecord& record : records) {
+        if (!codec.decode(in, chunk.data() + chunk.size(), record)) {
+            throw std::runtime_error{"trace is corrupt"};
+        }
+    }
+
+    return true;
+}
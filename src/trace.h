@@ -0,0 +1,115 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef CHIP8_TRACE_H
+#define CHIP8_TRACE_H
+
+// one instruction that ran: where, what it was, and what `I`, `VX` (X being
+// the instruction's second nibble) and `VF` were once it had
+struct TraceRecord {
+    uint16_t pc = 0;
+    uint16_t instruction = 0;
+    uint16_t index = 0;
+    uint8_t vx = 0;
+    uint8_t vf = 0;
+};
+
+// records every instruction a machine runs (when built with `TRACE`) to disk,
+// so whatever led up to a fault can be looked at afterwards (see
+// `TraceReader`)
+//
+// records go into a lock-free ring buffer, which a background thread drains,
+// compresses a chunk at a time and writes out, so recording one only costs a
+// store or two; the trace is split over numbered segment files
+// (`<prefix>.<number>.c8tr`), and the oldest get deleted as new ones are
+// started, so only about the last `keep` instructions stay on disk
+//
+// NOTE: if the writer falls a whole ring behind, recording waits for it
+// rather than dropping anything
+class Tracer {
+public:
+    Tracer(const std::string& prefix, const uint64_t keep);
+    ~Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    void record(const TraceRecord& record) {
+        const uint64_t at = head.load(std::memory_order_relaxed);
+
+        if (at - cached_tail == RING) {
+            wait_for_room(at);
+        }
+
+        ring[at % RING] = record;
+        head.store(at + 1, std::memory_order_release);
+    }
+
+    // wait until everything recorded so far is on disk
+    void flush();
+
+    // true if writing the trace out failed at some point (everything after
+    // that is thrown away)
+    bool failed() const;
+
+private:
+    static constexpr uint64_t RING = 1 << 20;
+
+    std::string prefix;
+    uint64_t segment_records;
+
+    std::unique_ptr<TraceRecord[]> ring;
+
+    // NOTE: on separate cache lines, since each is written by a different
+    // thread; `cached_tail` is the producer's last look at `tail`, so it only
+    // has to read the writer's line when the ring looks full
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cached_tail = 0;
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> error{false};
+
+    // everything from here on is only touched by the writer (after the
+    // constructor's done)
+    std::ofstream file;
+    uint64_t segment = 0;
+    uint64_t written = 0;
+    std::vector<uint8_t> chunk;
+    std::thread writer;
+
+    void wait_for_room(const uint64_t at);
+    void run();
+    void write(const TraceRecord* records, const size_t count);
+    void open_segment();
+};
+
+// reads back every record a `Tracer` left on disk, oldest first
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& prefix);
+
+    // the next record and which instruction (counting from the first one the
+    // `Tracer` recorded) it was; false once there are none left
+    bool next(uint64_t& sequence, TraceRecord& record);
+
+private:
+    std::vector<std::string> segments;
+    size_t segment = 0;
+    std::ifstream file;
+    uint64_t sequence = 0;
+
+    std::vector<uint8_t> chunk;
+    std::vector<TraceRecord> records;
+    size_t at = 0;
+
+    bool open_next();
+    bool read_chunk();
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "../trace.h"
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// decodes a trace left by `chip8-traced --trace <prefix>` and prints the
+// records that match, one per line, oldest first:
+//
+//   <sequence> <pc> <instruction> I=<index> VX=<VX> VF=<VF>
+//
+// `--pc` only keeps the instructions that ran at one address, `--match` only
+// keeps instructions that look like a pattern (four hex digits, with `?` for
+// any digit, e.g. `D???` for every draw), and `--last` only prints the last
+// however many matches (e.g. what led up to a fault)
+
+// an instruction pattern like `8??E`, as a mask of the digits that matter and
+// what they have to be
+struct Pattern {
+    uint16_t mask = 0;
+    uint16_t value = 0;
+
+    bool matches(const uint16_t instruction) const {
+        return (instruction & mask) == value;
+    }
+};
+
+static Pattern parse_pattern(const std::string& text) {
+    if (text.size() != 4) {
+        throw std::invalid_argument{"a pattern is 4 hex digits (or ?s)"};
+    }
+
+    Pattern pattern;
+
+    for (const char c : text) {
+        pattern.mask <<= 4;
+        pattern.value <<= 4;
+
+        if (c == '?') {
+            continue;
+        }
+
+        pattern.mask |= 0xF;
+        pattern.value |= std::stoul(std::string{c}, nullptr, 16);
+    }
+
+    return pattern;
+}
+
+static std::string describe(const uint64_t sequence, const TraceRecord& record) {
+    std::ostringstream out;
+
+    out << sequence << std::hex << std::uppercase << std::setfill('0')
+        << " 0x" << std::setw(3) << record.pc
+        << ' ' << std::setw(4) << record.instruction
+        << " I=0x" << std::setw(3) << record.index
+        << " VX=0x" << std::setw(2) << int{record.vx}
+        << " VF=0x" << std::setw(2) << int{record.vf};
+
+    return out.str();
+}
+
+int main(int argc, char** argv) {
+    bool usage = argc < 2;
+    std::optional<uint16_t> pc;
+    std::optional<Pattern> pattern;
+    uint64_t last = 0;
+
+    try {
+        for (int i = 2; i < argc && !usage; ++i) {
+            const std::string option = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if (option == "--pc" && has_value) {
+                pc = std::stoul(argv[++i], nullptr, 16);
+            } else if (option == "--match" && has_value) {
+                pattern = parse_pattern(argv[++i]);
+            } else if (option == "--last" && has_value) {
+                last = std::stoull(argv[++i]);
+            } else {
+                usage = true;
+            }
+        }
+
+        if (usage) {
+            std::cerr << "usage: chip8-trace <prefix> [--pc <hex address>] [--match <pattern>] [--last <count>]";
+            return EXIT_FAILURE;
+        }
+
+        TraceReader reader{argv[1]};
+        std::deque<std::string> kept;
+        uint64_t sequence = 0;
+        TraceRecord record;
+
+        while (reader.next(sequence, record)) {
+            if ((pc && record.pc != *pc) || (pattern && !pattern->matches(record.instruction))) {
+                continue;
+            }
+
+            if (last == 0) {
+                std::cout << describe(sequence, record) << '\n';
+                continue;
+            }
+
+            kept.push_back(describe(sequence, record));
+
+            if (kept.size() > last) {
+                kept.pop_front();
+            }
+        }
+
+        for (const auto& line : kept) {
+            std::cout << line << '\n';
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "chip8-trace: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#ifndef CHIP8_TRIPLE_BUFFER_H
+#define CHIP8_TRIPLE_BUFFER_H
+
+// hands the latest of a stream of values (e.g. frames) from one thread to
+// another without either ever waiting on the other: the producer fills in
+// `back` and `publish`es it, and the consumer picks up whatever was published
+// last with `update` and reads it through `front`, skipping any it was too
+// slow to see
+//
+// NOTE: the three slots are the producer's, the consumer's, and the one in
+// between; publishing or picking up is a single atomic exchange of the one
+// in between, so neither side ever touches a slot the other's using
+template <typename T>
+class TripleBuffer {
+public:
+    // the slot for the producer to fill in next
+    T& back() noexcept {
+        return slots[back_index];
+    }
+
+    // make whatever's in `back` the latest value (and start on a new `back`,
+    // which holds some older value)
+    void publish() noexcept {
+        back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // pick up the latest value, if there's been one since we last did; true
+    // if `front` changed
+    bool update() noexcept {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+
+        return true;
+    }
+
+    // the latest value we've picked up (only for the consumer)
+    const T& front() const noexcept {
+        return slots[front_index];
+    }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    std::array<T, 3> slots{};
+
+    // NOTE: on a cache line of its own, since both threads write it; the
+    // other two indices each belong to one thread
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back_index = 0;
+    alignas(64) uint8_t front_index = 2;
+};
+
+#endif
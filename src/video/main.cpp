@@ -0,0 +1,60 @@
+#include "../frame_sink.h"
+#include "../screen.h"
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// turns a delta video (see `FrameSink`), e.g. from `chip8-batch --capture
+// delta`, into something other tools can read: YUV4MPEG2 for ffmpeg, or a
+// sequence of PPM images, written to a file or `-` for standard output, e.g.
+//
+//   chip8-video 0.c8vd y4m - | ffmpeg -i - -vf scale=640:320:flags=neighbor 0.mp4
+//
+// `--stats` prints how many frames there were and what they took up instead
+
+int main(int argc, char** argv) {
+    const bool stats = argc == 3 && std::string{argv[2]} == "--stats";
+
+    if (argc != 4 && !stats) {
+        std::cerr << "usage: chip8-video <delta file> (<y4m|ppm> <output> | --stats)";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        FrameReader reader{argv[1]};
+        std::array<uint64_t, 32> rows;
+        uint64_t frames = 0;
+
+        if (stats) {
+            std::ifstream file{argv[1], std::ios::binary | std::ios::ate};
+
+            while (reader.next(rows)) {
+                ++frames;
+            }
+
+            const auto bytes = static_cast<uint64_t>(file.tellg());
+
+            std::cout << frames << " frames at " << reader.get_frequency() << " per second, "
+                << bytes << " bytes (" << (frames > 0 ? static_cast<double>(bytes) / frames : 0)
+                << " per frame)\n";
+
+            return EXIT_SUCCESS;
+        }
+
+        FrameSink sink{argv[3], find_format(argv[2]), reader.get_frequency()};
+        Screen<64, 32> screen{};
+
+        while (reader.next(rows)) {
+            screen.restore(rows);
+            sink.write(screen);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "chip8-video: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef CHIP8_VISITED_H
+#define CHIP8_VISITED_H
+
+// the fingerprints (see `Chip8::fingerprint`) of states that have already been
+// explored, so a search can tell it's been somewhere before without keeping
+// the states themselves around
+//
+// NOTE: only fingerprints are kept, so two different states with the same
+// fingerprint (about a 1 in 2^64 chance for any given pair) count as one
+class Visited {
+public:
+    explicit Visited(const size_t expected = 1024) {
+        size_t capacity = MIN_CAPACITY;
+
+        while (capacity < expected * 2) {
+            capacity *= 2;
+        }
+
+        resize(capacity);
+    }
+
+    // true if `fingerprint` wasn't in here yet (it is now)
+    bool insert(const uint64_t fingerprint) {
+        if (fingerprint == EMPTY) {
+            const bool fresh = !has_empty;
+
+            has_empty = true;
+            count += fresh;
+
+            return fresh;
+        }
+
+        // NOTE: keep at most half the slots full, so probes stay short
+        if ((count + 1) * 2 > slots.size()) {
+            resize(slots.size() * 2);
+        }
+
+        uint64_t& slot = slots[find(fingerprint)];
+
+        if (slot == fingerprint) {
+            return false;
+        }
+
+        slot = fingerprint;
+        ++count;
+
+        return true;
+    }
+
+    bool contains(const uint64_t fingerprint) const {
+        if (fingerprint == EMPTY) {
+            return has_empty;
+        }
+
+        return slots[find(fingerprint)] == fingerprint;
+    }
+
+    size_t size() const noexcept {
+        return count;
+    }
+
+    void clear() noexcept {
+        std::fill(slots.begin(), slots.end(), EMPTY);
+        has_empty = false;
+        count = 0;
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    // NOTE: marks a free slot, so the one fingerprint that happens to be this
+    // is kept track of on the side
+    static constexpr uint64_t EMPTY = 0;
+
+    // open addressing with linear probing; fingerprints are already well
+    // mixed, so their top bits pick the slot to start from
+    std::vector<uint64_t> slots;
+    unsigned shift = 0;
+    size_t count = 0;
+    bool has_empty = false;
+
+    // the slot `fingerprint` is in, or the free one it would go in
+    size_t find(const uint64_t fingerprint) const noexcept {
+        const size_t mask = slots.size() - 1;
+
+        for (size_t i = fingerprint >> shift;; i = (i + 1) & mask) {
+            if (slots[i] == fingerprint || slots[i] == EMPTY) {
+                return i;
+            }
+        }
+    }
+
+    void resize(const size_t capacity) {
+        std::vector<uint64_t> old(capacity, EMPTY);
+
+        std::swap(slots, old);
+        shift = 64 - std::countr_zero(capacity);
+
+        for (const uint64_t fingerprint : old) {
+            if (fingerprint != EMPTY) {
+                slots[find(fingerprint)] = fingerprint;
+            }
+        }
+    }
+};
+
+#endif